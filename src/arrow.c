@@ -0,0 +1,857 @@
+/* arrow.c - write shapes as an Arrow IPC file (GeoArrow) | GPL */
+
+/* The file is in the Arrow IPC file format: magic, the schema,
+ * record batches of up to ARROW_BATCHROWS rows, an end marker,
+ * and a footer that locates the batches, so readers can map the
+ * file and go straight to the columns.
+ *
+ * The geometry column follows GeoArrow's native encodings with
+ * separate coordinates: a struct of x, y (and z, m) double arrays
+ * for the vertices, nested in lists with int32 offsets for each
+ * level above: points (no lists), multipoints (one), multiline-
+ * strings (two), and multipolygons (three: polygons, rings, and
+ * vertices). Multipatches become multipolygons, too, with each
+ * triangle of a strip or fan a polygon. A column with M values
+ * gets NaN where a shape has none. Data are in native byte order,
+ * as the schema says. Attributes, if any, are string columns after
+ * the geometry.
+ *
+ * The metadata are flatbuffers, built here backwards, from the
+ * end of a buffer to its start, as the flatbuffers library does:
+ * children first, so that parents can refer forward to them.
+ */
+
+#include "arrow.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {           /* flatbuffer being built, at its end */
+  unsigned char *buf;
+  size_t cap, len;
+  size_t minalign;
+  size_t fields[8];        /* of the open table: where, 0 if not set */
+  size_t start;            /* of the open table */
+  int nfields;
+} Fb;
+
+typedef struct {           /* growable array */
+  char *p;
+  size_t len, cap;         /* in bytes */
+} Buf;
+
+typedef struct { const void *p; size_t len; } Body;
+
+typedef struct {           /* string column */
+  const char *name;
+  Buf valid, off, data;
+  long nulls;
+  const char *value;       /* for the next row, if set */
+  size_t len;
+} Text;
+
+static struct {
+  ArrowOut *out;
+  int shapetype, depth, hasz, hasm;
+  unsigned long pos;       /* bytes written */
+  long rows, nulls;        /* in the batch */
+  long count[4];           /* elements per level; count[depth] vertices */
+  Buf recno, valid, off[3], coord[4];
+  Buf blocks;              /* where the batches are */
+  Text *text;              /* attributes */
+  int ntext;
+  int failed;
+} aw;
+
+/* Flatbuffers */
+
+static int fbroom(Fb *b, size_t n)
+{
+  if (b->cap - b->len < n) {
+    size_t cap = b->cap ? 2*b->cap : 1024;
+    unsigned char *buf;
+    while (cap - b->len < n) cap *= 2;
+    if ((buf = (unsigned char *) malloc(cap)) == NULL) return aw.failed = -1;
+    if (b->len) memcpy(buf + cap - b->len, b->buf + b->cap - b->len, b->len);
+    free(b->buf);
+    b->buf = buf;
+    b->cap = cap;
+  }
+  return 0;
+}
+
+static void fbput(Fb *b, const void *p, size_t n)
+{
+  if ((n == 0) || (fbroom(b, n) < 0)) return;  /* maybe no buffer yet */
+  b->len += n;
+  if (p) memcpy(b->buf + b->cap - b->len, p, n);
+  else memset(b->buf + b->cap - b->len, 0, n);
+}
+
+/* Pad so that size-aligned data can follow extra bytes */
+static void fbprep(Fb *b, size_t size, size_t extra)
+{
+  if (size > b->minalign) b->minalign = size;
+  fbput(b, 0, (0 - (b->len + extra)) & (size - 1));
+}
+
+static void fbscalar(Fb *b, unsigned long hi, unsigned long lo, size_t size)
+{
+  unsigned char v[8];
+  size_t i;
+
+  for (i = 0; i < size; i++)  /* little endian */
+    v[i] = (unsigned char) ((i < 4 ? lo >> 8*i : hi >> 8*(i-4)) & 255);
+  fbprep(b, size, 0);
+  fbput(b, v, size);
+}
+
+#define fbint8(b, v) fbscalar((b), 0, (unsigned long) (v), 1)
+#define fbint16(b, v) fbscalar((b), 0, (unsigned long) (v), 2)
+#define fbint32(b, v) fbscalar((b), 0, (unsigned long) (v), 4)
+#define fbint64(b, v) fbscalar((b), (unsigned long) ((v) >> 16 >> 16), \
+                               (unsigned long) ((v) & 0xFFFFFFFFUL), 8)
+
+static void fboffset(Fb *b, size_t off)
+{
+  fbprep(b, 4, 0);
+  fbint32(b, b->len + 4 - off);
+}
+
+static size_t fbstring(Fb *b, const char *s)
+{
+  size_t n = strlen(s);
+
+  fbprep(b, 4, n+1);
+  fbput(b, 0, 1);
+  fbput(b, s, n);
+  fbint32(b, n);
+  return b->len;
+}
+
+static void fbvector(Fb *b, size_t elemsize, size_t n, size_t align)
+{
+  fbprep(b, 4, elemsize*n);
+  fbprep(b, align, elemsize*n);
+}
+
+static size_t fbendvector(Fb *b, size_t n)
+{
+  fbint32(b, n);
+  return b->len;
+}
+
+static size_t fboffsets(Fb *b, const size_t *offs, size_t n)
+{
+  size_t i;
+
+  fbvector(b, 4, n, 4);
+  for (i = n; i-- > 0; ) fboffset(b, offs[i]);
+  return fbendvector(b, n);
+}
+
+static void fbtable(Fb *b, int nfields)
+{
+  memset(b->fields, 0, sizeof b->fields);
+  b->nfields = nfields;
+  b->start = b->len;
+}
+
+#define fbfield(b, id) ((b)->fields[id] = (b)->len)
+#define fbaddint8(b, id, v) (fbint8((b), (v)), fbfield((b), (id)))
+#define fbaddint16(b, id, v) (fbint16((b), (v)), fbfield((b), (id)))
+#define fbaddint32(b, id, v) (fbint32((b), (v)), fbfield((b), (id)))
+#define fbaddint64(b, id, v) (fbint64((b), (v)), fbfield((b), (id)))
+#define fbaddoffset(b, id, off) (fboffset((b), (off)), fbfield((b), (id)))
+
+static size_t fbendtable(Fb *b)
+{
+  size_t table, vtable;
+  int i;
+
+  fbint32(b, 0);  /* to the vtable, set below */
+  table = b->len;
+  for (i = b->nfields; i-- > 0; )
+    fbint16(b, b->fields[i] ? table - b->fields[i] : 0);
+  fbint16(b, table - b->start);
+  fbint16(b, 4 + 2*b->nfields);
+  vtable = b->len;
+  if (!aw.failed) {
+    unsigned char *p = b->buf + b->cap - table;
+    size_t v = vtable - table;
+    p[0] = v & 255; p[1] = (v >> 8) & 255; p[2] = (v >> 16) & 255; p[3] = (v >> 24) & 255;
+  }
+  return table;
+}
+
+static void fbfinish(Fb *b, size_t root)
+{
+  fbprep(b, b->minalign, 4);
+  fboffset(b, root);
+}
+
+#define fbdata(b) ((b)->buf + (b)->cap - (b)->len)
+
+/* Arrow metadata (Schema.fbs, Message.fbs, File.fbs) */
+
+#define TYPE_INT 2
+#define TYPE_FLOAT 3
+#define TYPE_UTF8 5
+#define TYPE_LIST 12
+#define TYPE_STRUCT 13
+#define HEADER_SCHEMA 1
+#define HEADER_BATCH 3
+#define VERSION_V5 4
+
+static size_t keyvalue(Fb *b, const char *key, const char *value)
+{
+  size_t k = fbstring(b, key), v = fbstring(b, value);
+
+  fbtable(b, 2);
+  fbaddoffset(b, 0, k);
+  fbaddoffset(b, 1, v);
+  return fbendtable(b);
+}
+
+static size_t field(Fb *b, const char *name, int nullable, int type,
+                    const size_t *kids, int nkids, const char *ext)
+{
+  size_t kv[2], md = 0, nm, ch, t;
+
+  if (ext) {
+    kv[0] = keyvalue(b, "ARROW:extension:name", ext);
+    kv[1] = keyvalue(b, "ARROW:extension:metadata", "{}");
+    md = fboffsets(b, kv, 2);
+  }
+  ch = fboffsets(b, kids, nkids);
+  nm = fbstring(b, name);
+  switch (type) {
+    case TYPE_INT:
+      fbtable(b, 2);
+      fbaddint32(b, 0, 32);  /* bitWidth */
+      fbaddint8(b, 1, 1);    /* is_signed */
+      break;
+    case TYPE_FLOAT:
+      fbtable(b, 1);
+      fbaddint16(b, 0, 2);   /* DOUBLE */
+      break;
+    default:                 /* Utf8, List and Struct_ are empty */
+      fbtable(b, 0);
+  }
+  t = fbendtable(b);
+  fbtable(b, 7);
+  fbaddoffset(b, 0, nm);
+  fbaddoffset(b, 3, t);
+  fbaddoffset(b, 5, ch);
+  if (md) fbaddoffset(b, 6, md);
+  fbaddint8(b, 1, nullable);
+  fbaddint8(b, 2, type);
+  return fbendtable(b);
+}
+
+static size_t schema(Fb *b)
+{
+  static const char *levels[4][3] = {
+    { 0 }, { "points" }, { "linestrings", "vertices" },
+    { "polygons", "rings", "vertices" }
+  };
+  static const char *exts[4] = { "geoarrow.point", "geoarrow.multipoint",
+    "geoarrow.multilinestring", "geoarrow.multipolygon" };
+  static const char *dims[4] = { "x", "y", "z", "m" };
+  size_t kids[4], *top, fields;
+  unsigned int one = 1;
+  int n = 0, k, i;
+
+  if ((top = (size_t *) malloc((2 + aw.ntext) * sizeof(size_t))) == NULL)
+    return aw.failed = -1;
+  for (k = aw.ntext; k-- > 0; )
+    top[2+k] = field(b, aw.text[k].name, 1, TYPE_UTF8, 0, 0, 0);
+  for (k = 0; k < 4; k++)
+    if ((k < 2) || ((k == 2) && aw.hasz) || ((k == 3) && aw.hasm))
+      kids[n++] = field(b, dims[k], 0, TYPE_FLOAT, 0, 0, 0);
+  if (aw.depth == 0) top[1] = field(b, "geometry", 1, TYPE_STRUCT, kids, n, exts[0]);
+  else {
+    kids[0] = field(b, levels[aw.depth][aw.depth-1], 0, TYPE_STRUCT, kids, n, 0);
+    for (i = aw.depth-1; i > 0; i--)
+      kids[0] = field(b, levels[aw.depth][i-1], 0, TYPE_LIST, kids, 1, 0);
+    top[1] = field(b, "geometry", 1, TYPE_LIST, kids, 1, exts[aw.depth]);
+  }
+  top[0] = field(b, "record", 0, TYPE_INT, 0, 0, 0);
+  fields = fboffsets(b, top, 2 + aw.ntext);
+  free(top);
+  fbtable(b, 2);
+  fbaddoffset(b, 1, fields);
+  fbaddint16(b, 0, *(unsigned char *) &one ? 0 : 1);  /* endianness */
+  return fbendtable(b);
+}
+
+static void clear(void);  /* start a new batch */
+
+/* Output */
+
+static void put(const void *p, size_t n)
+{
+  static const char zeros[8] = { 0 };
+
+  if (n == 0) return;
+  aw.out(p ? p : zeros, n);
+  aw.pos += n;
+}
+
+#define pad8(n) (((n) + 7) & ~(size_t) 7)
+
+/* Write an encapsulated message (metadata in b, finished) and its
+ * body; for batches, note where they are in the footer blocks */
+static void message(Fb *b, const Body *body, int nbody, size_t bodylen, int batch)
+{
+  unsigned char head[8];
+  size_t metalen = pad8(b->len);
+  unsigned long at = aw.pos;
+  int i;
+
+  memset(head, 0xFF, 4);
+  for (i = 0; i < 4; i++) head[4+i] = (unsigned char) ((metalen >> 8*i) & 255);
+  put(head, 8);
+  put(fbdata(b), b->len);
+  put(0, metalen - b->len);
+  for (i = 0; i < nbody; i++) {
+    put(body[i].p, body[i].len);
+    put(0, pad8(body[i].len) - body[i].len);
+  }
+  if (batch) {  /* offset, metadata length, body length */
+    unsigned long block[3];
+    block[0] = at;
+    block[1] = 8 + metalen;
+    block[2] = bodylen;
+    if (aw.blocks.cap - aw.blocks.len < sizeof block) {
+      size_t cap = aw.blocks.cap ? 2*aw.blocks.cap : 64*sizeof block;
+      char *p = (char *) realloc(aw.blocks.p, cap);
+      if (p == NULL) { aw.failed = -1; return; }
+      aw.blocks.p = p;
+      aw.blocks.cap = cap;
+    }
+    memcpy(aw.blocks.p + aw.blocks.len, block, sizeof block);
+    aw.blocks.len += sizeof block;
+  }
+}
+
+static void batch(void)
+{
+  Body *body;
+  long (*nodes)[2];
+  Fb b;
+  size_t bodylen = 0, at, nodev, bufv, rb;
+  int nbody = 0, nnodes = 0, i, k;
+
+  /* record, lists, struct, x y z m, and the attributes */
+  body = (Body *) malloc((2 + 2*3 + 1 + 2*4 + 3*aw.ntext) * sizeof(Body));
+  nodes = (long (*)[2]) malloc((1 + 3 + 1 + 4 + aw.ntext) * sizeof *nodes);
+  if ((body == NULL) || (nodes == NULL)) {
+    free(body);
+    free(nodes);
+    aw.failed = -1;
+    return;
+  }
+
+#define NODE(length, nulls) (nodes[nnodes][0] = (length), nodes[nnodes++][1] = (nulls))
+#define BUFFER(buf, n) (body[nbody].p = (buf), body[nbody++].len = (n))
+
+  NODE(aw.rows, 0);
+  BUFFER(0, 0);
+  BUFFER(aw.recno.p, aw.recno.len);
+  NODE(aw.rows, aw.nulls);
+  BUFFER(aw.valid.p, aw.nulls ? aw.valid.len : 0);
+  for (i = 0; i < aw.depth; i++) {
+    if (i > 0) {
+      NODE(aw.count[i], 0);
+      BUFFER(0, 0);
+    }
+    BUFFER(aw.off[i].p, aw.off[i].len);
+  }
+  if (aw.depth > 0) {  /* the struct of vertices */
+    NODE(aw.count[aw.depth], 0);
+    BUFFER(0, 0);
+  }
+  for (k = 0; k < 2 + aw.hasz + aw.hasm; k++) {
+    NODE(aw.count[aw.depth], 0);
+    BUFFER(0, 0);
+    BUFFER(aw.coord[k].p, aw.coord[k].len);
+  }
+  for (k = 0; k < aw.ntext; k++) {
+    Text *t = &aw.text[k];
+    NODE(aw.rows, t->nulls);
+    BUFFER(t->valid.p, t->nulls ? t->valid.len : 0);
+    BUFFER(t->off.p, t->off.len);
+    BUFFER(t->data.p, t->data.len);
+  }
+  for (i = 0; i < nbody; i++) bodylen += pad8(body[i].len);
+
+  memset(&b, 0, sizeof b);
+  fbvector(&b, 16, nbody, 8);
+  for (i = nbody, at = bodylen; i-- > 0; ) {
+    at -= pad8(body[i].len);
+    fbint64(&b, body[i].len);
+    fbint64(&b, at);
+  }
+  bufv = fbendvector(&b, nbody);
+  fbvector(&b, 16, nnodes, 8);
+  for (i = nnodes; i-- > 0; ) {
+    fbint64(&b, nodes[i][1]);
+    fbint64(&b, nodes[i][0]);
+  }
+  nodev = fbendvector(&b, nnodes);
+  fbtable(&b, 3);
+  fbaddint64(&b, 0, aw.rows);
+  fbaddoffset(&b, 1, nodev);
+  fbaddoffset(&b, 2, bufv);
+  rb = fbendtable(&b);
+  fbtable(&b, 5);
+  fbaddint64(&b, 3, bodylen);
+  fbaddoffset(&b, 2, rb);
+  fbaddint16(&b, 0, VERSION_V5);
+  fbaddint8(&b, 1, HEADER_BATCH);
+  fbfinish(&b, fbendtable(&b));
+  if (!aw.failed) message(&b, body, nbody, bodylen, 1);
+  free(b.buf);
+  free(body);
+  free(nodes);
+
+  clear();
+#undef NODE
+#undef BUFFER
+}
+
+/* Columns */
+
+static void *grow(Buf *b, size_t n)
+{
+  if (b->cap - b->len < n) {
+    size_t cap = b->cap ? 2*b->cap : 64*1024;
+    char *p;
+    while (cap - b->len < n) cap *= 2;
+    if ((p = (char *) realloc(b->p, cap)) == NULL) { aw.failed = -1; return 0; }
+    b->p = p;
+    b->cap = cap;
+  }
+  b->len += n;
+  return b->p + b->len - n;
+}
+
+/* End an element of level i (a list) where the next level stands */
+static void offset(int i)
+{
+  Integer *p = (Integer *) grow(&aw.off[i], sizeof(Integer));
+
+  if (p) *p = (Integer) aw.count[i+1];
+  aw.count[i]++;
+}
+
+static void clear(void)
+{
+  int i;
+
+  aw.rows = aw.nulls = 0;
+  aw.recno.len = aw.valid.len = 0;
+  for (i = 0; i < 4; i++) aw.coord[i].len = aw.count[i] = 0;
+  for (i = 0; i < aw.depth; i++) {  /* lists start at 0 */
+    aw.off[i].len = 0;
+    offset(i);
+    aw.count[i] = 0;
+  }
+  for (i = 0; i < aw.ntext; i++) {
+    Text *t = &aw.text[i];
+    Integer *p;
+    t->valid.len = t->off.len = t->data.len = 0;
+    t->nulls = 0;
+    if ((p = (Integer *) grow(&t->off, sizeof(Integer)))) *p = 0;
+  }
+}
+
+/* Add the value set for t, if any, to its column */
+static void text(Text *t)
+{
+  unsigned char *bits;
+  Integer *p;
+  char *q;
+
+  if ((aw.rows % 8) == 0) {
+    if ((bits = (unsigned char *) grow(&t->valid, 1)) == NULL) return;
+    *bits = 0;
+  }
+  if (t->value) {
+    if ((q = (char *) grow(&t->data, t->len)) == NULL) return;
+    memcpy(q, t->value, t->len);
+    t->valid.p[aw.rows / 8] |= 1 << (aw.rows % 8);
+  }
+  else t->nulls++;
+  if ((p = (Integer *) grow(&t->off, sizeof(Integer)))) *p = (Integer) t->data.len;
+  t->value = 0;
+}
+
+static void vertices(const WkbShape *s, Integer a, Integer b)
+{
+  Double *v[4], nan = 0;
+  Integer i, n = b - a;
+  int k;
+
+  nan /= nan;
+  for (k = 0; k < 2 + aw.hasz + aw.hasm; k++)
+    if ((v[k] = (Double *) grow(&aw.coord[k], n * sizeof(Double))) == NULL) return;
+  for (i = 0; i < n; i++) {
+    v[0][i] = s->points[a+i].x;
+    v[1][i] = s->points[a+i].y;
+  }
+  k = 2;
+  if (aw.hasz) {
+    if (s->hasz) memcpy(v[k], s->z + a, n * sizeof(Double));
+    else for (i = 0; i < n; i++) v[k][i] = nan;
+    k++;
+  }
+  if (aw.hasm) {
+    if (s->hasm) memcpy(v[k], s->m + a, n * sizeof(Double));
+    else for (i = 0; i < n; i++) v[k][i] = nan;
+  }
+  aw.count[aw.depth] += n;
+}
+
+static void polygons(const WkbShape *s, Integer *owner)
+{
+  Integer j, k, a, b, i;
+
+  wkbgroup(s, owner);
+  for (k = 0; k < s->nparts; k++) {
+    if (owner[k] == k) {  /* its first ring, then the others */
+      wkbspan(s, k, &a, &b);
+      vertices(s, a, b);
+      offset(2);
+      for (j = 0; j < s->nparts; j++) if ((j != k) && (owner[j] == k)) {
+        wkbspan(s, j, &a, &b);
+        vertices(s, a, b);
+        offset(2);
+      }
+      offset(1);
+    }
+    else if (owner[k] == WKB_TRIANGLES) {
+      int fan = (s->types[k] == SHP_PART_TRIANGLEFAN);
+      wkbspan(s, k, &a, &b);
+      for (i = a; i + 2 < b; i++) {
+        Integer first = fan ? a : i;
+        vertices(s, first, first+1);
+        vertices(s, i+1, i+3);
+        vertices(s, first, first+1);
+        offset(2);
+        offset(1);
+      }
+    }
+  }
+}
+
+int arrowopen(int shapetype, const char **names, int nnames, ArrowOut *out)
+{
+  Fb b;
+  int i;
+
+  memset(&aw, 0, sizeof aw);
+  aw.out = out;
+  aw.shapetype = shapetype;
+  switch (shapetype) {
+    case SHP_TYPE_POINT: case SHP_TYPE_POINTZ: case SHP_TYPE_POINTM:
+      aw.depth = 0; break;
+    case SHP_TYPE_MULTIPOINT: case SHP_TYPE_MULTIPOINTZ: case SHP_TYPE_MULTIPOINTM:
+      aw.depth = 1; break;
+    case SHP_TYPE_POLYLINE: case SHP_TYPE_POLYLINEZ: case SHP_TYPE_POLYLINEM:
+      aw.depth = 2; break;
+    case SHP_TYPE_POLYGON: case SHP_TYPE_POLYGONZ: case SHP_TYPE_POLYGONM:
+    case SHP_TYPE_MULTIPATCH:
+      aw.depth = 3; break;
+    default:
+      return -1;
+  }
+  aw.hasz = (shapetype > 10) && (shapetype < 20);
+  aw.hasm = (shapetype > 10) && (shapetype < 30);
+  if (shapetype == SHP_TYPE_MULTIPATCH) aw.hasz = aw.hasm = 1;
+  if (nnames > 0) {
+    aw.text = (Text *) calloc(nnames, sizeof(Text));
+    if (aw.text == NULL) return -1;
+    for (i = 0; i < nnames; i++) aw.text[i].name = names[i];
+    aw.ntext = nnames;
+  }
+
+  put("ARROW1\0\0", 8);
+  memset(&b, 0, sizeof b);
+  i = schema(&b);
+  fbtable(&b, 5);
+  fbaddoffset(&b, 2, i);
+  fbaddint16(&b, 0, VERSION_V5);
+  fbaddint8(&b, 1, HEADER_SCHEMA);
+  fbfinish(&b, fbendtable(&b));
+  if (!aw.failed) message(&b, 0, 0, 0, 0);
+  free(b.buf);
+  clear();
+  return aw.failed;
+}
+
+void arrowattr(int k, const char *value, size_t len)
+{
+  aw.text[k].value = value;
+  aw.text[k].len = len;
+}
+
+int arrowadd(Integer recno, const WkbShape *s, Integer *owner)
+{
+  static const int types[4] = { WKB_POINT, WKB_MULTIPOINT,
+    WKB_MULTILINESTRING, WKB_MULTIPOLYGON };
+  int fits = (s->type == types[aw.depth]) ||
+             ((aw.depth == 3) && (s->type == WKB_POLYHEDRALSURFACE));
+  unsigned char *bits;
+  Integer j, a, b, *r;
+  WkbShape none;
+  int k, full = 0;
+
+  if (aw.failed) return -1;
+  if ((aw.rows % 8) == 0) {
+    if ((bits = (unsigned char *) grow(&aw.valid, 1)) == NULL) return -1;
+    *bits = 0;
+  }
+  if ((r = (Integer *) grow(&aw.recno, sizeof(Integer))) == NULL) return -1;
+  *r = recno;
+  if (!fits) {
+    aw.nulls++;
+    if (aw.depth == 0) {  /* still needs a vertex, any */
+      Point p;
+      p.x = p.y = 0;
+      memset(&none, 0, sizeof none);
+      none.npoints = 1;
+      none.points = &p;
+      vertices(&none, 0, 1);
+    }
+  }
+  else {
+    aw.valid.p[aw.rows / 8] |= 1 << (aw.rows % 8);
+    switch (aw.depth) {
+      case 0:
+        vertices(s, 0, 1);
+        break;
+      case 1:
+        vertices(s, 0, s->npoints);
+        break;
+      case 2:
+        for (j = 0; j < s->nparts; j++) {
+          wkbspan(s, j, &a, &b);
+          vertices(s, a, b);
+          offset(1);
+        }
+        break;
+      case 3:
+        polygons(s, owner);
+    }
+  }
+  if (aw.depth > 0) offset(0);
+  for (k = 0; k < aw.ntext; k++) {  /* as much text as coordinates */
+    text(&aw.text[k]);
+    if (aw.text[k].data.len >= ARROW_BATCHCOORDS * sizeof(Double)) full = 1;
+  }
+  aw.rows++;
+  if ((aw.rows >= ARROW_BATCHROWS) || (aw.count[aw.depth] >= ARROW_BATCHCOORDS))
+    full = 1;
+  if (full) batch();
+  if (aw.failed) return -1;
+  return ((s->type != WKB_GEOMETRYCOLLECTION) && !fits) ? 1 : 0;
+}
+
+int arrowclose(void)
+{
+  unsigned char tail[10];
+  unsigned long *block;
+  size_t i, n, sch, bv;
+  Fb b;
+  int k;
+
+  if (aw.rows > 0) batch();
+  put("\377\377\377\377\0\0\0\0", 8);  /* end of stream */
+
+  memset(&b, 0, sizeof b);
+  n = aw.blocks.len / (3 * sizeof(unsigned long));
+  block = (unsigned long *) aw.blocks.p;
+  fbvector(&b, 24, n, 8);
+  for (i = n; i-- > 0; ) {
+    fbint64(&b, block[3*i+2]);
+    fbint32(&b, 0);
+    fbint32(&b, block[3*i+1]);
+    fbint64(&b, block[3*i]);
+  }
+  bv = fbendvector(&b, n);
+  sch = schema(&b);
+  fbtable(&b, 5);
+  fbaddoffset(&b, 1, sch);
+  fbaddoffset(&b, 3, bv);
+  fbaddint16(&b, 0, VERSION_V5);
+  fbfinish(&b, fbendtable(&b));
+  if (!aw.failed) {
+    put(fbdata(&b), b.len);
+    for (k = 0; k < 4; k++) tail[k] = (unsigned char) ((b.len >> 8*k) & 255);
+    memcpy(tail + 4, "ARROW1", 6);
+    put(tail, 10);
+  }
+  free(b.buf);
+
+  free(aw.recno.p);
+  free(aw.valid.p);
+  free(aw.blocks.p);
+  for (k = 0; k < 3; k++) free(aw.off[k].p);
+  for (k = 0; k < 4; k++) free(aw.coord[k].p);
+  for (k = 0; k < aw.ntext; k++) {
+    free(aw.text[k].valid.p);
+    free(aw.text[k].off.p);
+    free(aw.text[k].data.p);
+  }
+  free(aw.text);
+  return aw.failed;
+}
+
+
+#ifdef TEST
+/* Write some files to memory, read them back with a minimal reader
+ * of the footer and the batch metadata, and check what's there.
+ * Exit 1 on any mismatch.
+ */
+#include <stdio.h>
+
+static unsigned char *file;
+static size_t flen, fcap;
+static unsigned long tests, fails;
+
+static void out(const void *buf, size_t len)
+{
+  if (flen + len > fcap) {
+    fcap = 2*(flen + len);
+    if ((file = (unsigned char *) realloc(file, fcap)) == NULL) exit(2);
+  }
+  memcpy(file + flen, buf, len);
+  flen += len;
+}
+
+static void expect(const char *what, int ok)
+{
+  tests++;
+  if (!ok) { fails++; printf("%s: failed\n", what); }
+}
+
+static unsigned long rd32(const unsigned char *p)
+{
+  return p[0] | (unsigned long) p[1] << 8 | (unsigned long) p[2] << 16 |
+         (unsigned long) p[3] << 24;
+}
+
+static unsigned long rd64(const unsigned char *p)  /* small values */
+{
+  return rd32(p);
+}
+
+/* Field slot of table t, or 0 if not there */
+static const unsigned char *rdfield(const unsigned char *t, int slot)
+{
+  const unsigned char *vt = t - (long) rd32(t);
+  unsigned o;
+
+  if (4 + 2*slot >= (vt[0] | vt[1] << 8)) return 0;
+  o = vt[4 + 2*slot] | vt[5 + 2*slot] << 8;
+  return o ? t + o : 0;
+}
+
+static const unsigned char *rdref(const unsigned char *p)
+{
+  return p + rd32(p);
+}
+
+/* Check the file's frame and the batches; return the rows in all
+ * batches, with buffer k of the first one in *first, *firstlen */
+static long rdfile(const char *what, const unsigned char **first, size_t *firstlen, int k)
+{
+  const unsigned char *footer, *blocks, *b, *msg, *rb, *bufs;
+  unsigned long footlen, n, i, at, meta;
+  long rows = 0;
+
+  expect(what, (flen > 24) && !memcmp(file, "ARROW1\0\0", 8) &&
+               !memcmp(file + flen - 6, "ARROW1", 6));
+  footlen = rd32(file + flen - 10);
+  expect(what, footlen < flen - 24);
+  footer = rdref(file + flen - 10 - footlen);
+  blocks = rdref(rdfield(footer, 3));
+  n = rd32(blocks);
+  for (i = 0, b = blocks + 4; i < n; i++, b += 24) {
+    at = rd64(b);
+    meta = rd32(b + 8);
+    expect(what, (at % 8 == 0) && (at + meta + rd64(b + 16) <= flen) &&
+                 (rd32(file + at) == 0xFFFFFFFFUL));
+    msg = rdref(file + at + 8);
+    expect(what, *rdfield(msg, 1) == 3);  /* a RecordBatch */
+    rb = rdref(rdfield(msg, 2));
+    rows += rd64(rdfield(rb, 0));
+    if (i == 0 && first) {
+      bufs = rdref(rdfield(rb, 2));
+      expect(what, (unsigned long) k < rd32(bufs));
+      *first = file + at + meta + rd64(bufs + 4 + 16*k);
+      *firstlen = rd64(bufs + 4 + 16*k + 8);
+    }
+  }
+  return rows;
+}
+
+int main(void)
+{
+  static Point sq[] = {
+    {0,0},{0,1},{1,1},{1,0},{0,0},       /* outer */
+    {10,0},{10,10},{20,10},{20,0},{10,0}  /* outer */
+  };
+  static Integer sqparts[] = { 0, 5 };
+  static const char *names[] = { "NAME" };
+  const unsigned char *buf;
+  size_t len;
+  Integer owner[2], offs[3];
+  Double x;
+  Point p;
+  WkbShape s;
+  long i;
+
+  flen = 0;
+  memset(&s, 0, sizeof s);
+  s.type = WKB_POINT; s.npoints = 1; s.points = &p;
+  expect("open", arrowopen(SHP_TYPE_POINT, 0, 0, out) == 0);
+  for (i = 0; i < ARROW_BATCHROWS + 10; i++) {
+    p.x = (Double) i; p.y = 1;
+    if (arrowadd(i + 1, &s, 0) != 0) break;
+  }
+  expect("close", arrowclose() == 0);
+  expect("points", rdfile("points", &buf, &len, 4) == ARROW_BATCHROWS + 10);
+  memcpy(&x, buf + 7*sizeof x, sizeof x);
+  expect("x values", (len == ARROW_BATCHROWS * sizeof x) && (x == 7));
+
+  flen = 0;
+  memset(&s, 0, sizeof s);
+  s.type = WKB_MULTIPOLYGON; s.points = sq; s.npoints = 10;
+  s.parts = sqparts; s.nparts = 2;
+  expect("open", arrowopen(SHP_TYPE_POLYGON, names, 1, out) == 0);
+  arrowattr(0, "abc", 3);
+  expect("polygons", arrowadd(1, &s, owner) == 0);
+  s.type = WKB_GEOMETRYCOLLECTION;
+  expect("null", arrowadd(2, &s, owner) == 0);
+  s.type = WKB_MULTILINESTRING;
+  arrowattr(0, "de", 2);
+  expect("mismatch", arrowadd(3, &s, owner) == 1);
+  expect("close", arrowclose() == 0);
+  expect("rows", rdfile("polygons", &buf, &len, 3) == 3);
+  memcpy(offs, buf, sizeof offs);  /* polygons per row */
+  expect("offsets", (len == 4 * sizeof(Integer)) &&
+                    (offs[0] == 0) && (offs[1] == 2) && (offs[2] == 2));
+  (void) rdfile("text", &buf, &len, 15);
+  expect("text", (len == 5) && !memcmp(buf, "abcde", 5));
+
+  flen = 0;
+  expect("unknown", arrowopen(SHP_TYPE_NULL, 0, 0, out) < 0);
+
+  printf("%lu tests, %lu failed\n", tests, fails);
+  free(file);
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,38 @@
+/* arrow.h - write shapes as an Arrow IPC file (GeoArrow) | GPL */
+
+#ifndef _ARROW_H_
+#define _ARROW_H_
+
+#include <stddef.h>
+
+#include "shapefile.h"
+#include "wkb.h"
+
+#define ARROW_BATCHROWS 65536       /* rows per record batch, at most */
+#define ARROW_BATCHCOORDS (1L<<22)  /* vertices per batch, about */
+
+typedef void ArrowOut(const void *buf, size_t len);
+
+/* Start the file, for shapes of the given type (SHP_TYPE_...),
+ * and write the schema: a column "record" with record numbers,
+ * a column "geometry" in the GeoArrow encoding for the type, and
+ * a string column for each of the nnames names (kept, not copied).
+ * All output goes through out. Return -1 for unknown types.
+ */
+extern int arrowopen(int shapetype, const char **names, int nnames, ArrowOut *out);
+
+/* Set string column k of the next row to len bytes at value (not
+ * copied until arrowadd()); columns not set are null */
+extern void arrowattr(int k, const char *value, size_t len);
+
+/* Add a row for shape s, with room in owner[] (s->nparts) to
+ * group polygon rings; null shapes (WKB_GEOMETRYCOLLECTION) are
+ * null. Return 1 if s does not fit the column, and was taken as
+ * null, or -1 if out of memory.
+ */
+extern int arrowadd(Integer recno, const WkbShape *s, Integer *owner);
+
+/* Write the last batch and the footer; -1 if out of memory */
+extern int arrowclose(void);
+
+#endif /* _ARROW_H_ */
@@ -0,0 +1,311 @@
+/* batch.c - dump many shapefiles in one go | GPL */
+
+/* Like the server (serve.c), a batch forks a process per shapefile
+ * from the one that parsed the options, so runs are isolated from
+ * each other the way separate commands would be, but without the
+ * exec. Each run writes to a temporary file (or its output file)
+ * and says what it has to say into another; when its turn comes,
+ * in the order given, both are copied out, tagged with its name.
+ * Runs are started while at most workers are running and at most
+ * 2*workers are waiting for their turn.
+ */
+
+#include "batch.h"
+#include "index.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define FAILSOFT 111
+#define MAXLINE 4096     /* bytes in a line of a list */
+
+typedef struct {
+  pid_t pid;             /* of the run, or 0 if it could not start */
+  int status, done;      /* exit status, once done */
+  FILE *out, *err;       /* what it wrote to stdout (without dir), stderr */
+} Run;
+
+typedef struct {
+  unsigned long files, ok, invalid, failed, warnings;
+  int worst;
+} Summary;
+
+static char **list = 0;  /* the shapefiles */
+static size_t nlist = 0, listsize = 0;
+
+static int add(const char *name);
+static int adddir(const char *dir);
+static int addlist(const char *file);
+static int compare(const void *a, const void *b);
+static void start(Run *r, char *argv[], const char *dir, const char *suffix,
+                  int (*run)(int argc, char *argv[]));
+static int report(Run *r, const char *name, Summary *sum);
+static void drop(Run *runs, size_t window, size_t from, size_t to);
+static int copy(FILE *from, FILE *to, const char *tag, unsigned long *warnings);
+
+int batchable(const char *arg)
+{
+  struct stat st;
+
+  return (*arg == '@') || ((stat(arg, &st) == 0) && S_ISDIR(st.st_mode));
+}
+
+int batch(int nnames, char *names[], int workers, const char *dir,
+          const char *suffix, int (*run)(int argc, char *argv[]))
+{
+  Summary sum;
+  Run *runs;
+  size_t window, started = 0, reported = 0, k;
+  int i, running = 0, status;
+  pid_t pid;
+
+  if (dir) {  /* once for all, not failing each run */
+    struct stat st;
+    if ((mkdir(dir, 0777) < 0) && (errno != EEXIST)) return -1;
+    if (stat(dir, &st) < 0) return -1;
+    if (!S_ISDIR(st.st_mode)) { errno = ENOTDIR; return -1; }
+  }
+  for (i = 0; i < nnames; i++) {
+    struct stat st;
+    if (names[i][0] == '@') { if (addlist(names[i] + 1) < 0) return -1; }
+    else if ((stat(names[i], &st) == 0) && S_ISDIR(st.st_mode)) {
+      if (adddir(names[i]) < 0) return -1;
+    }
+    else if (add(names[i]) < 0) return -1;
+  }
+  if (workers < 1) workers = 1;
+  window = 2*workers;
+  if ((runs = (Run *) calloc(window, sizeof(Run))) == NULL) return -1;
+  memset(&sum, 0, sizeof sum);
+
+  while (reported < nlist) {
+    while ((started < nlist) && (running < workers) && (started < reported + window)) {
+      start(&runs[started % window], list + started, dir, suffix, run);
+      if (runs[started % window].pid > 0) running++;
+      started++;
+    }
+    if (runs[reported % window].done) {
+      if (report(&runs[reported % window], list[reported], &sum) < 0) {
+        drop(runs, window, reported + 1, started);
+        return -1;
+      }
+      reported++;
+      continue;
+    }
+    if ((pid = waitpid(-1, &status, 0)) < 0) {
+      if (errno == EINTR) continue;
+      drop(runs, window, reported, started);
+      return -1;
+    }
+    for (k = reported; k < started; k++)
+      if (runs[k % window].pid == pid) {
+        runs[k % window].status = WIFEXITED(status) ? WEXITSTATUS(status) : FAILSOFT;
+        runs[k % window].done = 1;
+        running--;
+        break;
+      }
+  }
+  free(runs);
+
+  fprintf(stderr, "batch files %lu ok %lu invalid %lu failed %lu warnings %lu\n",
+          sum.files, sum.ok, sum.invalid, sum.failed, sum.warnings);
+  return sum.worst;
+}
+
+static int add(const char *name)
+{
+  char *s;
+
+  if (nlist == listsize) {
+    char **p;
+    listsize = listsize ? 2*listsize : 64;
+    if ((p = (char **) realloc(list, listsize * sizeof(char *))) == NULL) return -1;
+    list = p;
+  }
+  if ((s = (char *) malloc(strlen(name) + 1)) == NULL) return -1;
+  list[nlist++] = strcpy(s, name);
+  return 0;
+}
+
+/* The shapefiles in dir, plain or gzip compressed, sorted by name */
+static int adddir(const char *dir)
+{
+  DIR *dp = opendir(dir);
+  struct dirent *e;
+  size_t first = nlist, len;
+  char path[1024];
+  const char *q;
+
+  if (dp == NULL) return -1;
+  while ((e = readdir(dp)) != NULL) {
+    len = strlen(e->d_name);
+    if ((len > 3) && !strcmp(e->d_name + len - 3, ".gz")) len -= 3;
+    if (len <= 4) continue;
+    q = e->d_name + len - 4;
+    if (strncmp(q, ".shp", 4) && strncmp(q, ".SHP", 4)) continue;
+    if (strlen(dir) + strlen(e->d_name) + 2 > sizeof path) {
+      closedir(dp);
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    sprintf(path, "%s/%s", dir, e->d_name);
+    if (add(path) < 0) { closedir(dp); return -1; }
+  }
+  closedir(dp);
+  qsort(list + first, nlist - first, sizeof(char *), compare);
+  return 0;
+}
+
+/* A name per line, a shapefile or a directory; blank lines skipped */
+static int addlist(const char *file)
+{
+  FILE *fp = fopen(file, "r");
+  char line[MAXLINE], *s, *e;
+  struct stat st;
+  int ok = 0;
+
+  if (fp == NULL) return -1;
+  while ((ok == 0) && fgets(line, sizeof line, fp)) {
+    for (s = line; (*s == ' ') || (*s == '\t'); s++);
+    for (e = s + strlen(s); (e > s) && ((e[-1] == '\n') || (e[-1] == '\r') ||
+                                       (e[-1] == ' ') || (e[-1] == '\t')); e--);
+    *e = '\0';
+    if (!*s) continue;
+    if ((stat(s, &st) == 0) && S_ISDIR(st.st_mode)) ok = adddir(s);
+    else ok = add(s);
+  }
+  if (ferror(fp)) ok = -1;
+  fclose(fp);
+  return ok;
+}
+
+static int compare(const void *a, const void *b)
+{
+  return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Fork a run on argv[0], output to a temporary file or into dir; if
+ * that's not possible, it is done at once, failed, and says why */
+static void start(Run *r, char *argv[], const char *dir, const char *suffix,
+                  int (*run)(int argc, char *argv[]))
+{
+  const char *base = strrchr(argv[0], '/');
+  char path[1024];
+  int fd = -1;
+
+  r->pid = 0;
+  r->done = 0;
+  r->out = 0;
+  if ((r->err = tmpfile()) == NULL) {
+    r->status = FAILSOFT;
+    r->done = 1;
+    return;
+  }
+  if (dir) {
+    base = base ? base + 1 : argv[0];
+    if (strlen(dir) + 2 > sizeof path) errno = ENAMETOOLONG;
+    else {
+      sprintf(path, "%s/", dir);
+      if (!sidename(path + strlen(path), sizeof path - strlen(path), base, suffix))
+        errno = ENAMETOOLONG;
+      else fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    }
+  }
+  else if ((r->out = tmpfile()) != NULL) fd = fileno(r->out);
+
+  (void) fflush(stdout);
+  (void) fflush(stderr);
+  if ((fd < 0) || ((r->pid = fork()) < 0)) {
+    fprintf(r->err, "shpdump: cannot %s: %s\n", (fd < 0) ? "open output" : "fork",
+            strerror(errno));
+    if (dir && (fd >= 0)) close(fd);
+    r->pid = 0;
+    r->status = FAILSOFT;
+    r->done = 1;
+    return;
+  }
+  if (r->pid == 0) {
+    if ((dup2(fd, 1) < 0) || (dup2(fileno(r->err), 2) < 0)) _exit(FAILSOFT);
+    exit(run(1, argv));
+  }
+  if (dir) close(fd);
+}
+
+static int report(Run *r, const char *name, Summary *sum)
+{
+  int ok = 0;
+
+  if (r->out) {
+    long size = (fseek(r->out, 0, SEEK_END) == 0) ? ftell(r->out) : -1;
+    if ((size < 0) || (fseek(r->out, 0, SEEK_SET) < 0)) {
+      if (r->status == 0) r->status = FAILSOFT;
+      size = 0;
+    }
+    if ((printf("file %s %ld\n", name, size) < 0) || (copy(r->out, stdout, 0, 0) < 0))
+      ok = -1;
+    fclose(r->out);
+  }
+  if (r->err) {
+    rewind(r->err);
+    (void) copy(r->err, stderr, name, &sum->warnings);
+    fclose(r->err);
+  }
+
+  sum->files++;
+  if (r->status == 0) sum->ok++;
+  else if (r->status == 1) sum->invalid++;
+  else sum->failed++;
+  if (r->status > sum->worst) sum->worst = r->status;
+  if (r->status) fprintf(stderr, "batch exit %d %s\n", r->status, name);
+  return ok;
+}
+
+/* Give up on runs from to to (not reported): wait for those still
+ * running, drop what they wrote, free runs; errno as it was */
+static void drop(Run *runs, size_t window, size_t from, size_t to)
+{
+  int err = errno;
+  Run *r;
+
+  for (; from < to; from++) {
+    r = &runs[from % window];
+    while ((r->pid > 0) && !r->done && (waitpid(r->pid, 0, 0) < 0) && (errno == EINTR));
+    if (r->out) fclose(r->out);
+    if (r->err) fclose(r->err);
+  }
+  free(runs);
+  errno = err;
+}
+
+/* Copy what's in from to to, with each line after tag and a colon
+ * if there's a tag; count the lines that are warnings */
+static int copy(FILE *from, FILE *to, const char *tag, unsigned long *warnings)
+{
+  char buf[64*1024];
+  size_t n;
+  int bol = 1;
+
+  if (!tag) {
+    while ((n = fread(buf, 1, sizeof buf, from)) > 0)
+      if (fwrite(buf, 1, n, to) != n) return -1;
+    return ferror(from) ? -1 : 0;
+  }
+  while (fgets(buf, MAXLINE, from)) {
+    if (bol) {
+      if (fprintf(to, "%s: ", tag) < 0) return -1;
+      if (warnings && !strncmp(buf, "! ", 2)) ++*warnings;
+    }
+    if (fputs(buf, to) < 0) return -1;
+    bol = (strchr(buf, '\n') != NULL);
+  }
+  if (!bol) fputc('\n', to);
+  return ferror(from) ? -1 : 0;
+}
@@ -0,0 +1,31 @@
+/* batch.h - dump many shapefiles in one go | GPL */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/* Does arg name more than one shapefile: a directory (its .shp and
+ * .shp.gz files) or, after an @, a file with a name per line? */
+extern int batchable(const char *arg);
+
+/* Run run() on each shapefile named in names, in the order given,
+ * at most workers at a time, each in a process of its own, forked
+ * (no exec), and exit with what it returns; then return the highest
+ * exit status of the runs, or -1 with errno set if the names cannot
+ * be listed, dir cannot be made, or output cannot be written.
+ *
+ * With dir (made if it's not there), the output of each goes to a
+ * file there, named after the shapefile with suffix instead of
+ * .shp; otherwise to stdout, each after a line "file name bytes".
+ * Either way, what a run says on stderr goes to stderr in the same
+ * order, each line after the name and a colon, and at the end a
+ * summary:
+ *
+ *   batch exit 111 roads.shp       (for each run that failed)
+ *   batch files 120 ok 117 invalid 2 failed 1 warnings 5
+ *
+ * Invalid are those that exit 1, warnings the "! ..." lines.
+ */
+extern int batch(int nnames, char *names[], int workers, const char *dir,
+                 const char *suffix, int (*run)(int argc, char *argv[]));
+
+#endif /* _BATCH_H_ */
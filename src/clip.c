@@ -0,0 +1,469 @@
+/* clip.c - cut lines and polygon rings to a box | GPL */
+
+/* Lines go segment by segment: Liang-Barsky finds the stretch of
+ * each that is in the box, as parameters t0 <= t1 along it, and
+ * which edges cut it there. Rings go through the four edges of
+ * the box one after the other (Sutherland-Hodgman), from one
+ * scratch ring into the other; at each edge, a ring with I
+ * vertices inside and crossing it c times comes out with I + 2c
+ * vertices, at most 3/2 of those that went in.
+ */
+
+#include "clip.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct { Double x, y, z, m; } Vertex;
+
+#define NODATA (-1e38)  /* M values below are no data */
+
+static Vertex vertex(const Clipper *c, const Point *p, const Double *z,
+                     const Double *m, Integer i);
+static Vertex cut(const Vertex *a, const Vertex *b, Double t, int edge, Double at);
+static Double between(Double a, Double b, Double t);
+static int inside(const Vertex *v, int edge, Double at);
+static Double crossing(const Vertex *a, const Vertex *b, int edge, Double at);
+static int segment(const Double *edges, const Vertex *a, const Vertex *b,
+                   Vertex *from, Vertex *to, int *whole);
+static int put(Clipper *c, const Vertex *v);
+static int startpart(Clipper *c);
+static void endpart(Clipper *c);
+static int grow(void **p, size_t *room, size_t need, size_t each);
+
+long clip(Clipper *c, const BoundingBox *box, const Point *points,
+          const Double *z, const Double *m, Integer npoints,
+          const Integer *parts, Integer nparts, int rings)
+{
+  Integer j, i, first, end, n;
+  Vertex a, b, from, to, *in, *out, *t;
+  Double edges[4], area;
+  int k, whole, open;
+
+  c->nparts = c->npoints = 0;
+  c->hasz = (z != 0);
+  c->hasm = (m != 0);
+  edges[0] = box->xmin; edges[1] = box->xmax;
+  edges[2] = box->ymin; edges[3] = box->ymax;
+
+  for (j = 0; j < nparts; j++) {
+    first = parts[j];
+    end = (j+1 < nparts) ? parts[j+1] : npoints;
+    if (first < 0) first = 0;
+    if (end > npoints) end = npoints;
+    if (end - first < 2) continue;
+
+    if (!rings) {
+      open = 0;
+      for (i = first; i+1 < end; i++) {
+        a = vertex(c, points, z, m, i);
+        b = vertex(c, points, z, m, i+1);
+        if (!segment(edges, &a, &b, &from, &to, &whole)) {
+          if (open) endpart(c);
+          open = 0;
+          continue;
+        }
+        if (!open && ((startpart(c) < 0) || (put(c, &from) < 0))) return -1;
+        if (put(c, &to) < 0) return -1;
+        open = whole;
+        if (!open) endpart(c);
+      }
+      if (open) endpart(c);
+      continue;
+    }
+
+    /* a ring, without its closing point, through the four edges */
+    n = end - first;
+    if ((points[first].x == points[end-1].x) && (points[first].y == points[end-1].y)) n--;
+    if (n < 3) continue;
+    if (grow(&c->ring[0], &c->ringroom[0], n, sizeof(Vertex)) < 0) return -1;
+    in = (Vertex *) c->ring[0];
+    for (i = 0; i < n; i++) in[i] = vertex(c, points, z, m, first + i);
+    for (k = 0; (k < 4) && (n > 0); k++) {
+      Integer len = 0;
+      if (grow(&c->ring[!(k & 1)], &c->ringroom[!(k & 1)], n + n/2 + 1, sizeof(Vertex)) < 0)
+        return -1;
+      in = (Vertex *) c->ring[k & 1];
+      out = (Vertex *) c->ring[!(k & 1)];
+      for (i = 0; i < n; i++) {
+        const Vertex *p = &in[i ? i-1 : n-1], *q = &in[i];
+        int pin = inside(p, k, edges[k]), qin = inside(q, k, edges[k]);
+        if (pin != qin) out[len++] = cut(p, q, crossing(p, q, k, edges[k]), k, edges[k]);
+        if (qin) out[len++] = *q;
+      }
+      n = len;
+    }
+    t = (Vertex *) c->ring[0];  /* after an even number of edges */
+    if (n < 3) continue;
+    for (area = 0, i = 0; i < n; i++) {
+      const Vertex *p = &t[i ? i-1 : n-1];
+      area += (p->x - t[i].x) * (p->y + t[i].y);
+    }
+    if (!(area != 0)) continue;
+    if (startpart(c) < 0) return -1;
+    for (i = 0; i < n; i++) if (put(c, &t[i]) < 0) return -1;
+    if (put(c, &t[0]) < 0) return -1;
+  }
+  return c->nparts;
+}
+
+void clipfree(Clipper *c)
+{
+  free(c->points);
+  free(c->z);
+  free(c->m);
+  free(c->parts);
+  free(c->ring[0]);
+  free(c->ring[1]);
+  memset(c, 0, sizeof *c);
+}
+
+static Vertex vertex(const Clipper *c, const Point *p, const Double *z,
+                     const Double *m, Integer i)
+{
+  Vertex v;
+
+  v.x = p[i].x;
+  v.y = p[i].y;
+  v.z = c->hasz ? z[i] : 0;
+  v.m = c->hasm ? m[i] : 0;
+  return v;
+}
+
+/* The point at t from a to b, on edge (0 xmin, 1 xmax, 2 ymin,
+ * 3 ymax; -1 for none) at that coordinate */
+static Vertex cut(const Vertex *a, const Vertex *b, Double t, int edge, Double at)
+{
+  Vertex v;
+
+  v.x = (edge == 0 || edge == 1) ? at : between(a->x, b->x, t);
+  v.y = (edge == 2 || edge == 3) ? at : between(a->y, b->y, t);
+  v.z = between(a->z, b->z, t);
+  if (a->m < NODATA) v.m = a->m;
+  else if (b->m < NODATA) v.m = b->m;
+  else v.m = between(a->m, b->m, t);
+  return v;
+}
+
+/* From a to b, but never beyond them for rounding */
+static Double between(Double a, Double b, Double t)
+{
+  Double v = a + t * (b - a);
+
+  if (a <= b) return (v < a) ? a : (v > b) ? b : v;
+  return (v > a) ? a : (v < b) ? b : v;
+}
+
+static int inside(const Vertex *v, int edge, Double at)
+{
+  switch (edge) {
+    case 0: return v->x >= at;
+    case 1: return v->x <= at;
+    case 2: return v->y >= at;
+  }
+  return v->y <= at;
+}
+
+/* Where from a to b the line crosses edge, as a parameter */
+static Double crossing(const Vertex *a, const Vertex *b, int edge, Double at)
+{
+  if (edge < 2) return (at - a->x) / (b->x - a->x);
+  return (at - a->y) / (b->y - a->y);
+}
+
+/* Liang-Barsky: the part of a to b within the edges, if any, from
+ * from to to; whole if that goes all the way to b */
+static int segment(const Double *edges, const Vertex *a, const Vertex *b,
+                   Vertex *from, Vertex *to, int *whole)
+{
+  Double dx = b->x - a->x, dy = b->y - a->y, p[4], q[4], r, t0 = 0, t1 = 1;
+  int k, e0 = -1, e1 = -1;
+
+  if ((dx != dx) || (dy != dy)) return 0;  /* NaN, or infinite */
+  p[0] = -dx; q[0] = a->x - edges[0];
+  p[1] = dx;  q[1] = edges[1] - a->x;
+  p[2] = -dy; q[2] = a->y - edges[2];
+  p[3] = dy;  q[3] = edges[3] - a->y;
+  for (k = 0; k < 4; k++) {
+    if (p[k] == 0) {
+      if (q[k] < 0) return 0;
+      continue;
+    }
+    r = q[k] / p[k];
+    if (p[k] < 0) {
+      if (r > t1) return 0;
+      if (r > t0) { t0 = r; e0 = k; }
+    }
+    else {
+      if (r < t0) return 0;
+      if (r < t1) { t1 = r; e1 = k; }
+    }
+  }
+  *from = (e0 < 0) ? *a : cut(a, b, t0, e0, edges[e0]);
+  *to = (e1 < 0) ? *b : cut(a, b, t1, e1, edges[e1]);
+  *whole = (e1 < 0);
+  return 1;
+}
+
+/* Points, Z and M values grow together, used or not */
+static int put(Clipper *c, const Vertex *v)
+{
+  size_t n = c->npoints, room = c->room, zroom = room, mroom = room;
+
+  if (n == room) {
+    if ((grow((void **) &c->points, &room, n + 1, sizeof(Point)) < 0) ||
+        (grow((void **) &c->z, &zroom, n + 1, sizeof(Double)) < 0) ||
+        (grow((void **) &c->m, &mroom, n + 1, sizeof(Double)) < 0))
+      return -1;
+    c->room = room;
+  }
+  c->points[n].x = v->x;
+  c->points[n].y = v->y;
+  if (c->hasz) c->z[n] = v->z;
+  if (c->hasm) c->m[n] = v->m;
+  c->npoints++;
+  return 0;
+}
+
+static int startpart(Clipper *c)
+{
+  if (grow((void **) &c->parts, &c->partroom, c->nparts + 1, sizeof(Integer)) < 0)
+    return -1;
+  c->parts[c->nparts++] = c->npoints;
+  return 0;
+}
+
+/* A line is done: drop it if it's just a point */
+static void endpart(Clipper *c)
+{
+  Integer i, first = c->parts[c->nparts-1];
+
+  for (i = first + 1; i < c->npoints; i++)
+    if ((c->points[i].x != c->points[first].x) || (c->points[i].y != c->points[first].y))
+      return;
+  c->npoints = first;
+  c->nparts--;
+}
+
+/* Room for need of each at *p, by doubling; what's there stays */
+static int grow(void **p, size_t *room, size_t need, size_t each)
+{
+  size_t n = *room ? *room : 256;
+  void *q;
+
+  if (need <= *room) return 0;
+  while (n < need) n *= 2;
+  if ((q = realloc(*p, n * each)) == NULL) return -1;
+  *p = q;
+  *room = n;
+  return 0;
+}
+
+#ifdef TEST
+/* Cut random lines and rings, many of them on a grid so that they
+ * run along the edges and through the corners of the box, and
+ * check: all points are in the box, Z values are where they were
+ * (Z is a plane here), lines are as long as the stretches of the
+ * segments in the box and rings have the area of what's in the
+ * box, by counting sample points; lines and rings in the box come
+ * out as they are, a box in a ring as the box. Exit 1 on any
+ * mismatch.
+ */
+#include <math.h>
+#include <stdio.h>
+
+#define MAXN 64
+#define SAMPLES 400
+
+static unsigned long tests = 0, fails = 0;
+
+static void expect(int ok, const char *what)
+{
+  tests++;
+  if (!ok) { fails++; printf("%s\n", what); }
+}
+
+static Double coord(int grid)
+{
+  Double v = (rand() % 2001) / 100.0 - 10;
+
+  return grid ? floor(v / 2.5) * 2.5 : v;
+}
+
+static Double plane(Double x, Double y)
+{
+  return 2*x + 3*y + 1;
+}
+
+static int inbox(const BoundingBox *b, Double x, Double y)
+{
+  return (x >= b->xmin) && (x <= b->xmax) && (y >= b->ymin) && (y <= b->ymax);
+}
+
+static Double ringarea(const Point *p, Integer n)  /* closed, clockwise < 0 */
+{
+  Double a = 0;
+  Integer i;
+
+  for (i = 1; i < n; i++) a += (p[i-1].x - p[i].x) * (p[i-1].y + p[i].y);
+  return a / 2;
+}
+
+static int inring(const Point *p, Integer n, Double x, Double y)
+{
+  Integer i;
+  int in = 0;
+
+  for (i = 1; i < n; i++)
+    if (((p[i-1].y > y) != (p[i].y > y)) &&
+        (x < p[i-1].x + (y - p[i-1].y) * (p[i].x - p[i-1].x) / (p[i].y - p[i-1].y)))
+      in = !in;
+  return in;
+}
+
+/* The points are in the box and have their Z values */
+static void checkpoints(const Clipper *c, const BoundingBox *b, const char *what)
+{
+  Integer i;
+  int ok = 1, zok = 1;
+
+  for (i = 0; i < c->npoints; i++) {
+    if (!inbox(b, c->points[i].x, c->points[i].y)) ok = 0;
+    if (fabs(c->z[i] - plane(c->points[i].x, c->points[i].y)) > 1e-9) zok = 0;
+  }
+  expect(ok, what);
+  expect(zok, what);
+}
+
+static void line(Clipper *c, const BoundingBox *b, const Point *p, const Double *z,
+                 Integer n)
+{
+  Integer zero = 0, i, j, k;
+  Double want = 0, got = 0, len, tol = 1e-9;
+
+  if (clip(c, b, p, z, 0, n, &zero, 1, 0) < 0) { expect(0, "out of memory"); return; }
+  checkpoints(c, b, "line point outside the box or with wrong Z");
+  for (i = 0; i+1 < n; i++) {
+    len = sqrt((p[i+1].x - p[i].x)*(p[i+1].x - p[i].x) + (p[i+1].y - p[i].y)*(p[i+1].y - p[i].y));
+    for (k = 0, j = 0; j < SAMPLES; j++) {
+      Double t = (j + 0.5) / SAMPLES;
+      k += inbox(b, p[i].x + t*(p[i+1].x - p[i].x), p[i].y + t*(p[i+1].y - p[i].y));
+    }
+    want += len * k / SAMPLES;
+    tol += 2 * len / SAMPLES;
+  }
+  for (j = 0; j < c->nparts; j++) {
+    Integer end = (j+1 < c->nparts) ? c->parts[j+1] : c->npoints;
+    expect(end - c->parts[j] >= 2, "line of one point");
+    for (i = c->parts[j] + 1; i < end; i++)
+      got += sqrt((c->points[i].x - c->points[i-1].x)*(c->points[i].x - c->points[i-1].x) +
+                  (c->points[i].y - c->points[i-1].y)*(c->points[i].y - c->points[i-1].y));
+  }
+  expect(fabs(got - want) <= tol, "line not as long as it should be");
+}
+
+static void ring(Clipper *c, const BoundingBox *b, const Point *p, const Double *z,
+                 Integer n)
+{
+  Integer zero = 0, i, j, k = 0;
+  Double want, got = 0, a = ringarea(p, n), w = b->xmax - b->xmin, h = b->ymax - b->ymin;
+  Double tol = 1e-9, per = 2*(w + h);
+
+  if (clip(c, b, p, z, 0, n, &zero, 1, 1) < 0) { expect(0, "out of memory"); return; }
+  checkpoints(c, b, "ring point outside the box or with wrong Z");
+  for (i = 0; i < SAMPLES; i++)
+    for (j = 0; j < SAMPLES; j++)
+      k += inring(p, n, b->xmin + (i + 0.5) * w / SAMPLES, b->ymin + (j + 0.5) * h / SAMPLES);
+  want = k * (w / SAMPLES) * (h / SAMPLES);
+  for (i = 1; i < n; i++)
+    per += sqrt((p[i].x - p[i-1].x)*(p[i].x - p[i-1].x) + (p[i].y - p[i-1].y)*(p[i].y - p[i-1].y));
+  tol += per * (w + h) / SAMPLES;
+  for (j = 0; j < c->nparts; j++) {
+    Integer end = (j+1 < c->nparts) ? c->parts[j+1] : c->npoints;
+    Double part = ringarea(c->points + c->parts[j], end - c->parts[j]);
+    expect((end - c->parts[j] >= 4) && (c->points[c->parts[j]].x == c->points[end-1].x) &&
+           (c->points[c->parts[j]].y == c->points[end-1].y), "ring not closed");
+    expect((part > 0) == (a > 0), "ring turned around");
+    got += part;
+  }
+  expect(c->nparts <= 1, "ring in pieces");
+  expect(fabs(fabs(got) - want) <= tol, "ring without the area it should have");
+}
+
+int main(void)
+{
+  Clipper c;
+  BoundingBox b, big;
+  Point p[MAXN+1];
+  Double z[MAXN+1], m[MAXN+1];
+  Integer n, i, zero = 0;
+  int round, grid;
+
+  memset(&c, 0, sizeof c);
+  big.xmin = big.ymin = -100;
+  big.xmax = big.ymax = 100;
+  for (round = 0; round < 2000; round++) {
+    grid = round & 1;
+    b.xmin = coord(1); b.xmax = b.xmin + 2.5 * (1 + rand() % 4);
+    b.ymin = coord(1); b.ymax = b.ymin + 2.5 * (1 + rand() % 4);
+
+    n = 2 + rand() % (MAXN - 1);  /* a line */
+    for (i = 0; i < n; i++) {
+      p[i].x = coord(grid);
+      p[i].y = coord(grid);
+      z[i] = plane(p[i].x, p[i].y);
+    }
+    line(&c, &b, p, z, n);
+    for (i = 1; (i < n) && (p[i].x == p[0].x) && (p[i].y == p[0].y); i++);
+    if (i < n)  /* not just a point */
+      expect((clip(&c, &big, p, z, 0, n, &zero, 1, 0) == 1) && (c.npoints == n) &&
+             !memcmp(c.points, p, n * sizeof(Point)), "line in the box not as it was");
+
+    n = 3 + rand() % (MAXN - 3);  /* a star, around a point, both ways */
+    {
+      Double cx = coord(0) / 2, cy = coord(0) / 2, r;
+      for (i = 0; i < n; i++) {
+        r = grid ? 2.5 * (1 + rand() % 4) : 1 + (rand() % 1000) / 100.0;
+        p[i].x = cx + r * cos(2 * 3.141592653589793 * i / n);
+        p[i].y = cy + r * sin(2 * 3.141592653589793 * i / n) * ((round & 2) ? -1 : 1);
+        if (grid) { p[i].x = floor(p[i].x / 2.5) * 2.5; p[i].y = floor(p[i].y / 2.5) * 2.5; }
+      }
+      p[n] = p[0];
+      for (i = 0; i <= n; i++) z[i] = plane(p[i].x, p[i].y);
+    }
+    if (!grid || (ringarea(p, n + 1) != 0)) {  /* grid stars may be folded */
+      if (!grid) ring(&c, &b, p, z, n + 1);
+      else {
+        (void) clip(&c, &b, p, z, 0, n + 1, &zero, 1, 1);
+        checkpoints(&c, &b, "ring point outside the box or with wrong Z");
+      }
+      expect((clip(&c, &big, p, z, 0, n + 1, &zero, 1, 1) == 1) && (c.npoints == n + 1) &&
+             !memcmp(c.points, p, (n + 1) * sizeof(Point)), "ring in the box not as it was");
+    }
+  }
+
+  /* a box in a ring is the box; M no-data stays */
+  p[0].x = -50; p[0].y = -50; p[1].x = -50; p[1].y = 50;
+  p[2].x = 50; p[2].y = 50; p[3].x = 50; p[3].y = -50; p[4] = p[0];
+  for (i = 0; i < 5; i++) m[i] = 5;
+  b.xmin = 1; b.ymin = 2; b.xmax = 3; b.ymax = 4;
+  expect((clip(&c, &b, p, 0, m, 5, &zero, 1, 1) == 1) && (c.npoints == 5) &&
+         (ringarea(c.points, 5) == -4), "box in a ring not the box");
+  for (i = 0; i < c.npoints; i++) expect(c.m[i] == 5, "M not kept");
+  p[1].x = 10; p[1].y = 10; m[1] = -1e39;
+  expect((clip(&c, &b, p, 0, m, 2, &zero, 1, 0) == 1) && (c.npoints == 2) &&
+         (c.points[0].x == 2) && (c.points[1].y == 3) &&
+         (c.m[0] == -1e39) && (c.m[1] == -1e39), "M no-data not kept");
+
+  /* lines along an edge or through a corner */
+  p[0].x = 1; p[0].y = 0; p[1].x = 1; p[1].y = 10;
+  expect((clip(&c, &b, p, 0, 0, 2, &zero, 1, 0) == 1) && (c.npoints == 2) &&
+         (c.points[0].y == 2) && (c.points[1].y == 4), "line along an edge");
+  p[0].x = 0; p[0].y = 3; p[1].x = 2; p[1].y = 5;
+  expect(clip(&c, &b, p, 0, 0, 2, &zero, 1, 0) == 0, "line through a corner");
+
+  clipfree(&c);
+  printf("%lu tests, %lu failed\n", tests, fails);
+  return fails ? 1 : 0;
+}
+#endif
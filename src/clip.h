@@ -0,0 +1,38 @@
+/* clip.h - cut lines and polygon rings to a box | GPL */
+
+#ifndef _CLIP_H_
+#define _CLIP_H_
+
+#include <stddef.h>
+
+#include "shapefile.h"
+
+typedef struct {           /* what clip() makes, in memory reused */
+  Integer nparts, npoints;
+  Integer *parts;          /* first point of each part */
+  Point *points;
+  Double *z, *m;           /* if clip() was given them */
+  size_t room, partroom;   /* zero all to start, clipfree() when done */
+  void *ring[2];           /* a ring between edges of the box */
+  size_t ringroom[2];
+  int hasz, hasm;
+} Clipper;
+
+/* Cut the parts of a polyline to box (Liang-Barsky), or the rings
+ * of a polygon if rings (Sutherland-Hodgman, each ring for itself,
+ * so rings keep their orientation and holes stay holes). Where a
+ * line leaves the box and comes back, it goes on in a new part;
+ * a concave ring may come out with edges along the box's. Points
+ * on an edge of the box get its coordinate exactly, and Z and M
+ * values (if z, m) in between those of the ends of the segment
+ * cut; M no-data (below -1e38) stays no-data. Parts that come out
+ * as a single point and rings without area are dropped. Return
+ * the number of parts left, or -1 if out of memory.
+ */
+extern long clip(Clipper *c, const BoundingBox *box, const Point *points,
+                 const Double *z, const Double *m, Integer npoints,
+                 const Integer *parts, Integer nparts, int rings);
+
+extern void clipfree(Clipper *c);
+
+#endif /* _CLIP_H_ */
@@ -0,0 +1,150 @@
+/* dbf.c - column access to the dBase table (.dbf) | GPL */
+
+/* The .dbf has a row per shape, in the same order. Its header
+ * gives the number of records, the length of the header and of a
+ * record; a 32-byte descriptor per column (name, type, length)
+ * follows, up to a 0x0D byte. Records are fixed length: a delete
+ * flag, then the columns, one after the other. So a value is at a
+ * known offset in the file, and we map the file and hand out the
+ * values in place, touching no other columns or rows.
+ */
+
+#include "dbf.h"
+#include "index.h"
+#include "shapefile.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+typedef struct {
+  char name[12];
+  size_t offset, len;        /* in a record */
+} Column;
+
+static const unsigned char *base = 0;
+static size_t size = 0;
+static const unsigned char *rows;  /* first record */
+static size_t reclen;
+static long count = 0;
+static Column *columns = 0;  /* all of them */
+static int ncolumns = 0;
+static int *selected = 0;    /* indices into columns */
+static int nselected = 0;
+
+char *dbfname(char *buf, size_t size, const char *shpname)
+{
+  return sidename(buf, size, shpname, DBASE_SUFFIX);
+}
+
+long dbfopen(const char *name)
+{
+  const unsigned char *p, *end;
+  struct stat st;
+  size_t hdrlen, offset = 1;  /* after the delete flag */
+  void *m;
+  int fd, i;
+
+  if ((fd = open(name, O_RDONLY)) < 0) return -1;
+  if (fstat(fd, &st) < 0) { close(fd); return -1; }
+  if ((st.st_size < 32) || ((off_t) (size_t) st.st_size != st.st_size)) {
+    close(fd);
+    errno = 0;
+    return -1;
+  }
+  m = mmap(0, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED) return -1;
+
+  base = (const unsigned char *) m;
+  size = (size_t) st.st_size;
+  hdrlen = base[8] | base[9] << 8;
+  reclen = base[10] | base[11] << 8;
+  if ((hdrlen < 33) || (hdrlen > size) || (reclen < 1)) goto invalid;
+
+  end = base + hdrlen;
+  columns = (Column *) malloc((hdrlen - 32) / 32 * sizeof(Column) + 1);
+  if (columns == NULL) { dbfclose(); return -1; }
+  for (p = base + 32; (p + 32 <= end) && (*p != 0x0D); p += 32) {
+    Column *c = &columns[ncolumns++];
+    memcpy(c->name, p, 11);
+    c->name[11] = '\0';
+    for (i = 0; i < 11; i++) if (c->name[i] == ' ') c->name[i] = '\0';
+    c->offset = offset;
+    c->len = p[16];
+    if ((p[11] == 'C') || (p[11] == 'c')) c->len += p[17] << 8;  /* long text */
+    offset += c->len;
+  }
+  if (offset > reclen) goto invalid;
+
+  rows = base + hdrlen;
+  count = (long) (base[4] | base[5] << 8 | (unsigned long) base[6] << 16 |
+                  (unsigned long) base[7] << 24);
+  if ((count < 0) || ((unsigned long) count > (size - hdrlen) / reclen))
+    count = (long) ((size - hdrlen) / reclen);  /* truncated */
+  return count;
+
+invalid:
+  dbfclose();
+  errno = 0;
+  return -1;
+}
+
+void dbfclose(void)
+{
+  if (base) (void) munmap((void *) base, size);
+  base = 0;
+  size = 0;
+  count = 0;
+  free(columns);
+  columns = 0;
+  ncolumns = 0;
+  free(selected);
+  selected = 0;
+  nselected = 0;
+}
+
+int dbfselect(const char *name)
+{
+  int i, k;
+  int *s;
+
+  for (i = 0; i < ncolumns; i++) {
+    const char *a = columns[i].name, *b = name;
+    while (*a && (toupper((unsigned char) *a) == toupper((unsigned char) *b)))
+      a++, b++;
+    if (!*a && !*b) break;
+  }
+  if (i == ncolumns) return -1;
+  if ((s = (int *) realloc(selected, (nselected+1) * sizeof(int))) == NULL)
+    return -1;
+  selected = s;
+  k = nselected++;
+  selected[k] = i;
+  return k;
+}
+
+const char *dbfcolumn(int k)
+{
+  return columns[selected[k]].name;
+}
+
+const char *dbfvalue(long recno, int k, size_t *len)
+{
+  const Column *c = &columns[selected[k]];
+  const char *p, *q;
+
+  if ((recno < 1) || (recno > count)) return NULL;
+  p = (const char *) rows + (recno - 1) * reclen + c->offset;
+  q = p + c->len;
+  while ((p < q) && ((*p == ' ') || (*p == '\0'))) p++;
+  while ((q > p) && ((q[-1] == ' ') || (q[-1] == '\0'))) q--;
+  *len = (size_t) (q - p);
+  return p;
+}
@@ -0,0 +1,27 @@
+/* dbf.h - column access to the dBase table (.dbf) | GPL */
+
+#ifndef _DBF_H_
+#define _DBF_H_
+
+#include <stddef.h>
+
+extern char *dbfname(char *buf, size_t size, const char *shpname);
+
+extern long dbfopen(const char *name);  /* return #records or -1 */
+extern void dbfclose(void);
+
+/* Select the column with the given name (case does not matter)
+ * for dbfvalue(); return its number among those selected so far,
+ * or -1 if there is no such column.
+ */
+extern int dbfselect(const char *name);
+extern const char *dbfcolumn(int k);  /* name of selected column k */
+
+/* Return a pointer to the value of selected column k in record
+ * recno (1-based) and store its length in *len, without the blanks
+ * (or NULs) around it. The value is not terminated; it stays valid
+ * until dbfclose(). Return NULL if there is no such record.
+ */
+extern const char *dbfvalue(long recno, int k, size_t *len);
+
+#endif /* _DBF_H_ */
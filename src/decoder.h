@@ -0,0 +1,124 @@
+/* decoder.h - template for the shape decoders of shpread | GPL */
+
+/* Not a normal header: shpread.c includes it once per family of
+ * shapes, with these parameters #defined, to get a function
+ *
+ *   static int DECODER(ShpReader *r, ShpRecord *rec, Integer reclen)
+ *
+ * that decodes the rest of a record (reclen bytes after the shape
+ * type) into rec, or returns -1. The traits are fixed at compile
+ * time, so the loops over the points test none of them:
+ *
+ *   HASPARTS  1 if there are parts, 0 for multipoints
+ *   HASTYPES  1 if the parts have types (multipatches)
+ *   HASZ      1 if there are Z values
+ *   HASM      1 if there may be M values
+ *
+ * The M values (range and array) are optional in the format,
+ * also with Z: they are there if the record is long enough.
+ * The parameters are #undef'd at the end.
+ */
+
+#if HASPARTS
+#define FIXED 40        /* bbox, nparts, npoints */
+#define PARTSIZE (HASTYPES ? 8 : 4)
+#else
+#define FIXED 36        /* bbox, npoints */
+#define PARTSIZE 0
+#endif
+#define POINTSIZE (HASZ ? 24 : 16)
+
+static int DECODER(ShpReader *r, ShpRecord *rec, Integer reclen)
+{
+  Integer nparts = 0, npoints, room;
+  Point *points;
+#if HASPARTS
+  Integer *parts;
+#endif
+#if HASZ
+  Double *zvalues;
+#endif
+#if HASM
+  Double *mvalues;
+#endif
+  const unsigned char *p;
+
+  NEED(p, FIXED);
+  rec->bbox.xmin = getdouble(p);
+  rec->bbox.ymin = getdouble(p+8);
+  rec->bbox.xmax = getdouble(p+16);
+  rec->bbox.ymax = getdouble(p+24);
+
+#if HASPARTS
+  nparts = getint(p+32);
+  npoints = getint(p+36);
+#else
+  npoints = getint(p+32);
+#endif
+
+  room = reclen - FIXED;
+  if (HASZ) room -= 16;  /* zrange */
+  if (badcounts(nparts, npoints, room, PARTSIZE, POINTSIZE))
+    return fail(r, 0, "invalid number of parts or points");
+#if HASM
+  room -= nparts*PARTSIZE + npoints*POINTSIZE;
+  rec->hasm = (room >= 16 + npoints*8);
+#endif
+
+  points = (Point *) scratch(r, npoints*(sizeof(Point) + (HASZ+HASM)*sizeof(Double))
+                                + nparts*(PARTSIZE/4 + 1)*sizeof(Integer));
+  if (points == NULL) return -1;
+  rec->npoints = npoints;
+  rec->points = points;
+#if HASZ
+  zvalues = (Double *) (points + npoints);
+  rec->hasz = 1;
+  rec->z = zvalues;
+#endif
+#if HASM
+  mvalues = (Double *) (points + npoints) + HASZ*npoints;
+  rec->m = mvalues;
+#endif
+#if HASPARTS
+  parts = (Integer *) ((Double *) (points + npoints) + (HASZ+HASM)*npoints);
+  rec->nparts = nparts;
+  rec->parts = parts;
+  rec->owner = parts + nparts*(PARTSIZE/4);
+  NEED(p, nparts*sizeof(Integer));
+  getints(parts, p, nparts);
+#endif
+#if HASTYPES
+  rec->types = parts + nparts;
+  NEED(p, nparts*sizeof(Integer));
+  getints(parts + nparts, p, nparts);
+#endif
+  NEED(p, npoints*sizeof(Point));
+  vecpoints(points, p, npoints, &rec->extent);
+#if HASZ
+  NEED(p, 16);
+  rec->zmin = getdouble(p);
+  rec->zmax = getdouble(p+8);
+  NEED(p, npoints*sizeof(Double));
+  getdoubles(zvalues, p, npoints);
+#endif
+#if HASM
+  if (rec->hasm) {
+    NEED(p, 16);
+    rec->mmin = getdouble(p);
+    rec->mmax = getdouble(p+8);
+    NEED(p, npoints*sizeof(Double));
+    getdoubles(mvalues, p, npoints);
+  }
+#endif
+  return 0;
+}
+
+#undef FIXED
+#undef PARTSIZE
+#undef POINTSIZE
+
+#undef DECODER
+#undef HASPARTS
+#undef HASTYPES
+#undef HASZ
+#undef HASM
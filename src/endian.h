@@ -6,6 +6,8 @@
 #define ENDIAN_BIG     1   /* big endian: msb at lowest mem addr */
 #define ENDIAN_LITTLE  2   /* little endian: lsb at lowest mem addr */
 
+#define getendian shprgetendian  /* in the library, see input.h */
+
 extern int getendian(void);  /* return 0 if byte order unknown */
 
 #endif /* _ENDIAN_H_ */
@@ -0,0 +1,309 @@
+/* fmt.c - fast fixed-point formatting of doubles | GPL */
+
+/* A finite double is m * 2^e with m an integer below 2^53.
+ * Its value with prec digits after the point, scaled by 10^prec,
+ * is m * 5^prec * 2^(e+prec): we compute N = m * 5^prec exactly
+ * in a small bignum of 16-bit limbs, shift by e+prec bits, and
+ * round the bits shifted out to nearest, ties to even, which is
+ * what printf does. Anything too large for the bignum (huge
+ * precisions, huge magnitudes), infinities and NaNs go to
+ * sprintf, so the output is always identical to printf's.
+ *
+ * Reading back, a number of up to 15 digits is an integer that a
+ * double holds exactly, as is 10^k up to 10^22, so one division
+ * gives the double nearest to its value, as strtod() would; others
+ * (exponents, more digits, NaNs) go to strtod().
+ */
+
+#include "fmt.h"
+
+#include <math.h>    /* frexp, ldexp, floor */
+#include <stdio.h>   /* sprintf */
+#include <stdlib.h>  /* strtod */
+#include <string.h>  /* memcmp */
+
+#define MAXPREC 22    /* fast path only up to this precision */
+#define LIMBS   10    /* 16-bit limbs, least significant first */
+
+static int slow(char *buf, double v, int prec);
+static int mulsmall(unsigned long *d, int n, unsigned long f);
+static int nbits(const unsigned long *d, int n);
+static int testbit(const unsigned long *d, int n, int b);
+static int anybelow(const unsigned long *d, int n, int b);
+
+int fmtfix(char *buf, double v, int prec)
+{
+  static const double negzero = -0.0;
+  unsigned long d[LIMBS];
+  char digits[LIMBS*5+4];  /* reversed decimal digits, in groups of 4 */
+  int n, nd, e, s, p, i;
+  int neg, half, lower;
+  double x = v, m, q;
+  char *bp = buf;
+
+  if ((prec < 0) || (prec > MAXPREC)) return slow(buf, v, prec);
+  if ((v != v) || (v - v != 0)) return slow(buf, v, prec);  /* NaN, Inf */
+
+  neg = (v < 0) || (memcmp(&v, &negzero, sizeof v) == 0);
+  if (v < 0) v = -v;
+
+  n = 0;
+  if (v > 0) {
+    m = ldexp(frexp(v, &e), 53);  /* v = m * 2^e exactly */
+    e -= 53;
+    for (n = 0; m > 0; n++) {
+      q = floor(m / 65536.0);
+      d[n] = (unsigned long) (m - q * 65536.0);
+      m = q;
+    }
+
+    for (p = prec; p > 0; p -= 6) {  /* N = m * 5^prec */
+      unsigned long f = 1;
+      for (i = 0; (i < 6) && (i < p); i++) f *= 5;
+      if ((n = mulsmall(d, n, f)) < 0) return slow(buf, x, prec);
+    }
+
+    s = e + prec;
+    if (s >= 0) {  /* integer, shift left */
+      int ls = s / 16, bs = s % 16;
+      if (nbits(d, n) + s > LIMBS*16) return slow(buf, x, prec);
+      if (bs) {
+        unsigned long carry = 0;
+        for (i = 0; i < n; i++) {
+          unsigned long t = (d[i] << bs) | carry;
+          d[i] = t & 0xFFFF;
+          carry = t >> 16;
+        }
+        if (carry) d[n++] = carry;
+      }
+      if (ls) {
+        for (i = n-1; i >= 0; i--) d[i+ls] = d[i];
+        for (i = 0; i < ls; i++) d[i] = 0;
+        n += ls;
+      }
+    }
+    else {  /* shift right and round */
+      int k = -s, ls = k / 16, bs = k % 16;
+      half = testbit(d, n, k-1);
+      lower = anybelow(d, n, k-1);
+      if (ls >= n) n = 0;
+      else {
+        for (i = 0; i + ls < n; i++) {
+          unsigned long t = d[i+ls] >> bs;
+          if (i+ls+1 < n) t |= (d[i+ls+1] << (16-bs)) & 0xFFFF;
+          d[i] = t;
+        }
+        n -= ls;
+      }
+      while ((n > 0) && (d[n-1] == 0)) n--;
+      if (half && (lower || ((n > 0) && (d[0] & 1)))) {
+        for (i = 0; i < n; i++) {
+          if (++d[i] <= 0xFFFF) break;
+          d[i] = 0;
+        }
+        if (i == n) d[n++] = 1;
+      }
+    }
+  }
+
+  /* convert to decimal, least significant digit first */
+  nd = 0;
+  if (n <= 2) {
+    unsigned long val = (n > 1) ? (d[1] << 16) | d[0] : (n > 0) ? d[0] : 0;
+    while (val > 0) { digits[nd++] = '0' + (char) (val % 10); val /= 10; }
+  }
+  else while (n > 0) {
+    unsigned long rem = 0;
+    for (i = n-1; i >= 0; i--) {
+      unsigned long t = (rem << 16) | d[i];
+      d[i] = t / 10000;
+      rem = t % 10000;
+    }
+    while ((n > 0) && (d[n-1] == 0)) n--;
+    for (i = 0; i < 4; i++) { digits[nd++] = '0' + (char) (rem % 10); rem /= 10; }
+  }
+  while ((nd > 0) && (digits[nd-1] == '0')) nd--;
+  while (nd < prec+1) digits[nd++] = '0';
+
+  if (neg) *bp++ = '-';
+  for (i = nd-1; i >= prec; i--) *bp++ = digits[i];
+  if (prec > 0) {
+    *bp++ = '.';
+    for (; i >= 0; i--) *bp++ = digits[i];
+  }
+  *bp = '\0';
+  return bp - buf;
+}
+
+static int slow(char *buf, double v, int prec)
+{
+  return sprintf(buf, "%.*f", prec, v);
+}
+
+/* d *= f for f < 2^16; return new limb count or -1 on overflow */
+static int mulsmall(unsigned long *d, int n, unsigned long f)
+{
+  unsigned long carry = 0;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    unsigned long t = d[i] * f + carry;
+    d[i] = t & 0xFFFF;
+    carry = t >> 16;
+  }
+  while (carry) {
+    if (n >= LIMBS) return -1;
+    d[n++] = carry & 0xFFFF;
+    carry >>= 16;
+  }
+  return n;
+}
+
+static int nbits(const unsigned long *d, int n)
+{
+  int b;
+
+  while ((n > 0) && (d[n-1] == 0)) n--;
+  if (n == 0) return 0;
+  for (b = 16; !(d[n-1] & (1UL << (b-1))); b--);
+  return (n-1)*16 + b;
+}
+
+static int testbit(const unsigned long *d, int n, int b)
+{
+  if ((b < 0) || (b/16 >= n)) return 0;
+  return (d[b/16] >> (b%16)) & 1;
+}
+
+static int anybelow(const unsigned long *d, int n, int b)
+{
+  int i;
+
+  for (i = 0; (i < b/16) && (i < n); i++)
+    if (d[i]) return 1;
+  if ((b > 0) && (b/16 < n) && (d[b/16] & ((1UL << (b%16)) - 1))) return 1;
+  return 0;
+}
+
+double fmtscan(const char *s, char **end)
+{
+  static const double pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char *p = s;
+  int neg = 0, any = 0, digits = 0, frac = -1;
+  double m = 0;
+
+  if ((*p == '-') || (*p == '+')) neg = (*p++ == '-');
+  for (;; p++) {
+    if ((*p >= '0') && (*p <= '9')) {
+      any = 1;
+      if (digits || (*p != '0')) digits++;
+      m = m*10 + (*p - '0');
+      if (frac >= 0) frac++;
+    }
+    else if ((*p == '.') && (frac < 0)) frac = 0;
+    else break;
+  }
+  if (!any || (digits > 15) || (frac > 22) ||
+      (*p == 'e') || (*p == 'E') || (*p == 'x') || (*p == 'X'))
+    return strtod(s, end);
+  if (frac > 0) m /= pow10[frac];
+  if (end) *end = (char *) p;
+  return neg ? -m : m;
+}
+
+#ifdef TEST
+/* Compare fmtfix() against sprintf() for edge cases and lots
+ * of random doubles at all precisions up to beyond MAXPREC, and
+ * fmtscan() of the results against strtod(). Print mismatches and
+ * exit 1 if there were any.
+ */
+#include <float.h>
+#include <stdlib.h>
+
+static unsigned long fails = 0, tests = 0;
+
+static void scan(const char *s);
+
+static void check(double v, int prec)
+{
+  char want[FMTFIXLEN(40)], got[FMTFIXLEN(40)];
+  int len;
+
+  sprintf(want, "%.*f", prec, v);
+  len = fmtfix(got, v, prec);
+  tests++;
+  if (strcmp(want, got) || (len != (int) strlen(want))) {
+    if (fails++ < 20) printf("%.17g prec %d: want %s got %s\n", v, prec, want, got);
+  }
+  scan(want);
+}
+
+static void scan(const char *s)
+{
+  char *end1, *end2;
+  double want = strtod(s, &end1), got = fmtscan(s, &end2);
+
+  tests++;
+  if ((memcmp(&want, &got, sizeof want) && !((want != want) && (got != got))) ||
+      (end1 != end2)) {
+    if (fails++ < 20) printf("scan %s: want %.17g got %.17g\n", s, want, got);
+  }
+}
+
+static double randbits(void)
+{
+  unsigned char bytes[sizeof(double)];
+  double v;
+  size_t i;
+
+  for (i = 0; i < sizeof bytes; i++) bytes[i] = rand() & 0xFF;
+  memcpy(&v, bytes, sizeof v);
+  return v;
+}
+
+int main(void)
+{
+  static const double edge[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, 0.125, 0.375, 2.5, 0.05, 0.005, 1e-5,
+    0.045, 1.005, 239363.77, 2778312.07, -2035803.78, 5115960.55,
+    9.5, 10.5, 99.995, 999999.9999995, 4503599627370495.5,
+    9007199254740993.0, 1e15, 1e16, 1e17, 1e21, 1e22, 1e23, 1e30,
+    1e-300, -1e-300, 4.9e-324, 2.2250738585072014e-308,
+    DBL_MAX, -DBL_MAX, DBL_MIN, DBL_EPSILON,
+    1.1417981541647678e+46, 1.0141204801825834e+31,  /* all limbs used */
+    1.4615016373309028e+48
+  };
+  static const char *odd[] = {
+    "", "-", "+", ".", "-.", "1.", ".5", "-.5", "+7", " 7", "1e5", "-2.5E-3",
+    "0x1p3", "inf", "-nan", "00012.50", "123456789012345", "1234567890123456",
+    "0.0000000000000000000001", "0.00000000000000000000001", "9007199254740993",
+    "1.5x", "12,34", "-0", "-0.00"
+  };
+  double inf = 1e308 * 10, nan = inf - inf;
+  int prec, i, e;
+
+  for (i = 0; i < (int) (sizeof odd / sizeof *odd); i++) scan(odd[i]);
+
+  for (prec = 0; prec <= 30; prec++) {
+    for (i = 0; i < (int) (sizeof edge / sizeof *edge); i++) {
+      check(edge[i], prec);
+      check(-edge[i], prec);
+    }
+    check(inf, prec); check(-inf, prec); check(nan, prec);
+    for (i = 0; i < 5000; i++) {
+      double v = randbits();
+      check(v, prec);
+      check(ldexp(frexp(v, &e), i % 40), prec);
+      check(floor(v * 1e6) / ((i % 7) ? 100.0 : 1024.0), prec);
+      check((rand() - RAND_MAX/2) / 1000.0, prec);
+      check((rand() % 100000) / 8.0, prec);  /* exact ties */
+    }
+  }
+
+  printf("%lu tests, %lu failed\n", tests, fails);
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,22 @@
+/* fmt.h - fast fixed-point formatting of doubles | GPL */
+
+#ifndef _FMT_H_
+#define _FMT_H_
+
+/* Maximum length of fmtfix() output for given precision:
+ * sign, up to 309 integer digits, point, prec digits, NUL.
+ */
+#define FMTFIXLEN(prec) (312 + (prec))
+
+/* Write v to buf exactly as sprintf(buf, "%.*f", prec, v) would
+ * and return the number of chars written (excluding the NUL).
+ */
+extern int fmtfix(char *buf, double v, int prec);
+
+/* Read a number like strtod() does, and as fast as can be for what
+ * fmtfix() writes: up to 15 digits, up to 22 after the point. Set
+ * *end past it (to s if there is none).
+ */
+extern double fmtscan(const char *s, char **end);
+
+#endif /* _FMT_H_ */
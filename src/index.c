@@ -0,0 +1,250 @@
+/* index.c - random access to shapes via the index file | GPL */
+
+/* The index file (.shx) has the same 100-byte header as the
+ * main file, followed by one 8-byte record per shape holding
+ * the shape's offset and content length, both big endian and
+ * in 16-bit words. We map it and look records up in place.
+ */
+
+#include "index.h"
+#include "shapefile.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+static const unsigned char *base = 0;
+static size_t size = 0;
+static long count = 0;
+static int mapped = 0;  /* by us, not given by idxmem() */
+
+static FILE *out = 0;    /* index file being written */
+static char *outname = 0, *tmpname = 0;
+static unsigned long written = 0;  /* records */
+
+#define MAXWORDS 0xFFFFFFFFUL  /* offsets and lengths, in 16-bit words */
+
+static unsigned long getbig(const unsigned char *p);
+static void putbig(unsigned char *p, unsigned long v);
+static void putheader(unsigned char *p, const MainHeader *h);
+
+char *idxname(char *buf, size_t size, const char *shpname)
+{
+  return sidename(buf, size, shpname, INDEX_SUFFIX);
+}
+
+char *sidename(char *buf, size_t size, const char *shpname, const char *suffix)
+{
+  const char *p = strrchr(shpname, '/');
+  const char *q = strrchr(shpname, '.');
+  size_t end = strlen(shpname), len;  /* end: without .gz */
+  char *s;
+
+  if (q && (!p || (q > p)) && !strcmp(q, ".gz")) {  /* x.shp.gz goes with x.shx */
+    end = q - shpname;
+    for (q = 0, len = end; (len > 0) && (shpname[len-1] != '/'); len--)
+      if (shpname[len-1] == '.') { q = shpname + len - 1; break; }
+  }
+  len = (q && (!p || (q > p))) ? (size_t) (q - shpname) : end;
+  if (len + strlen(suffix) + 1 > size) return NULL;
+  memcpy(buf, shpname, len);
+  strcpy(buf + len, suffix);
+  if ((len + 4 == end) && !strncmp(shpname + len, ".SHP", 4))
+    for (s = buf + len; *s; s++)  /* keep the case of the suffix */
+      *s = toupper((unsigned char) *s);
+  return buf;
+}
+
+const char *shpname(char *buf, size_t size, const char *name)
+{
+  const char *p = strrchr(name, '/');
+  const char *q = strrchr(name, '.');
+  size_t len = strlen(name);
+
+  if (q && (!p || (q > p))) return name;
+  if (len + strlen(SHAPE_SUFFIX) + 1 > size) return NULL;
+  memcpy(buf, name, len);
+  strcpy(buf + len, SHAPE_SUFFIX);
+  return buf;
+}
+
+long idxopen(const char *name)
+{
+  struct stat st;
+  void *p;
+  int fd;
+
+  if ((fd = open(name, O_RDONLY)) < 0) return -1;
+  if (fstat(fd, &st) < 0) { close(fd); return -1; }
+  if ((st.st_size < 100) || ((off_t) (size_t) st.st_size != st.st_size)) {
+    close(fd);
+    errno = 0;
+    return -1;
+  }
+  p = mmap(0, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return -1;
+
+  mapped = 1;
+  return idxmem(p, (size_t) st.st_size);
+}
+
+long idxmem(const void *p, size_t n)
+{
+  if (n < 100) { errno = 0; return -1; }
+  base = (const unsigned char *) p;
+  size = n;
+  count = (long) ((size - 100) / sizeof(IndexRecord));
+  return count;
+}
+
+void idxclose(void)
+{
+  if (base && mapped) (void) munmap((void *) base, size);
+  base = 0;
+  size = 0;
+  count = 0;
+  mapped = 0;
+}
+
+int idxrecord(long recno, unsigned long *offset, unsigned long *length)
+{
+  const unsigned char *p;
+
+  if ((recno < 1) || (recno > count)) return -1;
+  p = base + 100 + (recno - 1) * sizeof(IndexRecord);
+  if (offset) *offset = getbig(p) * 2;
+  if (length) *length = getbig(p+4) * 2;
+  return 0;
+}
+
+int idxcreate(const char *name)
+{
+  static char buf[1024*1024];
+  size_t len = strlen(name);
+
+  if ((outname = (char *) malloc(2*len + 6)) == NULL) return -1;
+  tmpname = outname + len + 1;
+  strcpy(outname, name);
+  sprintf(tmpname, "%s.tmp", name);
+  if ((out = fopen(tmpname, "wb")) == NULL) {
+    free(outname);
+    outname = 0;
+    return -1;
+  }
+  (void) setvbuf(out, buf, _IOFBF, sizeof buf);
+  written = 0;
+  memset(buf, 0, 100);
+  return (fwrite(buf, 1, 100, out) == 100) ? 0 : -1;  /* header comes last */
+}
+
+int idxput(unsigned long offset, unsigned long length)
+{
+  unsigned char p[8];
+
+  if ((offset/2 > MAXWORDS) || (length/2 > MAXWORDS)) {
+    errno = 0;
+    return -1;
+  }
+  putbig(p, offset/2);
+  putbig(p+4, length/2);
+  written++;
+  return (fwrite(p, 1, 8, out) == 8) ? 0 : -1;
+}
+
+int idxfinish(const MainHeader *h)
+{
+  unsigned char p[100];
+  MainHeader hh;
+  int ok = -1, err = errno;  /* kept if just removing it */
+
+  if (h && (50 + 4*written <= MAXWORDS)) {
+    hh = *h;
+    hh.fileLength = (Integer) (50 + 4*written);
+    putheader(p, &hh);
+    if ((fseek(out, 0, SEEK_SET) == 0) && (fwrite(p, 1, 100, out) == 100)) ok = 0;
+    err = errno;
+  }
+  else if (h) err = 0;  /* too many records */
+  if ((fclose(out) != 0) && (ok == 0)) {
+    ok = -1;
+    err = errno;
+  }
+  if ((ok == 0) && (rename(tmpname, outname) < 0)) {
+    ok = -1;
+    err = errno;
+  }
+  if (ok < 0) (void) remove(tmpname);
+  free(outname);
+  out = 0;
+  outname = tmpname = 0;
+  errno = err;
+  return ok;
+}
+
+int idxheader(const char *name, const MainHeader *h)
+{
+  unsigned char p[100];
+  int fd, err;
+
+  putheader(p, h);
+  if ((fd = open(name, O_WRONLY)) < 0) return -1;
+  if (write(fd, p, 100) != 100) {
+    err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return close(fd);
+}
+
+/* File code and length big endian, the rest little endian */
+static void putheader(unsigned char *p, const MainHeader *h)
+{
+  const unsigned short one = 1;
+  int little = *(const unsigned char *) &one;
+  Double v[8];
+  const unsigned char *q;
+  int i, k;
+
+  memset(p, 0, 100);
+  putbig(p, (unsigned long) h->fileCode);
+  putbig(p+24, (unsigned long) h->fileLength);
+  p[28] = h->version & 0xFF; p[29] = (h->version >> 8) & 0xFF;
+  p[30] = (h->version >> 16) & 0xFF; p[31] = (h->version >> 24) & 0xFF;
+  p[32] = h->shapeType & 0xFF; p[33] = (h->shapeType >> 8) & 0xFF;
+  p[34] = (h->shapeType >> 16) & 0xFF; p[35] = (h->shapeType >> 24) & 0xFF;
+  v[0] = h->bbox.xmin; v[1] = h->bbox.ymin;
+  v[2] = h->bbox.xmax; v[3] = h->bbox.ymax;
+  v[4] = h->zmin; v[5] = h->zmax;
+  v[6] = h->mmin; v[7] = h->mmax;
+  for (k = 0; k < 8; k++) {
+    q = (const unsigned char *) &v[k];
+    for (i = 0; i < 8; i++) p[36 + 8*k + i] = q[little ? i : 7 - i];
+  }
+}
+
+static void putbig(unsigned char *p, unsigned long v)
+{
+  p[0] = (v >> 24) & 0xFF; p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF; p[3] = v & 0xFF;
+}
+
+static unsigned long getbig(const unsigned char *p)
+{
+  unsigned long value;
+
+  value  = p[0]; value <<= 8;
+  value += p[1]; value <<= 8;
+  value += p[2]; value <<= 8;
+  value += p[3];
+
+  return value;
+}
@@ -0,0 +1,48 @@
+/* index.h - random access to shapes via the index file | GPL */
+
+#ifndef _INDEX_H_
+#define _INDEX_H_
+
+#include <stddef.h>
+
+#include "shapefile.h"
+
+/* Derive the index file name (.shx) from the shape file name;
+ * return buf, or NULL if the name does not fit into size bytes.
+ */
+extern char *idxname(char *buf, size_t size, const char *shpname);
+extern char *sidename(char *buf, size_t size, const char *shpname,
+                      const char *suffix);  /* same for other suffixes */
+
+/* The shape file name for name as given: name itself if it has a
+ * suffix, else with .shp appended in buf, or NULL if that doesn't
+ * fit into size bytes.
+ */
+extern const char *shpname(char *buf, size_t size, const char *name);
+
+extern long idxopen(const char *name);  /* return #records or -1 */
+extern long idxmem(const void *base, size_t size);  /* same, from memory */
+extern void idxclose(void);
+
+/* Look up record recno (1-based) and store its byte offset
+ * into the .shp and its content length in bytes (excluding the
+ * 8-byte record header). Return -1 if there is no such record.
+ */
+extern int idxrecord(long recno, unsigned long *offset, unsigned long *length);
+
+/* Write an index file in one pass over the shape file: idxcreate()
+ * it, under a temporary name; idxput() the byte offset and content
+ * length of each record, in order; idxfinish() writes h as its
+ * header, with the file length of the index, and renames it into
+ * place, or with h NULL, removes it. Writes are buffered, so the
+ * memory needed stays the same however many records. Return 0, or
+ * -1 with errno set (0 if an offset does not fit into the index).
+ */
+extern int idxcreate(const char *name);
+extern int idxput(unsigned long offset, unsigned long length);
+extern int idxfinish(const MainHeader *h);
+
+/* Write h over the header of the file name, a shape file */
+extern int idxheader(const char *name, const MainHeader *h);
+
+#endif /* _INDEX_H_ */
@@ -0,0 +1,439 @@
+/* input.c - memory-mapped or block-buffered input | GPL */
+
+/* Regular files are mapped into memory and decoded in place.
+ * Anything else (pipes, terminals, or files that cannot be
+ * mapped) is read in large blocks into a buffer that grows
+ * as needed to hold the largest chunk requested so far.
+ * Either way, callers get a pointer to contiguous bytes and
+ * do their bounds checks per chunk, not per byte.
+ *
+ * Gzip compressed input, mapped or not, is inflated by a thread
+ * while the reader decodes what came before. The thread fills a
+ * ring of buffers, and fill() takes from there what it would
+ * otherwise read(), so the reader waits only if it catches up.
+ */
+
+#include "input.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef NOZLIB
+#include <limits.h>
+#include <pthread.h>
+#include <zlib.h>
+
+struct Inflater {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t filled;       /* a buffer was filled, or the end came */
+  pthread_cond_t emptied;      /* a buffer was taken */
+  unsigned char *ring[NRING];
+  size_t len[NRING];           /* bytes in each buffer */
+  size_t head, count;          /* next buffer to take, buffers filled */
+  size_t at;                   /* bytes taken from ring[head] */
+  int done, err, stop;         /* end of input, errno then, closing */
+  int fd;                      /* compressed input, read from fd, */
+  unsigned char *buf;          /* into buf (first n bytes given), */
+  size_t n;
+  const unsigned char *src;    /* or all there at src */
+  size_t srclen;
+  int unmap;                   /* src is our mapping */
+};
+
+static void *inflater(void *arg);
+static void endstream(void *zs);
+static void pump(Inflater *z, z_stream *zs);
+static ssize_t take(Inflater *z, unsigned char *p, size_t n);
+static void stop(Inflater *z);
+#endif
+
+static int fill(Input *in, size_t n);
+
+int inopen(Input *in, int fd)
+{
+  struct stat st;
+
+  in->fd = fd;
+  in->keep = 0;
+  in->z = 0;
+  if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0) &&
+      ((off_t) (size_t) st.st_size == st.st_size)) {
+    void *p = mmap(0, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p != MAP_FAILED) {
+      (void) posix_madvise(p, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+      in->mapped = 1;
+      in->base = (unsigned char *) p;
+      in->size = (size_t) st.st_size;
+      in->ptr = in->base;
+      in->end = in->base + in->size;
+      return ininflate(in);
+    }
+  }
+
+  /* fall back to block reads */
+  in->mapped = 0;
+  in->size = INBUFSIZE;
+  in->base = (unsigned char *) malloc(in->size);
+  if (in->base == NULL) return -1;
+  in->ptr = in->end = in->base;
+#ifndef NOZLIB
+  if ((fill(in, 2) < 0) && errno) return -1;  /* for the magic */
+  return ininflate(in);
+#else
+  errno = 0;
+  return 0;
+#endif
+}
+
+/* Memory the caller keeps, like a mapping of its own, is read
+ * like a mapped file, and not unmapped when done */
+int inmem(Input *in, const void *base, size_t size)
+{
+  in->fd = -1;
+  in->mapped = 1;
+  in->keep = 1;
+  in->base = (unsigned char *) base;
+  in->size = size;
+  in->ptr = in->base;
+  in->end = in->base + size;
+  in->z = 0;
+  return 0;
+}
+
+void inclose(Input *in)
+{
+#ifndef NOZLIB
+  if (in->z) stop(in->z);
+  in->z = 0;
+#endif
+  if (in->mapped && !in->keep) (void) munmap(in->base, in->size);
+  else if (!in->mapped) free(in->base);
+  in->base = 0;
+  in->ptr = in->end = 0;
+  in->size = 0;
+  in->mapped = 0;
+  in->keep = 0;
+  in->fd = -1;
+}
+
+const unsigned char *inneed(Input *in, size_t n)
+{
+  const unsigned char *p;
+
+  if ((size_t) (in->end - in->ptr) < n) {
+    if (in->mapped) { errno = 0; return NULL; }
+    if (fill(in, n) < 0) return NULL;
+  }
+  p = in->ptr;
+  in->ptr += n;
+  return p;
+}
+
+const unsigned char *inpeek(Input *in, size_t n)
+{
+  const unsigned char *p = inneed(in, n);
+
+  if (p) in->ptr = p;
+  return p;
+}
+
+int inskip(Input *in, size_t n)
+{
+  while (n > 0) {
+    size_t avail = in->end - in->ptr;
+    if (avail == 0) {
+      if (in->mapped) { errno = 0; return -1; }
+      if (fill(in, 1) < 0) return -1;
+      avail = in->end - in->ptr;
+    }
+    if (avail > n) avail = n;
+    in->ptr += avail;
+    n -= avail;
+  }
+  return 0;
+}
+
+/* Position at given byte offset from the start of the input.
+ * Mapped input is always seekable; for block reads we need a
+ * regular file and just drop what's buffered.
+ */
+int inseek(Input *in, unsigned long offset)
+{
+  if (in->z) { errno = ESPIPE; return -1; }
+  if (in->mapped) {
+    if (offset > in->size) { errno = 0; return -1; }
+    in->ptr = in->base + offset;
+    return 0;
+  }
+  if (lseek(in->fd, (off_t) offset, SEEK_SET) == (off_t) -1) return -1;
+  in->ptr = in->end = in->base;
+  return 0;
+}
+
+/* Put n bytes back in front of what's left of block reads */
+int inunread(Input *in, const void *p, size_t n)
+{
+  size_t have = in->end - in->ptr, size = in->size;
+  unsigned char *base;
+
+  if (in->mapped) { errno = EINVAL; return -1; }
+  while (size < n + have) size *= 2;
+  if ((base = (unsigned char *) malloc(size)) == NULL) return -1;
+  memcpy(base, p, n);
+  memcpy(base + n, in->ptr, have);
+  free(in->base);
+  in->base = base;
+  in->size = size;
+  in->ptr = base;
+  in->end = base + n + have;
+  return 0;
+}
+
+/* Make at least n bytes available at ptr: move what's left
+ * to the start of the buffer, grow it if n would not fit,
+ * then read full blocks until we have n bytes or hit eof.
+ */
+static int fill(Input *in, size_t n)
+{
+  size_t have = in->end - in->ptr;
+
+  if (n > in->size) {
+    size_t newsize = in->size;
+    unsigned char *newbase;
+    while (newsize < n) newsize *= 2;
+    newbase = (unsigned char *) malloc(newsize);
+    if (newbase == NULL) return -1;
+    memcpy(newbase, in->ptr, have);
+    free(in->base);
+    in->base = newbase;
+    in->size = newsize;
+  }
+  else if (in->ptr != in->base) memmove(in->base, in->ptr, have);
+  in->ptr = in->base;
+  in->end = in->base + have;
+
+  while (have < n) {
+#ifndef NOZLIB
+    ssize_t r = in->z ? take(in->z, in->base + have, in->size - have)
+                      : read(in->fd, in->base + have, in->size - have);
+#else
+    ssize_t r = read(in->fd, in->base + have, in->size - have);
+#endif
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (r == 0) { errno = 0; return -1; }  /* eof */
+    have += r;
+    in->end = in->base + have;
+  }
+  return 0;
+}
+
+#ifndef NOZLIB
+/* If the input starts like gzip data, hand it to an inflater
+ * thread: the mapping as it is, or what's been read so far as
+ * the start of what the thread will read; then the input is
+ * what the thread puts out. Return -1 only if we cannot. */
+int ininflate(Input *in)
+{
+  Inflater *z;
+  int i;
+
+  errno = 0;
+  if ((in->end - in->ptr < 2) || (in->ptr[0] != 0x1f) || (in->ptr[1] != 0x8b))
+    return 0;
+  if ((z = (Inflater *) calloc(1, sizeof *z)) == NULL) return -1;
+  for (i = 0; i < NRING; i++)
+    if ((z->ring[i] = (unsigned char *) malloc(INBUFSIZE)) == NULL) goto fail;
+  z->fd = in->fd;
+  if (in->mapped) {
+    z->src = in->base;
+    z->srclen = in->size;
+    z->unmap = !in->keep;
+    if ((in->base = (unsigned char *) malloc(INBUFSIZE)) == NULL) {
+      in->base = (unsigned char *) z->src;
+      goto fail;
+    }
+    in->size = INBUFSIZE;
+  }
+  else {
+    if ((z->buf = (unsigned char *) malloc(INBUFSIZE)) == NULL) goto fail;
+    z->n = in->end - in->ptr;
+    memcpy(z->buf, in->ptr, z->n);
+  }
+  pthread_mutex_init(&z->lock, 0);
+  pthread_cond_init(&z->filled, 0);
+  pthread_cond_init(&z->emptied, 0);
+  if (pthread_create(&z->thread, 0, inflater, z) != 0) {
+    if (in->mapped) { free(in->base); in->base = (unsigned char *) z->src; }
+    goto fail;
+  }
+  in->mapped = 0;
+  in->keep = 0;
+  in->ptr = in->end = in->base;
+  in->z = z;
+  errno = 0;
+  return 0;
+
+fail:
+  for (i = 0; i < NRING; i++) free(z->ring[i]);
+  free(z->buf);
+  free(z);
+  errno = ENOMEM;
+  return -1;
+}
+
+/* The thread: inflate one gzip member after the other into the
+ * next free buffer of the ring. Truncated input ends the output
+ * like the end of an uncompressed file would (errno 0), corrupt
+ * input like a read error (EIO). */
+static void *inflater(void *arg)
+{
+  Inflater *z = (Inflater *) arg;
+  z_stream zs;
+
+  (void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+  memset(&zs, 0, sizeof zs);
+  if (z->buf) { zs.next_in = z->buf; zs.avail_in = (uInt) z->n; }
+  if (inflateInit2(&zs, 15 + 16) != Z_OK) {  /* 16: gzip */
+    pthread_mutex_lock(&z->lock);
+    z->done = 1;
+    z->err = ENOMEM;
+    pthread_cond_signal(&z->filled);
+    pthread_mutex_unlock(&z->lock);
+    return 0;
+  }
+  pthread_cleanup_push(endstream, &zs);  /* if cancelled in read() */
+  pump(z, &zs);
+  pthread_cleanup_pop(1);
+  return 0;
+}
+
+static void endstream(void *zs)
+{
+  (void) inflateEnd((z_stream *) zs);
+}
+
+static void pump(Inflater *z, z_stream *zs)
+{
+  const unsigned char *src = z->src;
+  size_t left = z->srclen;  /* of src */
+  int eof = 0, end = 0, err = 0, rc;
+  unsigned char *out;
+  ssize_t r;
+
+  while (!end) {
+    pthread_mutex_lock(&z->lock);
+    while (!z->stop && (z->count == NRING))
+      pthread_cond_wait(&z->emptied, &z->lock);
+    if (z->stop) { pthread_mutex_unlock(&z->lock); return; }
+    out = z->ring[(z->head + z->count) % NRING];
+    pthread_mutex_unlock(&z->lock);
+
+    zs->next_out = out;
+    zs->avail_out = INBUFSIZE;
+    while ((zs->avail_out > 0) && !end) {
+      if ((zs->avail_in == 0) && !eof) {
+        if (src) {  /* at most what fits in uInt at a time */
+          zs->next_in = (unsigned char *) src;
+          zs->avail_in = (uInt) ((left > UINT_MAX/2) ? UINT_MAX/2 : left);
+          src += zs->avail_in;
+          left -= zs->avail_in;
+          eof = (left == 0);
+        }
+        else {
+          (void) pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, 0);
+          r = read(z->fd, z->buf, INBUFSIZE);
+          (void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, 0);
+          if ((r < 0) && (errno == EINTR)) continue;
+          if (r < 0) { err = errno; end = 1; break; }
+          zs->next_in = z->buf;
+          zs->avail_in = (uInt) r;
+          eof = (r == 0);
+        }
+      }
+      rc = inflate(zs, Z_NO_FLUSH);
+      if (rc == Z_STREAM_END) {  /* another member may follow */
+        if ((zs->avail_in == 0) && eof) end = 1;
+        else (void) inflateReset(zs);
+      }
+      else if ((rc == Z_BUF_ERROR) && (zs->avail_in == 0)) {
+        if (eof) end = 1;  /* truncated */
+      }
+      else if (rc != Z_OK) { err = EIO; end = 1; }
+    }
+
+    pthread_mutex_lock(&z->lock);
+    z->len[(z->head + z->count) % NRING] = INBUFSIZE - zs->avail_out;
+    z->count++;
+    if (end) { z->done = 1; z->err = err; }
+    pthread_cond_signal(&z->filled);
+    pthread_mutex_unlock(&z->lock);
+  }
+}
+
+/* Like read(): up to n bytes of what the thread put out, or 0 at
+ * the end, or -1 with errno set */
+static ssize_t take(Inflater *z, unsigned char *p, size_t n)
+{
+  size_t k = 0;
+
+  pthread_mutex_lock(&z->lock);
+  for (;;) {
+    while ((z->count == 0) && !z->done) pthread_cond_wait(&z->filled, &z->lock);
+    if (z->count == 0) break;
+    k = z->len[z->head] - z->at;
+    if (k > n) k = n;
+    memcpy(p, z->ring[z->head] + z->at, k);
+    z->at += k;
+    if (z->at == z->len[z->head]) {  /* hand the buffer back */
+      z->head = (z->head + 1) % NRING;
+      z->count--;
+      z->at = 0;
+      pthread_cond_signal(&z->emptied);
+    }
+    if (k > 0) break;
+  }
+  if ((k == 0) && z->err) {
+    errno = z->err;
+    pthread_mutex_unlock(&z->lock);
+    return -1;
+  }
+  pthread_mutex_unlock(&z->lock);
+  return (ssize_t) k;
+}
+
+static void stop(Inflater *z)
+{
+  int i;
+
+  pthread_mutex_lock(&z->lock);
+  z->stop = 1;
+  pthread_cond_signal(&z->emptied);
+  pthread_mutex_unlock(&z->lock);
+  (void) pthread_cancel(z->thread);  /* if blocked in read() */
+  (void) pthread_join(z->thread, 0);
+  if (z->unmap) (void) munmap((void *) z->src, z->srclen);
+  for (i = 0; i < NRING; i++) free(z->ring[i]);
+  free(z->buf);
+  pthread_mutex_destroy(&z->lock);
+  pthread_cond_destroy(&z->filled);
+  pthread_cond_destroy(&z->emptied);
+  free(z);
+}
+#endif
+
+#ifdef NOZLIB
+int ininflate(Input *in)
+{
+  (void) in;
+  return 0;
+}
+#endif
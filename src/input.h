@@ -0,0 +1,63 @@
+/* input.h - memory-mapped or block-buffered input | GPL */
+
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <stddef.h>
+
+#define INBUFSIZE (1024*1024)  /* block size for non-mappable input */
+
+/* Part of the reader library, which exports only shpr* names */
+#define inopen shprinopen
+#define inmem shprinmem
+#define ininflate shprininflate
+#define inclose shprinclose
+#define inneed shprinneed
+#define inpeek shprinpeek
+#define inskip shprinskip
+#define inseek shprinseek
+#define inunread shprinunread
+
+typedef struct Inflater Inflater;  /* see input.c */
+
+typedef struct {
+  int fd;
+  int mapped;                  /* 1 if base is a mapping */
+  int keep;                    /* 1 if it's the caller's, see inmem() */
+  unsigned char *base;         /* mapping or buffer */
+  size_t size;                 /* size of mapping or buffer */
+  const unsigned char *ptr;    /* next byte to hand out */
+  const unsigned char *end;    /* end of valid data */
+  Inflater *z;                 /* if the input is gzip compressed */
+} Input;
+
+extern int inopen(Input *in, int fd);  /* map fd or prepare block reads */
+extern int inmem(Input *in, const void *base, size_t size);  /* the caller's */
+extern int ininflate(Input *in);       /* inflate it, if it's gzip */
+extern void inclose(Input *in);        /* unmap or free the buffer */
+
+/* Gzip compressed input (by its magic bytes, see ininflate(),
+ * which inopen() calls) is inflated by a thread of its own, ahead
+ * of the reader, into a ring of NRING buffers of INBUFSIZE, and
+ * then read in blocks like a pipe: it is not mapped and cannot
+ * seek. Build with -DNOZLIB to read it as it is.
+ */
+#define NRING 4
+
+/* Return pointer to next n bytes and advance past them; the bytes
+ * remain valid until the next call. Return NULL at end of input
+ * (errno zero) or on read error (errno set).
+ */
+extern const unsigned char *inneed(Input *in, size_t n);
+extern const unsigned char *inpeek(Input *in, size_t n);  /* don't advance */
+extern int inskip(Input *in, size_t n);  /* -1 on eof or error */
+extern int inseek(Input *in, unsigned long offset);  /* -1 if can't */
+extern int inunread(Input *in, const void *p, size_t n);  /* unmapped only */
+
+/* A copy of a mapped Input is an independent cursor into the same
+ * mapping: several threads may read through their own copies.
+ * Only the original may be closed.
+ */
+#define intell(in) ((unsigned long) ((in)->ptr - (in)->base))
+
+#endif /* _INPUT_H_ */
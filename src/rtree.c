@@ -0,0 +1,423 @@
+/* rtree.c - packed Hilbert R-tree as a spatial index file | GPL */
+
+/* The entries are sorted by the Hilbert value of their centers,
+ * so neighbours in the plane tend to be neighbours in the file,
+ * and packed FANOUT to a node, bottom up, until there's a single
+ * root. The file is the header followed by the nodes, level by
+ * level, leaves first; each node is a bbox and a reference: a
+ * record number in leaves, the index of its first child above.
+ * The file is written in native byte order and mapped for use;
+ * one written elsewhere is ignored, like a stale one. It is only
+ * a cache and can always be rebuilt from the shapefile.
+ */
+
+#include "rtree.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define FANOUT    100          /* children per node: 4000 bytes */
+#define MAXLEVELS 16
+#define MAXSTAMPS 4
+#define HDRSIZE   256
+#define BYTEORDER 0x01020304L
+
+typedef struct {
+  BoundingBox bbox;
+  Integer ref;               /* record number or first child */
+  Integer unused;
+} Node;
+
+typedef struct {
+  char magic[4];             /* "SPX1" */
+  Integer order;             /* BYTEORDER as written */
+  Integer nodesize;          /* sizeof(Node) as written */
+  Integer fanout;
+  Integer nlevels;
+  Integer level[MAXLEVELS+1];  /* first node of each level, leaves first */
+  Integer nstamps;
+  RtStamp stamps[MAXSTAMPS];
+} Header;
+
+typedef struct {             /* for sorting entries */
+  unsigned long h;
+  long i;
+} Item;
+
+static const unsigned char *base = 0;
+static size_t size = 0;
+static const Header *hdr = 0;
+static const Node *nodes = 0;
+
+static unsigned long hilbert(unsigned long x, unsigned long y);
+static int byhilbert(const void *a, const void *b);
+static int byrecno(const void *a, const void *b);
+static int checkheader(const Header *h, const RtStamp *stamps, int nstamps);
+
+int rtstamp(RtStamp *stamp, const char *name)
+{
+  struct stat st;
+
+  if (stat(name, &st) < 0) return -1;
+  stamp->size = (Double) st.st_size;
+  stamp->mtime = (Double) st.st_mtime;
+  return 0;
+}
+
+int rtbuild(const char *name, RtEntry *entries, long n,
+            const RtStamp *stamps, int nstamps)
+{
+  char pad[HDRSIZE];
+  Header h;
+  BoundingBox ext;
+  Item *items;
+  Node *tree;
+  long total, start, end, i, j, k;
+  int level, err;
+  char *tmp;
+  FILE *fp;
+
+  if ((nstamps > MAXSTAMPS) || (n > 0x7FFFFFFFL / 2)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* drop entries with NaNs: they would never be found */
+  for (i = j = 0; i < n; i++) {
+    BoundingBox *b = &entries[i].bbox;
+    if ((b->xmin == b->xmin) && (b->ymin == b->ymin) &&
+        (b->xmax == b->xmax) && (b->ymax == b->ymax))
+      entries[j++] = entries[i];
+  }
+  n = j;
+
+  for (total = k = n; k > 1; total += k) k = (k + FANOUT-1) / FANOUT;
+  items = (Item *) malloc((n+1) * sizeof(Item));
+  tree = (Node *) malloc((total+1) * sizeof(Node));
+  tmp = (char *) malloc(strlen(name) + 5);
+  if (!items || !tree || !tmp) {
+    free(items); free(tree); free(tmp);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  /* Hilbert values of the centers on a 2^16 by 2^16 grid
+   * over their extent; infinite shapes go to the start */
+  ext.xmin = ext.ymin = 1.0;
+  ext.xmax = ext.ymax = 0.0;
+  for (i = 0; i < n; i++) {
+    Double x = entries[i].bbox.xmin/2 + entries[i].bbox.xmax/2;
+    Double y = entries[i].bbox.ymin/2 + entries[i].bbox.ymax/2;
+    if ((x - x != 0) || (y - y != 0)) continue;
+    if (ext.xmin > ext.xmax) { ext.xmin = ext.xmax = x; ext.ymin = ext.ymax = y; }
+    if (x < ext.xmin) ext.xmin = x;
+    if (x > ext.xmax) ext.xmax = x;
+    if (y < ext.ymin) ext.ymin = y;
+    if (y > ext.ymax) ext.ymax = y;
+  }
+  for (i = 0; i < n; i++) {
+    Double x = entries[i].bbox.xmin/2 + entries[i].bbox.xmax/2;
+    Double y = entries[i].bbox.ymin/2 + entries[i].bbox.ymax/2;
+    Double w = ext.xmax - ext.xmin, hh = ext.ymax - ext.ymin;
+    unsigned long hx = 0, hy = 0;
+    if ((x - x == 0) && (w > 0)) hx = (unsigned long) ((x - ext.xmin) / w * 65535.0);
+    if ((y - y == 0) && (hh > 0)) hy = (unsigned long) ((y - ext.ymin) / hh * 65535.0);
+    items[i].h = hilbert(hx, hy);
+    items[i].i = i;
+  }
+  qsort(items, n, sizeof(Item), byhilbert);
+
+  memset(&h, 0, sizeof h);
+  memcpy(h.magic, "SPX1", 4);
+  h.order = BYTEORDER;
+  h.nodesize = sizeof(Node);
+  h.fanout = FANOUT;
+  h.nstamps = nstamps;
+  for (i = 0; i < nstamps; i++) h.stamps[i] = stamps[i];
+
+  for (i = 0; i < n; i++) {  /* leaves */
+    const RtEntry *e = &entries[items[i].i];
+    tree[i].bbox = e->bbox;
+    tree[i].ref = (Integer) e->recno;
+    tree[i].unused = 0;
+  }
+  level = 0;
+  h.level[0] = 0;
+  for (start = 0, end = k = n; end - start > 1; start = end, end = k) {
+    for (i = start; i < end; i += FANOUT) {  /* parents */
+      Node *p = &tree[k++];
+      p->bbox = tree[i].bbox;
+      p->ref = (Integer) i;
+      p->unused = 0;
+      for (j = i+1; (j < i+FANOUT) && (j < end); j++) {
+        const BoundingBox *b = &tree[j].bbox;
+        if (b->xmin < p->bbox.xmin) p->bbox.xmin = b->xmin;
+        if (b->ymin < p->bbox.ymin) p->bbox.ymin = b->ymin;
+        if (b->xmax > p->bbox.xmax) p->bbox.xmax = b->xmax;
+        if (b->ymax > p->bbox.ymax) p->bbox.ymax = b->ymax;
+      }
+    }
+    h.level[++level] = (Integer) end;
+  }
+  h.level[level+1] = (Integer) end;
+  h.nlevels = level+1;
+  free(items);
+
+  /* write to a temporary file, then rename into place */
+  sprintf(tmp, "%s.tmp", name);
+  memset(pad, 0, sizeof pad);
+  memcpy(pad, &h, sizeof h);
+  if ((fp = fopen(tmp, "wb")) == NULL) {
+    err = errno;
+    free(tree); free(tmp);
+    errno = err;
+    return -1;
+  }
+  if ((fwrite(pad, 1, HDRSIZE, fp) != HDRSIZE) ||
+      ((long) fwrite(tree, sizeof(Node), end, fp) != end) ||
+      (fclose(fp) != 0) || (rename(tmp, name) < 0)) {
+    err = errno;
+    (void) remove(tmp);
+    free(tree); free(tmp);
+    errno = err;
+    return -1;
+  }
+  free(tree);
+  free(tmp);
+  return 0;
+}
+
+long rtopen(const char *name, const RtStamp *stamps, int nstamps)
+{
+  struct stat st;
+  void *p;
+  int fd;
+
+  if ((fd = open(name, O_RDONLY)) < 0) return -1;
+  if (fstat(fd, &st) < 0) { close(fd); return -1; }
+  if ((st.st_size < HDRSIZE) || ((off_t) (size_t) st.st_size != st.st_size)) {
+    close(fd);
+    errno = 0;
+    return -1;
+  }
+  p = mmap(0, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return -1;
+
+  base = (const unsigned char *) p;
+  size = (size_t) st.st_size;
+  hdr = (const Header *) p;
+  nodes = (const Node *) (base + HDRSIZE);
+  if (checkheader(hdr, stamps, nstamps) < 0) {
+    rtclose();
+    errno = 0;
+    return -1;
+  }
+  return hdr->level[1];
+}
+
+void rtclose(void)
+{
+  if (base) (void) munmap((void *) base, size);
+  base = 0;
+  size = 0;
+  hdr = 0;
+  nodes = 0;
+}
+
+long rtsearch(const BoundingBox *box, long **found)
+{
+  struct { long i; int level; } *stack;
+  long *recs = 0;
+  size_t sp = 0, nrecs = 0, room = 0;
+  int top = hdr->nlevels - 1;
+  long i, j;
+
+  stack = malloc((hdr->nlevels + 1) * FANOUT * sizeof *stack);
+  if (stack == NULL) return -1;
+  for (i = hdr->level[top]; i < hdr->level[top+1]; i++) {
+    stack[sp].i = i;
+    stack[sp++].level = top;
+  }
+
+  while (sp > 0) {
+    const Node *n = &nodes[stack[--sp].i];
+    int level = stack[sp].level;
+
+    if (!((n->bbox.xmin <= box->xmax) && (n->bbox.xmax >= box->xmin) &&
+          (n->bbox.ymin <= box->ymax) && (n->bbox.ymax >= box->ymin)))
+      continue;
+    if (level == 0) {
+      if (nrecs == room) {
+        long *r = (long *) realloc(recs, (room = room ? 2*room : 256) * sizeof(long));
+        if (r == NULL) { free(recs); free(stack); return -1; }
+        recs = r;
+      }
+      recs[nrecs++] = n->ref;
+      continue;
+    }
+    if ((n->ref < hdr->level[level-1]) || (n->ref >= hdr->level[level]))
+      continue;  /* corrupt */
+    for (j = n->ref; (j < n->ref + FANOUT) && (j < hdr->level[level]); j++) {
+      stack[sp].i = j;
+      stack[sp++].level = level-1;
+    }
+  }
+
+  free(stack);
+  if (nrecs > 0) qsort(recs, nrecs, sizeof(long), byrecno);
+  *found = recs;
+  return (long) nrecs;
+}
+
+static int checkheader(const Header *h, const RtStamp *stamps, int nstamps)
+{
+  int i;
+
+  if (memcmp(h->magic, "SPX1", 4) || (h->order != BYTEORDER) ||
+      (h->nodesize != sizeof(Node)) || (h->fanout != FANOUT) ||
+      (h->nlevels < 1) || (h->nlevels > MAXLEVELS) || (h->level[0] != 0))
+    return -1;
+  for (i = 0; i < h->nlevels; i++)
+    if (h->level[i+1] < h->level[i]) return -1;
+  if (size != HDRSIZE + (size_t) h->level[h->nlevels] * sizeof(Node))
+    return -1;
+  if (h->level[h->nlevels] - h->level[h->nlevels-1] > FANOUT)
+    return -1;  /* more roots than rtsearch() makes room for */
+  if (h->nstamps != nstamps) return -1;
+  for (i = 0; i < nstamps; i++)
+    if ((h->stamps[i].size != stamps[i].size) ||
+        (h->stamps[i].mtime != stamps[i].mtime)) return -1;
+  return 0;
+}
+
+/* distance of (x,y) along the Hilbert curve through 2^16 by 2^16 */
+static unsigned long hilbert(unsigned long x, unsigned long y)
+{
+  unsigned long s, rx, ry, t, d = 0;
+
+  for (s = 1UL << 15; s > 0; s >>= 1) {
+    rx = (x & s) ? 1 : 0;
+    ry = (y & s) ? 1 : 0;
+    d += s * s * ((3 * rx) ^ ry);
+    if (ry == 0) {  /* rotate quadrant */
+      if (rx == 1) { x = 0xFFFF - x; y = 0xFFFF - y; }
+      t = x; x = y; y = t;
+    }
+  }
+  return d;
+}
+
+static int byhilbert(const void *a, const void *b)
+{
+  const Item *p = (const Item *) a, *q = (const Item *) b;
+
+  if (p->h != q->h) return (p->h < q->h) ? -1 : 1;
+  return (p->i < q->i) ? -1 : (p->i > q->i);
+}
+
+static int byrecno(const void *a, const void *b)
+{
+  long p = *(const long *) a, q = *(const long *) b;
+
+  return (p < q) ? -1 : (p > q);
+}
+
+#ifdef TEST
+/* Build a tree over random boxes (some of them huge, infinite,
+ * or with NaNs), then compare searches against brute force.
+ * Print mismatches and exit 1 if there were any.
+ */
+#define TESTFILE "rtree-test.spx"
+
+static double urand(double lo, double hi)
+{
+  return lo + (hi - lo) * (rand() / (RAND_MAX + 1.0));
+}
+
+int main(void)
+{
+  static const long sizes[] = { 0, 1, 2, 99, 100, 101, 10000, 25000 };
+  double inf = 1e308 * 10, nan = inf - inf;
+  unsigned long tests = 0, fails = 0;
+  RtStamp stamps[2], other;
+  size_t s;
+
+  stamps[0].size = 1234; stamps[0].mtime = 5678;
+  stamps[1].size = 42;   stamps[1].mtime = 5679;
+  other = stamps[1]; other.mtime += 1;
+
+  for (s = 0; s < sizeof sizes / sizeof *sizes; s++) {
+    long n = sizes[s], i, j, q, nfound, *found;
+    RtEntry *e = (RtEntry *) malloc((n+1) * sizeof(RtEntry));
+    RtEntry *copy = (RtEntry *) malloc((n+1) * sizeof(RtEntry));
+
+    for (i = 0; i < n; i++) {
+      double x = urand(-180, 180), y = urand(-90, 90);
+      double w = (i % 50) ? urand(0, 2) : urand(0, 200);
+      e[i].bbox.xmin = x; e[i].bbox.xmax = x + w;
+      e[i].bbox.ymin = y; e[i].bbox.ymax = y + urand(0, 2);
+      if (i % 97 == 5) { e[i].bbox.xmin = e[i].bbox.ymin = -inf;
+                         e[i].bbox.xmax = e[i].bbox.ymax = inf; }
+      if (i % 89 == 7) e[i].bbox.ymax = nan;
+      e[i].recno = i+1;
+    }
+    memcpy(copy, e, (n+1) * sizeof(RtEntry));
+    if (rtbuild(TESTFILE, copy, n, stamps, 2) < 0) { perror(TESTFILE); return 1; }
+
+    tests++;
+    stamps[1] = other;  /* stale */
+    if (rtopen(TESTFILE, stamps, 2) >= 0) { fails++; printf("stale tree opened\n"); }
+    stamps[1].mtime -= 1;
+
+    if (rtopen(TESTFILE, stamps, 2) < 0) { perror(TESTFILE); return 1; }
+    for (q = 0; q < 200; q++) {
+      BoundingBox box;
+      long want = 0, k = 0;
+      box.xmin = urand(-200, 200); box.xmax = box.xmin + urand(0, (q % 10) ? 5 : 100);
+      box.ymin = urand(-100, 100); box.ymax = box.ymin + urand(0, 5);
+      if ((nfound = rtsearch(&box, &found)) < 0) { printf("out of memory\n"); return 1; }
+      for (i = 0; i < n; i++) {
+        const BoundingBox *b = &e[i].bbox;
+        if ((b->xmin <= box.xmax) && (b->xmax >= box.xmin) &&
+            (b->ymin <= box.ymax) && (b->ymax >= box.ymin)) {
+          want++;
+          if ((k < nfound) && (found[k] == e[i].recno)) k++;
+        }
+      }
+      for (j = 1; j < nfound; j++) if (found[j-1] >= found[j]) break;
+      tests++;
+      if ((want != nfound) || (k != nfound) || (j < nfound)) {
+        if (fails++ < 20) printf("n %ld query %ld: want %ld found %ld\n", n, q, want, nfound);
+      }
+      free(found);
+    }
+    rtclose();
+
+    if (n > 2*FANOUT) {  /* all nodes roots, with the file size right */
+      FILE *fp = fopen(TESTFILE, "r+b");
+      Header h;
+      if ((fp == NULL) || (fread(&h, sizeof h, 1, fp) != 1)) { perror(TESTFILE); return 1; }
+      h.level[1] = h.level[h.nlevels];
+      h.nlevels = 1;
+      rewind(fp);
+      if ((fwrite(&h, sizeof h, 1, fp) != 1) || (fclose(fp) != 0)) { perror(TESTFILE); return 1; }
+      tests++;
+      if (rtopen(TESTFILE, stamps, 2) >= 0) { fails++; printf("corrupt tree opened\n"); rtclose(); }
+    }
+    free(e);
+    free(copy);
+  }
+  (void) remove(TESTFILE);
+
+  printf("%lu tests, %lu failed\n", tests, fails);
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,40 @@
+/* rtree.h - packed Hilbert R-tree as a spatial index file | GPL */
+
+#ifndef _RTREE_H_
+#define _RTREE_H_
+
+#include "shapefile.h"
+
+#define RTREE_SUFFIX ".spx"  /* suffix for spatial index (counties.spx) */
+
+typedef struct {             /* what the tree indexes */
+  BoundingBox bbox;
+  long recno;                /* record number, 1-based */
+} RtEntry;
+
+typedef struct {             /* identifies a version of a file */
+  Double size, mtime;        /* exact below 2^53 */
+} RtStamp;
+
+extern int rtstamp(RtStamp *stamp, const char *name);  /* -1 if no stat */
+
+/* Bulk-load the tree from n entries (reordering them) and write
+ * it to the named file, along with stamps of the files it was
+ * built from. Return -1 with errno set on failure.
+ */
+extern int rtbuild(const char *name, RtEntry *entries, long n,
+                   const RtStamp *stamps, int nstamps);
+
+/* Map the named tree; return #entries, or -1 if there is none
+ * or it is invalid or was built from files with other stamps.
+ */
+extern long rtopen(const char *name, const RtStamp *stamps, int nstamps);
+extern void rtclose(void);
+
+/* Find the entries whose bbox intersects box; store the record
+ * numbers, sorted ascending, into a malloc'ed array at *found
+ * and return their count, or -1 if out of memory.
+ */
+extern long rtsearch(const BoundingBox *box, long **found);
+
+#endif /* _RTREE_H_ */
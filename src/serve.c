@@ -0,0 +1,312 @@
+/* serve.c - answer dump requests on a socket | GPL */
+
+/* The server accepts connections and forks a process to run each
+ * request, so requests are isolated from each other and from the
+ * server the way separate commands would be, but without the exec.
+ * At most workers requests run at a time: when all are busy, the
+ * server waits for one to finish before it accepts the next
+ * connection, so a large file or a slow client holds up no more
+ * than one of them.
+ *
+ * If the request line is there when the connection is accepted,
+ * as it is with most clients, the server reads it and maps the
+ * shapefile of the request and its .shx before it forks, and keeps
+ * the last CACHESIZE of them mapped; the request process inherits
+ * the mappings and reads through them. Otherwise the server never
+ * waits for it: the request process reads it (for up to TIMEOUT
+ * seconds) and maps the files for itself.
+ */
+
+#include "serve.h"
+#include "index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define CACHESIZE 16     /* files kept mapped */
+#define MAXREQUEST 4096  /* bytes in a request line */
+#define MAXARGS 64
+#define TIMEOUT 10       /* seconds for a client to send its request */
+
+typedef struct {
+  char name[256];
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+  void *base;            /* mapping, or 0 if the entry is free */
+  unsigned long used;    /* when it was last requested */
+} Cached;
+
+static Cached cache[CACHESIZE];
+static unsigned long tick = 0;
+
+static int listenon(const char *addr);
+static int ready(int fd);
+static int getrequest(int fd, char *line, char **argv);
+static int named(int argc, char **argv, const char *optstring);
+static void prepare(const char *arg);
+static void keep(const char *name);
+static int spool(void);
+
+int serve(const char *addr, int workers, const char *progname,
+          const char *optstring, int (*run)(int argc, char *argv[]))
+{
+  static const char invalid[] = "shpdump: invalid request\n";
+  extern int optind;
+  char line[MAXREQUEST+1], *argv[MAXARGS+2];
+  int fd, conn, argc, running = 0;
+  pid_t pid;
+
+  if ((fd = listenon(addr)) < 0) return -1;
+  (void) signal(SIGPIPE, SIG_IGN);  /* clients that hang up */
+  if (workers < 1) workers = 1;
+
+  for (;;) {
+    while ((running > 0) && (waitpid(-1, 0, WNOHANG) > 0)) running--;
+    while ((running >= workers) && (waitpid(-1, 0, 0) > 0)) running--;
+
+    if ((conn = accept(fd, 0, 0)) < 0) {
+      if ((errno == EINTR) || (errno == ECONNABORTED)) continue;
+      return -1;
+    }
+    argv[0] = (char *) progname;
+    argc = 0;  /* until the request is read */
+    if (ready(conn)) {
+      if ((argc = getrequest(conn, line, argv + 1)) < 0) {
+        (void) write(conn, invalid, sizeof invalid - 1);
+        close(conn);
+        continue;
+      }
+      argc++;
+      if (named(argc, argv, optstring)) prepare(argv[optind]);
+    }
+
+    switch (pid = fork()) {
+      case -1:
+        close(conn);  /* the client sees it closed, try again later */
+        continue;
+      case 0:
+        close(fd);
+        (void) signal(SIGPIPE, SIG_DFL);
+        if (!argc) {
+          if ((argc = getrequest(conn, line, argv + 1)) < 0) {
+            (void) write(conn, invalid, sizeof invalid - 1);
+            _exit(127);
+          }
+          argc++;
+          if (named(argc, argv, optstring)) prepare(argv[optind]);
+        }
+        if ((dup2(conn, 0) < 0) || (dup2(conn, 1) < 0) || (dup2(conn, 2) < 0))
+          _exit(127);
+        close(conn);
+        if (!named(argc, argv, optstring) && (spool() < 0)) {
+          static const char msg[] = "shpdump: cannot spool input\n";
+          (void) write(2, msg, sizeof msg - 1);
+          _exit(111);
+        }
+        optind = 1;
+        exit(run(argc, argv));
+    }
+    close(conn);
+    running++;
+  }
+}
+
+/* A Unix socket, replacing a stale one, or a port on localhost */
+static int listenon(const char *addr)
+{
+  struct sockaddr_un un;
+  struct sockaddr_in in;
+  struct stat st;
+  const char *p;
+  int fd, on = 1;
+
+  for (p = addr; (*p >= '0') && (*p <= '9'); p++);
+  if ((p > addr) && !*p) {
+    long port = atol(addr);
+    if ((port < 1) || (port > 65535)) { errno = EINVAL; return -1; }
+    memset(&in, 0, sizeof in);
+    in.sin_family = AF_INET;
+    in.sin_port = htons((unsigned short) port);
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) return -1;
+    (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+    if (bind(fd, (struct sockaddr *) &in, sizeof in) < 0) goto fail;
+  }
+  else {
+    if (strlen(addr) >= sizeof un.sun_path) { errno = ENAMETOOLONG; return -1; }
+    memset(&un, 0, sizeof un);
+    un.sun_family = AF_UNIX;
+    strcpy(un.sun_path, addr);
+    if ((stat(addr, &st) == 0) && S_ISSOCK(st.st_mode)) (void) unlink(addr);
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) return -1;
+    if (bind(fd, (struct sockaddr *) &un, sizeof un) < 0) goto fail;
+  }
+  if (listen(fd, 64) < 0) goto fail;
+  return fd;
+
+fail:
+  close(fd);
+  return -1;
+}
+
+/* Whether the request line is there to read without waiting */
+static int ready(int fd)
+{
+  char buf[MAXREQUEST];
+  ssize_t n = recv(fd, buf, sizeof buf, MSG_PEEK | MSG_DONTWAIT);
+
+  return (n > 0) && (memchr(buf, '\n', (size_t) n) != NULL);
+}
+
+/* Whether the request names a shapefile, the first argument after
+ * the options, at argv[optind] */
+static int named(int argc, char **argv, const char *optstring)
+{
+  extern int optind, opterr;
+
+  opterr = 0;
+  optind = 1;
+  while (getopt(argc, argv, optstring) != -1);
+  return optind < argc;
+}
+
+/* Read the request line, but not beyond it (the input may follow),
+ * and split it into argv; return the number of arguments or -1 */
+static int getrequest(int fd, char *line, char **argv)
+{
+  struct timeval tv;
+  size_t len = 0;
+  ssize_t n;
+  char *p, *s;
+  int argc = 0;
+
+  tv.tv_sec = TIMEOUT;
+  tv.tv_usec = 0;
+  (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  for (;;) {
+    if ((n = recv(fd, line + len, MAXREQUEST - len, MSG_PEEK)) <= 0) return -1;
+    if ((p = memchr(line + len, '\n', (size_t) n)) != NULL) n = p - (line + len) + 1;
+    if (recv(fd, line + len, (size_t) n, 0) != n) return -1;
+    len += (size_t) n;
+    if (p) break;
+    if (len == MAXREQUEST) return -1;
+  }
+  tv.tv_sec = 0;
+  (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+  line[len] = '\0';
+
+  for (s = strtok(line, " \t\r\n"); s; s = strtok(0, " \t\r\n")) {
+    if (argc == MAXARGS) return -1;
+    argv[argc++] = s;
+  }
+  argv[argc] = 0;
+  return argc;
+}
+
+/* Keep the shapefile named in the request mapped, and its .shx */
+static void prepare(const char *arg)
+{
+  char buf[256], name[256];
+  const char *shp = shpname(buf, sizeof buf, arg);
+
+  if (!shp) return;
+  tick++;
+  keep(shp);
+  if (idxname(name, sizeof name, shp)) keep(name);
+}
+
+static void keep(const char *name)
+{
+  Cached *c, *slot = 0;
+  struct stat st;
+  void *p;
+  int fd, i;
+
+  for (i = 0; i < CACHESIZE; i++) {
+    c = &cache[i];
+    if (!c->base) { if (!slot || slot->base) slot = c; continue; }
+    if (strcmp(c->name, name)) {
+      if (!slot || (slot->base && (c->used < slot->used))) slot = c;
+      continue;
+    }
+    if ((stat(name, &st) == 0) && (st.st_dev == c->dev) && (st.st_ino == c->ino) &&
+        (st.st_size == c->size) && (st.st_mtime == c->mtime)) {
+      c->used = tick;
+      return;
+    }
+    (void) munmap(c->base, (size_t) c->size);  /* changed or gone */
+    c->base = 0;
+    slot = c;
+    break;
+  }
+
+  /* not there: map it into the slot or least recently used entry */
+  if ((strlen(name) >= sizeof slot->name) || ((fd = open(name, O_RDONLY)) < 0))
+    return;
+  if ((fstat(fd, &st) < 0) || !S_ISREG(st.st_mode) || (st.st_size <= 0) ||
+      ((off_t) (size_t) st.st_size != st.st_size)) {
+    close(fd);
+    return;
+  }
+  p = mmap(0, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) return;
+  (void) posix_madvise(p, (size_t) st.st_size, POSIX_MADV_WILLNEED);
+  if (slot->base) (void) munmap(slot->base, (size_t) slot->size);
+  strcpy(slot->name, name);
+  slot->dev = st.st_dev;
+  slot->ino = st.st_ino;
+  slot->size = st.st_size;
+  slot->mtime = st.st_mtime;
+  slot->base = p;
+  slot->used = tick;
+}
+
+const void *servemap(const char *name, size_t *size)
+{
+  int i;
+
+  for (i = 0; i < CACHESIZE; i++)
+    if (cache[i].base && !strcmp(cache[i].name, name)) {
+      *size = (size_t) cache[i].size;
+      return cache[i].base;
+    }
+  return NULL;
+}
+
+/* Input from the client goes to a temporary file first, which is
+ * then mapped: no deadlock with a client that sends all its input
+ * before it reads, and the reader gets a file it can map */
+static int spool(void)
+{
+  char buf[64*1024];
+  ssize_t n;
+  FILE *fp = tmpfile();
+
+  if (fp == NULL) return -1;
+  while ((n = read(0, buf, sizeof buf)) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (fwrite(buf, 1, (size_t) n, fp) != (size_t) n) return -1;
+  }
+  if ((fflush(fp) != 0) || (lseek(fileno(fp), 0, SEEK_SET) < 0)) return -1;
+  if (dup2(fileno(fp), 0) < 0) return -1;
+  return 0;
+}
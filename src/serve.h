@@ -0,0 +1,30 @@
+/* serve.h - answer dump requests on a socket | GPL */
+
+#ifndef _SERVE_H_
+#define _SERVE_H_
+
+#include <stddef.h>
+
+/* Listen on addr, a Unix socket path or a TCP port on localhost
+ * (all digits), and answer requests there, at most workers at a
+ * time, until killed; return -1 with errno set if we cannot listen.
+ *
+ * A request is a line with the arguments of a command, options
+ * (as in optstring, for getopt) and shapefile, separated by blanks;
+ * without a shapefile, what the client sends after the line is the
+ * input. The client then shuts down its side for writing and reads
+ * the output, stdout and stderr as one, until the server closes.
+ *
+ * Each request runs in a process of its own, forked (no exec) from
+ * the server, which calls run() there with the arguments, behind an
+ * argv[0] of progname, and exits with what it returns.
+ */
+extern int serve(const char *addr, int workers, const char *progname,
+                 const char *optstring, int (*run)(int argc, char *argv[]));
+
+/* In run(): the mapping of a file the server keeps open, or NULL.
+ * The server keeps the shapefiles requested recently, and their
+ * .shx, as long as they don't change (size, mtime, inode). */
+extern const void *servemap(const char *name, size_t *size);
+
+#endif /* _SERVE_H_ */
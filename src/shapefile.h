@@ -19,7 +19,7 @@
 #define SHP_TYPE_MULTIPOINT    8
 
 #define SHP_TYPE_POINTZ       11   /* shape types in X,Y,Z space */
-#define SHP_TYPE_POLYLINEZ    13   /*  (they always include M) */
+#define SHP_TYPE_POLYLINEZ    13   /*  (M values optional) */
 #define SHP_TYPE_POLYGONZ     15
 #define SHP_TYPE_MULTIPOINTZ  18
 
@@ -30,6 +30,13 @@
 
 #define SHP_TYPE_MULTIPATCH   31   /* surface patches */
 
+#define SHP_PART_TRIANGLESTRIP 0   /* types of multipatch parts */
+#define SHP_PART_TRIANGLEFAN   1
+#define SHP_PART_OUTERRING     2
+#define SHP_PART_INNERRING     3   /*  (hole in preceding outer) */
+#define SHP_PART_FIRSTRING     4   /*  (first of polygon's rings) */
+#define SHP_PART_RING          5   /*  (other ring of a first's) */
+
 #if INT_MAX == 0x7FFFFFFF
   #define INT32 int
   #define FINT "%d"
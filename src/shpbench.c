@@ -0,0 +1,181 @@
+/* shpbench - time shpdump on shapefiles | GPL
+ *
+ * Usage: shpbench [-n runs] [-m args]... shpdump file...
+ *
+ * Run the given shpdump on each file with each set of arguments
+ * (-m, repeatable; default: none, -g, -v, -x, -h), output to
+ * /dev/null, runs times each (default 3), and write a table to
+ * stdout, tab separated, a line per file and mode with the best
+ * wall time of the runs and the CPU time and peak resident set
+ * size (as getrusage() reports it; kilobytes on Linux) of that run:
+ *
+ *   # shpdump by ujr/2008-07-27
+ *   file  mode  bytes  records  seconds  cpu  mbps  recps  maxrss
+ *
+ * The first line is what shpdump -V says. Bytes is the size of the
+ * shapefile, records the count from the .shx (0 if there's none),
+ * mbps and recps are bytes (in millions) and records per second.
+ *
+ * Exit codes: 0 ok, 1 if a run failed, 111 troubles running shpdump,
+ * 127 invalid arguments.
+ */
+
+#include "shapefile.h"
+#include "index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define FAILSOFT 111
+#define FAILHARD 127
+#define MAXMODES 32
+#define MAXARGS 32
+
+static const char usage[] = "Usage: shpbench [-n runs] [-m args]... shpdump file...\n";
+static const char *defaults[] = { "", "-g", "-v", "-x", "-h" };
+
+typedef struct {
+  double seconds;  /* wall */
+  double cpu;      /* user and system */
+  long maxrss;
+  int status;
+} Run;
+
+static void die(int code, const char *info);
+static int measure(Run *run, const char *prog, const char *args, const char *file);
+static void version(const char *prog);
+static long records(const char *file);
+
+int main(int argc, char *argv[])
+{
+  extern int optind;
+  extern char *optarg;
+  const char *modes[MAXMODES];
+  int nmodes = 0, runs = 3, failed = 0, c, i, m, k;
+  struct stat st;
+  Run run, best = { 0, 0, 0, 0 };
+  long recs;
+
+  while ((c = getopt(argc, argv, "n:m:")) != -1) switch (c) {
+    case 'n': if ((runs = atoi(optarg)) < 1) runs = 1; break;
+    case 'm': if (nmodes == MAXMODES) { errno = 0; die(FAILHARD, "too many modes"); }
+              modes[nmodes++] = optarg; break;
+    default:  fputs(usage, stderr); exit(FAILHARD);
+  }
+  if (argc - optind < 2) { fputs(usage, stderr); exit(FAILHARD); }
+  if (nmodes == 0)
+    for (; nmodes < (int) (sizeof defaults / sizeof defaults[0]); nmodes++)
+      modes[nmodes] = defaults[nmodes];
+
+  version(argv[optind]);
+  printf("file\tmode\tbytes\trecords\tseconds\tcpu\tmbps\trecps\tmaxrss\n");
+  for (i = optind + 1; i < argc; i++) {
+    if (stat(argv[i], &st) < 0) die(FAILHARD, argv[i]);
+    recs = records(argv[i]);
+    for (m = 0; m < nmodes; m++) {
+      for (k = 0; k < runs; k++) {
+        if (measure(&run, argv[optind], modes[m], argv[i]) < 0) die(FAILSOFT, argv[optind]);
+        if ((k == 0) || (run.seconds < best.seconds)) best = run;
+        if (run.status != 0) failed = 1;
+      }
+      if (best.seconds <= 0) best.seconds = 1e-6;
+      printf("%s\t%s\t%.0f\t%ld\t%.3f\t%.3f\t%.1f\t%.0f\t%ld\n", argv[i],
+             *modes[m] ? modes[m] : "default", (double) st.st_size, recs,
+             best.seconds, best.cpu, st.st_size / best.seconds / 1e6,
+             recs / best.seconds, best.maxrss);
+      fflush(stdout);
+    }
+  }
+  return failed;
+}
+
+static void die(int code, const char *info)
+{
+  fprintf(stderr, "shpbench: %s", info);
+  if (errno) fprintf(stderr, ": %s", strerror(errno));
+  fputc('\n', stderr);
+  exit(code);
+}
+
+/* Run prog with args (split on blanks) and file, output to /dev/null.
+ * The run is in a grandchild: its rusage comes to the child, which has
+ * no other children, with RUSAGE_CHILDREN, and back through a pipe */
+static int measure(Run *run, const char *prog, const char *args, const char *file)
+{
+  char buf[256], *argv[MAXARGS+3], *s;
+  struct timeval t0, t1;
+  struct rusage ru;
+  int fd[2], argc = 0, status;
+  pid_t pid;
+
+  if (strlen(args) >= sizeof buf) { errno = E2BIG; return -1; }
+  strcpy(buf, args);
+  argv[argc++] = (char *) prog;
+  for (s = strtok(buf, " \t"); s && (argc < MAXARGS+1); s = strtok(0, " \t"))
+    argv[argc++] = s;
+  argv[argc++] = (char *) file;
+  argv[argc] = 0;
+
+  if (pipe(fd) < 0) return -1;
+  gettimeofday(&t0, 0);
+  if ((pid = fork()) < 0) { close(fd[0]); close(fd[1]); return -1; }
+  if (pid == 0) {
+    close(fd[0]);
+    if ((pid = fork()) < 0) _exit(FAILSOFT);
+    if (pid == 0) {
+      int null = open("/dev/null", O_WRONLY);
+      close(fd[1]);
+      if ((null < 0) || (dup2(null, 1) < 0) || (dup2(null, 2) < 0)) _exit(FAILSOFT);
+      execv(prog, argv);
+      _exit(FAILSOFT);
+    }
+    if (waitpid(pid, &status, 0) < 0) _exit(FAILSOFT);
+    gettimeofday(&t1, 0);
+    if (getrusage(RUSAGE_CHILDREN, &ru) < 0) _exit(FAILSOFT);
+    run->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+    run->cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+               ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    run->maxrss = ru.ru_maxrss;
+    run->status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    if (write(fd[1], run, sizeof *run) != sizeof *run) _exit(FAILSOFT);
+    _exit(0);
+  }
+  close(fd[1]);
+  status = (read(fd[0], run, sizeof *run) == sizeof *run) ? 0 : -1;
+  close(fd[0]);
+  if ((waitpid(pid, 0, 0) < 0) || (status < 0)) { errno = 0; return -1; }
+  return 0;
+}
+
+/* shpdump -V as a comment line */
+static void version(const char *prog)
+{
+  char cmd[512], line[256];
+  FILE *fp;
+
+  if (strlen(prog) + 6 > sizeof cmd) return;
+  sprintf(cmd, "'%s' -V", prog);
+  if ((fp = popen(cmd, "r")) == NULL) return;
+  if (fgets(line, sizeof line, fp)) printf("# %s", line);
+  (void) pclose(fp);
+}
+
+/* The number of records, from the size of the .shx */
+static long records(const char *file)
+{
+  char name[256];
+  struct stat st;
+
+  if (!idxname(name, sizeof name, file)) return 0;
+  if ((stat(name, &st) < 0) || (st.st_size < 100)) return 0;
+  return (long) ((st.st_size - 100) / sizeof(IndexRecord));
+}
@@ -3,20 +3,80 @@
  * Copyright (c) 2004-2008 by Urs-Jakob Ruetschi.
  * Licensed under the terms of the GNU General Public License.
  *
- * Usage: shpdump [-V] [-p prec] [-ghvx] [shapefile]
+ * Usage: shpdump [-cV] [-a cols] [-b box] [-e tol] [-f fmt] [-j jobs] [-l addr] [-o dir] [-p prec] [-r recs] [-z tiles] [-ghikstvx] [shapefile...]
  *
  * Read from stdin or the file given on the command line a shapefile
  * and dump it to stdout in a plain text representation that is easy
  * to read for humans and machines.  Any complaints go to stderr.
+ * The shapefile may be gzip compressed; it is then decompressed
+ * by a thread of its own while the dump goes on, and x.shp.gz
+ * goes with x.shx and x.dbf.
+ *
+ * Given more than one shapefile, a directory (for the shapefiles
+ * in it) or @file (a list of them, one per line), dump them all in
+ * a batch, up to -j (default 4) at a time, each in a process of
+ * its own, see batch.h; the output of each goes to stdout after a
+ * line "file name bytes", or with -o to a file of its own, and a
+ * summary goes to stderr. The exit code is the highest of them.
  *
  * Options:
  *
  *   -V  identify program and version to stdout and exit 0
+ *   -c  check only: dump nothing, report inconsistencies like -x
+ *       and more (record numbers, lengths, parts, the .shx) and
+ *       write a summary; works with -j
+ *   -a  dump the given columns (comma separated) of the .dbf with
+ *       each record, as "field name value" lines, after the WKB,
+ *       or as Arrow columns; not with -g
+ *   -b  dump only shapes within box xmin,ymin,xmax,ymax (the shape's
+ *       bbox must intersect the box; points must be inside); uses
+ *       the spatial index (.spx) if there's an up-to-date one
+ *   -e  simplify lines and polygon rings for output to about tol
+ *       (in map units, like a pixel): drop vertices that make a
+ *       triangle of less than tol*tol/2 with their neighbours (the
+ *       smallest first), keeping the ends of each part and 4 points
+ *       of each ring; -x and -c check the shapes as they are
+ *   -f  output format: text (default), wkb for each record's number,
+ *       WKB length (32-bit little endian) and Well-Known Binary, or
+ *       hex for a line per record with number and WKB in hex, or
+ *       arrow for an Arrow IPC file with GeoArrow geometries
  *   -g  dump in Arc GENERATE format
  *   -h  header only: quit after dump of shapefile header
+ *   -i  rebuild the index (.shx) from the records of the shapefile
+ *       alone, in one pass, up to the last complete record, and
+ *       exit; -ii also writes the actual file length and bbox into
+ *       the header of both (not for a compressed shapefile)
+ *   -j  use this many threads: split by the index (.shx) if there
+ *       is one, or else (stdin, pipes, gzip) cut up as it's read
+ *   -k  check the geometry of lines and polygons, reporting like -x
+ *       the record and part (from 0) of those that cross or touch
+ *       themselves, rings not closed or with too few points, rings
+ *       crossing each other and outer rings not clockwise, holes
+ *       not counter-clockwise; with a sweep line, not all pairs
+ *   -l  serve dump requests on a Unix socket (path) or a TCP port
+ *       on localhost, up to -j (default 4) at a time; see serve.h;
+ *       requests cannot have -l, -o, -i, -s or -r @file
+ *   -o  in a batch, write the output of each shapefile to a file
+ *       in this directory, named like it with .txt (.gen with -g,
+ *       or .wkb, .hex, .arrow with -f) for .shp; with -z, that of
+ *       each tile to z/x/y.txt (or x/y.txt) there
  *   -v  verbose: dump more stuff about the shapefile
  *   -x  report inconsistencies in the shapefile to stderr
+ *   -z  cut into tiles, a zoom level z (2^z by 2^z tiles over the
+ *       extent, made square, rows from the top) or w,h for tiles
+ *       of that size from 0,0: dump each tile's shapes cut to it,
+ *       after a line "tile z/x/y bytes" (or x/y) or with -o to a
+ *       file of its own; lines and rings are clipped, points kept
+ *       if in the tile, multipatches if their bbox touches it; by
+ *       -j workers; needs a mapped (not compressed) shapefile
  *   -p  use given precision (digits after decimal point; deflt 2)
+ *   -r  dump only the given records: a list like 7,1000-2000,5000-
+ *       or @file to read such a list from file; needs the .shx
+ *   -s  build the spatial index (.spx) for -b and exit; needs the .shx
+ *   -t  write statistics to stderr at the end: records, bytes and
+ *       time, with rates, time spent reading, decoding, on bboxes,
+ *       formatting and writing, and records per type and per number
+ *       of parts and points; a progress line every 10 seconds
  *
  * Exit codes:
  *
@@ -33,54 +93,170 @@
  */
 
 static char id[] = "shpdump by ujr/2008-07-27\n";
-static char usage[] = "Usage: shpdump [-V] [-p prec] [-ghvx] [shapefile]\n";
+static char usage[] = "Usage: shpdump [-cV] [-a cols] [-b box] [-e tol] [-f fmt] [-j jobs] [-l addr] [-o dir] [-p prec] [-r recs] [-z tiles] [-ghikstvx] [shapefile...]\n";
 
 #define FAILSOFT 111  /* temporary error */
 #define FAILHARD 127  /* permanent error */
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
-#include <float.h>   /* DBL_MIN, DBL_MAX */
+#include <float.h>   /* DBL_MAX */
+#include <limits.h>  /* LONG_MAX */
+#include <math.h>    /* HUGE_VAL */
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>  /* calloc, free, atoi */
 #include <string.h>
+#include <time.h>    /* clock_gettime */
 #include <unistd.h>  /* getopt if _POSIX_C_SOURCE >= 2 */
+#include <sys/stat.h>  /* mkdir */
 
+#include "arrow.h"
+#include "batch.h"
+#include "clip.h"
+#include "dbf.h"
 #include "endian.h"
+#include "fmt.h"
+#include "index.h"
+#include "rtree.h"
 #include "shapefile.h"
-
-int header(void);            /* parse and dump header, return shape type */
-int dumpshape(void);         /* dump next shape, return type */
+#include "serve.h"
+#include "shpread.h"
+#include "simplify.h"
+#include "valid.h"
+#include "wkb.h"
+
+#define NOTELEN 80
+
+typedef struct {           /* a warning kept for later */
+  size_t at;               /* output length when it was issued */
+  char info[NOTELEN];
+} Note;
+
+#define NTYPES 32          /* shape types 0..31, the rest counted as 32 */
+#define NBUCKETS 33        /* counts 0, 1, 2-3, 4-7, ... 2^31-... */
+
+typedef struct {           /* for -t, one per thread */
+  double last;             /* when the last phase ended */
+  double read, decode, bbox, format, write, other;  /* seconds */
+  unsigned long types[NTYPES+1];  /* records per shape type */
+  unsigned long parts[NBUCKETS], points[NBUCKETS];  /* per record */
+} Stats;
+
+typedef struct {           /* state of a dump, one per thread */
+  ShpReader *in;           /* where shapes come from */
+  unsigned long tally;     /* input handled, in 16-bit words */
+  unsigned long records;   /* number of records handled */
+  long recno;              /* position of the record at hand, from 1 */
+  BoundingBox bbox;        /* actual extent of shapes dumped */
+  char *buf;               /* output buffer */
+  size_t size, len;
+  int keep;                /* keep output and warnings, don't flush */
+  int quiet;               /* discard output */
+  Note *notes;             /* warnings kept */
+  size_t nnotes;
+  unsigned long warnings;
+  jmp_buf *fail;           /* where fail() jumps to, if set */
+  int code, err;           /* exit code and errno of the failure */
+  char info[NOTELEN];      /* and what it was about */
+  Stats stats;             /* if -t */
+  Simplifier simple;       /* for -e */
+  void *copy;              /* arrays of the simplified record */
+  size_t copysize;
+  Validator valid;         /* for -k */
+  Clipper clip;            /* for -z */
+  int tiled;               /* dumping a tile: */
+  long tilex, tiley;       /* its column and row */
+  BoundingBox tile;        /* and its box */
+} Dump;
+
+int header(Dump *d);            /* parse and dump header, return shape type */
+int options(int argc, char *argv[]);  /* parse options, see main() */
+const char *suffix(void);       /* of output files, by format */
+int dump(int argc, char *argv[]);  /* dump file or stdin, return exit code */
+int request(int argc, char *argv[]);  /* run a request to the server */
+int dumpshape(Dump *d);         /* dump next shape, return type */
+void dumpnext(Dump *d, int type);  /* dump next shape, check its type */
+int outside(const ShpRecord *rec);  /* shape not in -b box? */
+long openindex(const char *filename);  /* map .shx, return #records */
+long mapindex(const char *name);       /* idxopen(), or the server's copy */
+long tryindex(const char *filename);   /* same, but 0 if there's none */
+void dumpranges(Dump *d, long count, int type);  /* dump selected shapes */
+void buildtree(Dump *d, const char *filename);  /* write spatial index */
+int buildindex(Dump *d, const char *filename);  /* write .shx, for -i */
+int usetree(const char *filename);  /* select -b shapes via spatial index */
+int dumpparallel(Dump *d, long count, int type);  /* dump with -j threads */
+int dumpstream(Dump *d, int type);  /* same, reading a pipe */
 char *shptype(int type);     /* translate shape code to description */
-void dumppoint(Integer id);
-void dumpline(Integer id);
-void dumppolygon(Integer id);
-void dumpmultipoint(Integer id);
-void dumplinez(Integer id);
-
-Integer getint(void);        /* read integer, little endian */
-Integer getintbig(void);     /* read integer, big endian */
-Double getdouble(void);      /* read double, little endian */
-Point getpoint(void);        /* read two doubles, little endian */
-
-void putint(const char *label, Integer value);
-void putname(const char *label, const char *name);
-void putrange(const char *label, Double min, Double max);
-void putbbox(Double xmin, Double ymin, Double xmax, Double ymax);
-void putpoint(Double xcoord, Double ycoord, int gflag);
-void putpointz(Double x, Double y, Double z, Double m, int gflag);
+int shpvalidtype(int type);  /* is it a shape type we know? */
+char *parttype(int type);    /* translate multipatch part type */
+void putrecord(Dump *d, const ShpRecord *rec);  /* as text or -f */
+const ShpRecord *simplified(Dump *d, const ShpRecord *rec, ShpRecord *copy);
+const ShpRecord *clipped(Dump *d, const ShpRecord *rec, ShpRecord *copy);
+int dumptiles(Dump *d, int type);  /* for -z, return exit code */
+
+void checkrecord(Dump *d, unsigned long at, Integer recnum, Integer reclen);
+void checkparts(Dump *d, const Integer *parts, Integer nparts, Integer npoints);
+void checkshape(Dump *d, const ShpRecord *rec);  /* for -k */
+static void badshape(void *arg, int problem, Integer part, Integer other);
+void putsummary(Dump *d);  /* for -c */
+void putstats(Dump *d);    /* for -t, to stderr */
+void progress(Dump *d);    /* same, every STATSEVERY seconds */
+void statsmerge(Stats *stats, const Stats *other);
+static int bucket(Integer n);
+static const char *bucketname(int k);
+double now(void);          /* seconds, monotonic */
+void badread(Dump *d);  /* die on what the reader failed with */
+
+void putint(Dump *d, const char *label, Integer value);
+void putname(Dump *d, const char *label, const char *name);
+void putrange(Dump *d, const char *label, Double min, Double max);
+void putbbox(Dump *d, Double xmin, Double ymin, Double xmax, Double ymax);
+void putpoint(Dump *d, Double xcoord, Double ycoord, int gflag);
+void putpointz(Dump *d, Double x, Double y, Double z, int gflag);
+void putpointm(Dump *d, Double x, Double y, Double m, int gflag);
+void putpointzm(Dump *d, Double x, Double y, Double z, Double m, int gflag);
+void putshape(Dump *d, Integer id, const WkbShape *s, Integer *owner);
+void putwkb(Dump *d, Integer id, const WkbShape *s, Integer *owner);
+void putarrow(const void *buf, size_t len);
+void putattrs(Dump *d);  /* -a columns of the record, as lines */
+void opendbf(const char *filename, char *list);  /* select -a columns */
+void endarrow(Dump *d);
+
+typedef struct { long first, last; } Range;  /* of record numbers */
+int addranges(const char *spec);  /* parse list like 1,5,10-20,30- */
+void addrange(long first, long last);
+int getbox(BoundingBox *box, const char *spec);  /* parse xmin,ymin,xmax,ymax */
+int gettiles(const char *spec);  /* parse zoom level or width,height */
+char *slurp(const char *filename);  /* read file into a string */
 
 void bboxinit(BoundingBox *bbox);  /* make empty bbox */
 void bboxadd(BoundingBox *bbox, Double xcoord, Double ycoord);
+void bboxmerge(BoundingBox *bbox, const BoundingBox *other);
 int bboxok(BoundingBox *, Double xmin, Double ymin, Double xmax, Double ymax);
+
+/* With -t, add the time since the last lap to the given phase */
+#define LAP(d, phase) do { if (statsflag) { double t_ = now(); \
+	(d)->stats.phase += t_ - (d)->stats.last; (d)->stats.last = t_; } } while (0)
+#ifndef STATSEVERY
+#define STATSEVERY 10  /* seconds between progress reports */
+#endif
 #define bboxok(bb, minx, miny, maxx, maxy) \
 	((bb)->xmin == (minx) && (bb)->ymin == (miny) && \
 	 (bb)->xmax == (maxx) && (bb)->ymax == (maxy))
 
 /* I/O helpers: put... to stdout, log... to stderr */
 #define setin(s) ((freopen((s), "rb", stdin) == NULL) ? -1 : 0)
-#define getbyte() getchar()
-#define putstr(s) fputs(s, stdout)
+#define OUTBUFSIZE (1024*1024)
+static void putf(Dump *d, const char *fmt, ...);
+static void putstr(Dump *d, const char *s);
+static void putlong(Dump *d, long value);
+static void putbuf(Dump *d, const char *s, size_t len);
+static char *putroom(Dump *d, size_t len);
+static void putflush(Dump *d);
 static void logstr(const char *s);
 static void logline(const char *s);
 static void logbuf(const char *s, size_t len);
@@ -88,366 +264,1579 @@ static int shipout(FILE *fp, const char *buf, size_t len);
 
 /* Reporting the unexpected */
 void die(int code, const char *info);
-void warn(const char *info);
+void fail(Dump *d, int code, const char *info);  /* die or abort worker */
+void warn(Dump *d, const char *info);
 #define usage(x) do { logline(usage); errno=0; die(FAILHARD, (x)); } while (0)
 
-int endian;
-int vflag=0, gflag=0, hflag=0, xflag=0, prec=2;
-unsigned long length, tally;  /* in 16-bit words */
-unsigned long warnings=0;
-BoundingBox headerbbox, actualbbox;
+static const char optstring[] = "a:b:cCe:f:gGhHiIj:kKl:o:p:r:sStTvVxXz:";
+int endian;  /* for -vv */
+int vflag=0, gflag=0, hflag=0, xflag=0, bflag=0, sflag=0, cflag=0;
+int prec=2, jobs=1;
+int kflag=0;  /* -k check the geometry of lines and rings */
+int iflag=0;  /* -i rebuild the .shx, -ii fix the .shp header too */
+Double tolerance=0;  /* -e simplify lines and rings for output */
+int zoom=-1;  /* -z tiles: of the extent at this zoom level, */
+Double gridw=0, gridh=0;  /* or of a grid of this size */
+#define TILING ((zoom >= 0) || (gridw > 0))
+char *laddr=0;  /* -l address to serve requests on */
+int workers=4;  /* at a time, -j with -l or a batch */
+char *odir=0;  /* -o directory for the output of a batch */
+int inrequest=0;  /* options of a request to the server (-l) */
+int fflag=0;  /* -f output format: */
+#define FORMAT_TEXT 0
+#define FORMAT_WKB 1  /* length-prefixed WKB */
+#define FORMAT_HEX 2  /* hex WKB, one line per record */
+#define FORMAT_ARROW 3  /* Arrow IPC file, see arrow.h */
+char *attrs=0;  /* -a columns, comma separated */
+int nattrs=0;
+long dbfcount=0;  /* records in the .dbf */
+int tflag=0;  /* -b shapes selected via spatial index */
+int statsflag=0;  /* -t timings and counts to stderr */
+double started, reported;  /* for -t */
+long idxcount=0;  /* records in the .shx, if -c compares with it */
+unsigned long length;  /* in 16-bit words */
+BoundingBox headerbbox;
+ShpReader *reader;  /* of stdin */
+Dump top;     /* the main thread's dump, output to stdout */
+Range *ranges = 0;   /* records selected with -r */
+size_t nranges = 0;
+BoundingBox window;  /* selected with -b */
 
 int main(int argc, char *argv[])
+{
+  int n;
+
+  setvbuf(stdout, NULL, _IONBF, 0);  /* we buffer ourselves */
+
+  n = options(argc, argv);
+  if (laddr) {  /* serve until killed */
+  	if (n < argc) usage("no shapefile with -l");
+  	if (serve(laddr, workers, "shpdump", optstring, request) < 0)
+  		die(FAILSOFT, laddr);
+  }
+  if (TILING) {  /* of one shapefile */
+  	if ((argc - n > 1) || ((n < argc) && batchable(argv[n])))
+  		usage("one shapefile with -z");
+  	return dump(argc - n, argv + n);
+  }
+  if (odir || (argc - n > 1) || ((n < argc) && batchable(argv[n]))) {
+  	if (n == argc) usage("no shapefile with -o");
+  	jobs = 1;  /* files at a time instead */
+  	if ((n = batch(argc - n, argv + n, workers, odir, suffix(), dump)) < 0) {
+  		struct stat st;
+  		if (odir && !((stat(odir, &st) == 0) && S_ISDIR(st.st_mode)))
+  			die(FAILHARD, odir);  /* ENOTDIR from batch() if it's there */
+  		die((errno == ENOENT) ? FAILHARD : FAILSOFT, "cannot run batch");
+  	}
+  	return n;
+  }
+  return dump(argc - n, argv + n);
+}
+
+/* Parse the options into the flags; return the index of
+ * the first argument after them */
+int options(int argc, char *argv[])
 {
   extern int optind, opterr;
   extern char *optarg;
-  int c, type; /* of shapefile */
+  int c;
 
   opterr = 0;
-  while ((c=getopt(argc, argv, "gGhHp:vVxX")) > 0) switch (c) {
+  while ((c=getopt(argc, argv, optstring)) > 0) switch (c) {
+  	case 'a': attrs = optarg; break;
+  	case 'b': if (getbox(&window, optarg) < 0) usage("invalid box");
+  	          bflag = 1; break;
+  	case 'c': cflag = 1; break;  /* check only */
+  	case 'C': cflag = 0; break;
+  	case 'e': tolerance = atof(optarg);  /* simplify */
+  	          if (!(tolerance >= 0)) usage("invalid tolerance");
+  	          break;
+  	case 'f': if (!strcmp(optarg, "text")) fflag = FORMAT_TEXT;
+  	          else if (!strcmp(optarg, "wkb")) fflag = FORMAT_WKB;
+  	          else if (!strcmp(optarg, "hex")) fflag = FORMAT_HEX;
+  	          else if (!strcmp(optarg, "arrow")) fflag = FORMAT_ARROW;
+  	          else usage("invalid format");
+  	          break;
   	case 'g': gflag = 1; break;  /* GENERATE format */
   	case 'G': gflag = 0; break;
   	case 'h': hflag = 1; break;  /* header only */
   	case 'H': hflag = 0; break;
+  	case 'i': iflag += 1; break;  /* rebuild index */
+  	case 'I': iflag = 0; break;
   	case 'x': xflag = 1; break;  /* report inconsistencies */
   	case 'X': xflag = 0; break;
+  	case 'k': kflag = 1; break;  /* check geometry */
+  	case 'K': kflag = 0; break;
+  	case 'j': jobs = atoi(optarg); if (jobs < 1) jobs = 1;
+  	          workers = jobs; break;
+  	case 'l': laddr = optarg; break;  /* serve requests */
+  	case 'o': odir = optarg; break;  /* batch output files */
   	case 'p': prec = atoi(optarg); if (prec < 0) prec = 0; break;
+  	case 'r': if (*optarg == '@') {  /* records from file */
+  	            char *list;
+  	            if (inrequest) usage("no -r @file in a request");
+  	            list = slurp(optarg+1);
+  	            if (addranges(list) < 0) usage("invalid record list");
+  	            free(list);
+  	          }
+  	          else if (addranges(optarg) < 0) usage("invalid record list");
+  	          break;
+  	case 's': sflag = 1; break;  /* build spatial index */
+  	case 'S': sflag = 0; break;
+  	case 't': statsflag = 1; break;  /* stats */
+  	case 'T': statsflag = 0; break;
   	case 'v': vflag += 1; break;  /* verbose */
-  	case 'V': putstr(id); return 0;
+  	case 'z': if (gettiles(optarg) < 0) usage("invalid tiles"); break;
+  	case 'V': putstr(&top, id); putflush(&top); exit(0);
   	default:  usage("invalid option");
   }
-  argc -= optind;
-  argv += optind;
+  return optind;
+}
+
+/* Output files of a batch are named by the format */
+const char *suffix(void)
+{
+  switch (fflag) {
+  	case FORMAT_WKB: return ".wkb";
+  	case FORMAT_HEX: return ".hex";
+  	case FORMAT_ARROW: return ".arrow";
+  }
+  return gflag ? ".gen" : ".txt";
+}
+
+/* A request to the server (-l), in a process of its own: its
+ * options go on top of those the server was started with, but
+ * for those that write files or read any but the shapefile */
+int request(int argc, char *argv[])
+{
+  int n;
+
+  laddr = 0;
+  odir = 0;
+  iflag = sflag = 0;
+  jobs = 1;
+  inrequest = 1;
+  n = options(argc, argv);
+  if (laddr) usage("no -l in a request");
+  if (odir) usage("no -o in a request");
+  if (iflag) usage("no -i in a request");
+  if (sflag) usage("no -s in a request");
+  return dump(argc - n, argv + n);
+}
+
+/* Dump the shapefile named in argv, or stdin */
+int dump(int argc, char *argv[])
+{
+  int c, type; /* of shapefile */
+  long count = 0; /* of records in index */
+  char buf[256];
+  const char *filename = 0;
+  const void *m = 0;
+  size_t size;
+  Dump *d = &top;
+
+  if (cflag) xflag = d->quiet = 1;
+  if (kflag) xflag = 1;
+  if (fflag) gflag = 0, d->quiet = 1;  /* no text, not even the header */
+  if (fflag == FORMAT_ARROW) jobs = 1;  /* one writer, in record order */
+  if (TILING && (cflag || iflag || sflag || (nranges > 0)))
+  	usage("no -c, -i, -r or -s with -z");
+  if (TILING && (fflag == FORMAT_ARROW)) usage("no Arrow tiles");
 
   assert(sizeof(Integer) == 4);
   assert(sizeof(Double) == 8);
+  assert(sizeof(Point) == 2*sizeof(Double));
+  if (statsflag) started = reported = d->stats.last = now();
 
   if (argc > 1) usage("too many arguments");
   if (argc > 0 && *argv) {
-    char buf[256];
-    const char *filename;
-  	const char *p = strrchr(*argv, '/');
-  	const char *q = strrchr(*argv, '.');
-  	if (!q || (p && (q < p))) { /* append suffix */
-  		size_t len = strlen(*argv);
-  		if (len > sizeof(buf) - 5) die(FAILHARD, "filename too long");
-  		strcpy(buf, *argv); strcpy(buf+len, ".shp");
-      filename = buf;
-  	}
-  	else filename = *argv;
-  	if (setin(filename) < 0) die(FAILHARD, filename);
-  	if (vflag > 1) putname("filename", filename);
+  	if ((filename = shpname(buf, sizeof buf, *argv)) == NULL)
+  		die(FAILHARD, "filename too long");
+  	m = servemap(filename, &size);  /* kept open by the server (-l)? */
+  	if (!m && (setin(filename) < 0)) die(FAILHARD, filename);
+  	if (vflag > 1) putname(d, "filename", filename);
   }
+  if (attrs) opendbf(filename, attrs);
+  if (gflag && nattrs) usage("no attributes in GENERATE format");
 
   endian = getendian();
   switch (endian) { char *p;  /* weird but legal */
   	case ENDIAN_LITTLE: p = "little"; goto goon;
   	case ENDIAN_BIG: p = "big"; goto goon;
   	default: die(FAILHARD, "unknown machine byte order");
-  	goon: if (vflag > 1) putname("endian", p);
+  	goon: if (vflag > 1) putname(d, "endian", p);
   }
 
-  type = header();
-  if (hflag) return 0; /* header only */
-  bboxinit(&actualbbox);
-  switch (type) {
-  	case SHP_TYPE_NULL:
-  	case SHP_TYPE_POINT:
-  	case SHP_TYPE_POLYLINE:
-  	case SHP_TYPE_POLYGON:
-  	case SHP_TYPE_POLYLINEZ:
-  		break;
-  	default: warn("type not supported, just scanning");
+  reader = m ? shprmem(m, size) : shpropen(fileno(stdin));
+  if (reader == NULL) die(FAILSOFT, "cannot read input");
+  d->in = reader;
+  if (sflag) { buildtree(d, filename); return 0; }
+  if (iflag) return buildindex(d, filename);
+  if (nranges > 0) count = openindex(filename);
+  else if (bflag && !xflag && !TILING && filename && usetree(filename)) {
+  	tflag = 1;
+  	count = openindex(filename);
+  }
+  else if (filename && (cflag || ((jobs > 1) && shprmapped(reader)))) {
+  	count = tryindex(filename);
+  	if (cflag) idxcount = count;
   }
 
-  while (tally < length) {
-    int shape = dumpshape();
-  	if (xflag && (shape != type) && (shape != SHP_TYPE_NULL))
-  		warn("unexpected shape type");
+  if (TILING && !hflag) d->quiet = 1;  /* each tile has its own */
+  type = header(d);
+  if (hflag) { putflush(d); putstats(d); return 0; } /* header only */
+  if (TILING) return dumptiles(d, type);
+  if (fflag && !cflag) d->quiet = 0;
+  bboxinit(&d->bbox);
+  if (!shpvalidtype(type))
+  	warn(d, "type not supported, just scanning");
+  if ((fflag == FORMAT_ARROW) && !cflag) {
+  	const char *names[256];
+  	for (c = 0; c < nattrs; c++) names[c] = dbfcolumn(c);
+  	if (arrowopen(type, names, nattrs, putarrow) < 0)
+  		die(FAILHARD, "no Arrow encoding for this shape type");
   }
-  if (gflag) printf("END\n");  /* last line in GENERATE file */
-  if (xflag) {
-  	if (tally != length) warn("inconsistent file");
-  	if (!bboxok(&headerbbox, actualbbox.xmin, actualbbox.ymin,
-  	                         actualbbox.xmax, actualbbox.ymax))
-  		warn("invalid global bounding box (xrange/yrange)");
+
+  if ((nranges > 0) || tflag) {
+  	dumpranges(d, count, type);
+  	if (gflag) putf(d, "END\n");
+  	endarrow(d);
+  	dbfclose();
+  	if (cflag) putsummary(d);
+  	putflush(d);
+  	putstats(d);
+  	return (xflag && d->warnings > 0) ? 1 : 0;
   }
 
-  return (xflag && warnings > 0) ? 1 : 0;
+  if ((count > 0) && (jobs > 1) && shprmapped(reader))
+  	(void) dumpparallel(d, count, type);
+  else if ((jobs > 1) && !shprmapped(reader))
+  	(void) dumpstream(d, type);
+  while (d->tally < length) dumpnext(d, type);
+  if (gflag) putf(d, "END\n");  /* last line in GENERATE file */
+  if (xflag) {
+  	if (d->tally != length) warn(d, "inconsistent file");
+  	if (!bflag && !bboxok(&headerbbox, d->bbox.xmin, d->bbox.ymin,
+  	                         d->bbox.xmax, d->bbox.ymax))
+  		warn(d, "invalid global bounding box (xrange/yrange)");
+  }
+  if (idxcount && ((unsigned long) idxcount != d->records)) {
+  	char msg[NOTELEN];
+  	sprintf(msg, "index file has %ld records, shapefile %lu",
+  	        idxcount, d->records);
+  	warn(d, msg);
+  }
+  if (xflag && nattrs && ((unsigned long) dbfcount != d->records)) {
+  	char msg[NOTELEN];
+  	sprintf(msg, "dBase file has %ld records, shapefile %lu",
+  	        dbfcount, d->records);
+  	warn(d, msg);
+  }
+  idxclose();
+
+  endarrow(d);
+  dbfclose();
+  if (cflag) putsummary(d);
+  putflush(d);
+  putstats(d);
+  return (xflag && d->warnings > 0) ? 1 : 0;
 }
 
-int header(void)
+int header(Dump *d)
 {
+  ShpHeader h;
   Integer magic, version, type;
   Double minX, maxX, minY, maxY, minZ, maxZ, minM, maxM;
   int vngflag = (vflag && !gflag);
 
-  magic = getintbig();
-  (void) getintbig();  /* unused */
-  (void) getintbig();  /* unused */
-  (void) getintbig();  /* unused */
-  (void) getintbig();  /* unused */
-  (void) getintbig();  /* unused */
-  length = getintbig();
-  version = getint();
-  type = getint();
-  minX = getdouble();  headerbbox.xmin = minX;
-  minY = getdouble();  headerbbox.ymin = minY;
-  maxX = getdouble();  headerbbox.xmax = maxX;
-  maxY = getdouble();  headerbbox.ymax = maxY;
-  minZ = getdouble();
-  maxZ = getdouble();
-  minM = getdouble();
-  maxM = getdouble();
+  if (shprheader(d->in, &h) < 0) badread(d);
+  magic = h.magic;
+  length = h.length;
+  version = h.version;
+  type = h.type;
+  minX = h.bbox.xmin;  headerbbox.xmin = minX;
+  minY = h.bbox.ymin;  headerbbox.ymin = minY;
+  maxX = h.bbox.xmax;  headerbbox.xmax = maxX;
+  maxY = h.bbox.ymax;  headerbbox.ymax = maxY;
+  minZ = h.zmin;
+  maxZ = h.zmax;
+  minM = h.mmin;
+  maxM = h.mmax;
 
-  if (vngflag) putint("magic", magic);
-  if (xflag && (magic != SHP_MAGIC)) warn("invalid file code");
+  if (vngflag) putint(d, "magic", magic);
+  if (xflag && (magic != SHP_MAGIC)) warn(d, "invalid file code");
 
-  if (vngflag) putint("version", version);
-  if (xflag && (version != 1000)) warn("unknown file version");
+  if (vngflag) putint(d, "version", version);
+  if (xflag && (version != 1000)) warn(d, "unknown file version");
 
-  if (vngflag) putint("length", length*2); /* in bytes */
+  if (vngflag) putint(d, "length", length*2); /* in bytes */
 
-  if (!gflag) putname("type", shptype(type));
+  if (!gflag) putname(d, "type", shptype(type));
 
-  if (vngflag) putrange("xrange", minX, maxX);
-  if (xflag && (minX > maxX)) warn("global xrange has min > max");
+  if (vngflag) putrange(d, "xrange", minX, maxX);
+  if (xflag && (minX > maxX)) warn(d, "global xrange has min > max");
 
-  if (vngflag) putrange("yrange", minY, maxY);
-  if (xflag && (minY > maxY)) warn("global yrange has min > max");
+  if (vngflag) putrange(d, "yrange", minY, maxY);
+  if (xflag && (minY > maxY)) warn(d, "global yrange has min > max");
 
   switch (type) {
     case 11: case 13: case 15: case 18: /* shapes in XYZ space with M */
-  	if (vngflag) putrange("zrange", minZ, maxZ);
-  	if (xflag && (minZ > maxZ)) warn("global zrange has min > max");
+    case 31:
+  	if (vngflag) putrange(d, "zrange", minZ, maxZ);
+  	if (xflag && (minZ > maxZ)) warn(d, "global zrange has min > max");
   	/* FALLTHRU */
     case 21: case 23: case 25: case 28: /* measured shapes in XY space */
-  	if (vngflag) putrange("mrange", minM, maxM);
-  	if (xflag && (minM > maxM)) warn("global mrange has min > max");
+  	if (vngflag) putrange(d, "mrange", minM, maxM);
+  	if (xflag && (minM > maxM)) warn(d, "global mrange has min > max");
   	break;
   }
 
-  tally = 100/2;  /* number of 16-bit words handled */
+  d->tally = 100/2;  /* number of 16-bit words handled */
+  d->recno = 1;
   return (int) type;
 }
 
-int dumpshape(void)
+int dumpshape(Dump *d)
 {
-  Integer recnum = getintbig();  /* record number */
-  Integer reclen = getintbig();  /* record length in 16-bit words */
-  Integer type = getint();  /* record type, 0=Null, 1=Point, etc */
+  ShpRecord rec, copy, cut;
+  const ShpRecord *out;
+  Integer reclen;
+
+  LAP(d, other);
+  if (shprhead(d->in, &rec) < 0) badread(d);
+  d->tally += 4;  /* record header size in words */
+  d->tally += rec.length;  /* record contents in words */
+  d->records++;
+  if (statsflag)
+  	d->stats.types[((rec.type >= 0) && (rec.type < NTYPES)) ? rec.type : NTYPES]++;
+  if (cflag) checkrecord(d, rec.offset, rec.id, rec.length);
+
+  reclen = rec.length*2;  /* convert to bytes */
+  reclen -= sizeof(Integer);  /* type already read */
 
-  tally += 4;  /* record header size in words */
-  tally += reclen;  /* record contents in words */
+  if (bflag) {
+  	if (shprbbox(d->in, &rec) < 0) badread(d);
+  	if (outside(&rec)) {  /* its .dbf row too */
+  		if (shprskip(d->in, &rec) < 0) badread(d);
+  		d->recno++;
+  		LAP(d, read);
+  		return rec.type;
+  	}
+  }
+  LAP(d, read);
+
+  if (!fflag && !shpvalidtype(rec.type))
+  	putf(d, "shape "FINT" type "FINT" bytes "FINT"\n", rec.id, rec.type, reclen);
+  if (shprdecode(d->in, &rec) < 0) badread(d);
+  if (cflag && rec.parts) checkparts(d, rec.parts, rec.nparts, rec.npoints);
+  LAP(d, decode);
+  out = (tolerance > 0) ? simplified(d, &rec, &copy) : &rec;
+  if (d->tiled) out = clipped(d, out, &cut);
+  if (out) putrecord(d, out);
+  LAP(d, format);
+  switch (rec.type) {
+  	case SHP_TYPE_NULL: break;
+  	case SHP_TYPE_POINT: case SHP_TYPE_POINTZ: case SHP_TYPE_POINTM:
+  		bboxadd(&d->bbox, rec.points[0].x, rec.points[0].y);
+  		break;
+  	default:
+  		if (!shpvalidtype(rec.type)) break;
+  		if (xflag && !bboxok(&rec.extent, rec.bbox.xmin, rec.bbox.ymin,
+  		                     rec.bbox.xmax, rec.bbox.ymax))
+  			warn(d, "invalid bbox");
+  		bboxadd(&d->bbox, rec.extent.xmin, rec.extent.ymin);
+  		bboxadd(&d->bbox, rec.extent.xmax, rec.extent.ymax);
+  }
+  if (cflag && (rec.used != (unsigned long) reclen))
+  	warn(d, "record length does not match contents");
+  if (kflag) checkshape(d, &rec);
+  LAP(d, bbox);
+  if (nattrs && !fflag && !d->quiet && out) putattrs(d);
+  if (statsflag) {
+  	LAP(d, format);
+  	d->stats.parts[bucket(rec.nparts)]++;
+  	d->stats.points[bucket(rec.npoints)]++;
+  }
 
-  reclen *= 2;  /* convert to bytes */
-  reclen -= sizeof(Integer);  /* type already read */
+  d->recno++;
+  return rec.type;
+}
 
-  switch (type) {
-  	case SHP_TYPE_NULL: printf("null " FINT "\n", recnum); break;
-  	case SHP_TYPE_POINT: dumppoint(recnum); break;
-  	case SHP_TYPE_POLYLINE: dumpline(recnum); break;
-  	case SHP_TYPE_POLYGON: dumppolygon(recnum); break;
-  	case SHP_TYPE_POLYLINEZ: dumplinez(recnum); break;
-  	default: printf("shape "FINT" type "FINT" bytes "FINT"\n", recnum, type, reclen);
-  	         while (--reclen > 0) (void) getbyte(); /* skip record */
+void dumpnext(Dump *d, int type)
+{
+  int shape = dumpshape(d);
+
+  if (xflag && (shape != type) && (shape != SHP_TYPE_NULL))
+  	warn(d, "unexpected shape type");
+  if (statsflag && !d->keep) progress(d);
+}
+
+/* Filter for -b, by where shprbbox() says the shape is: null
+ * shapes are nowhere, those it can't tell go through; written
+ * so that NaNs are outside */
+int outside(const ShpRecord *rec)
+{
+  const BoundingBox *b = &rec->bbox;
+
+  switch (rec->where) {
+  	case -1: return 1;
+  	case 0: return 0;
   }
+  return !((b->xmin <= window.xmax) && (b->xmax >= window.xmin) &&
+           (b->ymin <= window.ymax) && (b->ymax >= window.ymin));
+}
 
-  return type;
+long openindex(const char *filename)
+{
+  char name[256];
+  long count;
+
+  if (!filename) usage("need a shapefile to select records");
+  if (!idxname(name, sizeof name, filename)) die(FAILHARD, "filename too long");
+  if ((count = mapindex(name)) < 0) {
+  	if (errno) die(FAILHARD, name);
+  	die(FAILHARD, "invalid index file");
+  }
+  return count;
 }
 
-void dumppoint(Integer id)
+/* Like openindex() but quietly return 0 if there's no usable index */
+long tryindex(const char *filename)
 {
-  Double xcoord = getdouble();
-  Double ycoord = getdouble();
+  char name[256];
+  long count;
 
-  if (gflag) printf(FINT",", id);
-  else printf("point "FINT, id);
-  putpoint(xcoord, ycoord, gflag);
-  bboxadd(&actualbbox, xcoord, ycoord);
+  if (!idxname(name, sizeof name, filename)) return 0;
+  if ((count = mapindex(name)) < 0) return 0;
+  return count;
 }
 
-void dumpline(Integer id)
+long mapindex(const char *name)
 {
-  BoundingBox bbox;
-  Double xmin, xmax;
-  Double ymin, ymax;
-  Integer nparts, npoints;
-  Integer *parts;
-  Point *points;
-  Integer i, j;
+  const void *m;
+  size_t size;
+
+  if ((m = servemap(name, &size)) != NULL) return idxmem(m, size);
+  return idxopen(name);
+}
+
+/* Map the .dbf and select the columns in list (-a); the rows go
+ * by record position, so -b and -r skip the others for free */
+void opendbf(const char *filename, char *list)
+{
+  char name[256], msg[NOTELEN];
+  char *p;
+
+  if (!filename) usage("need a shapefile to read attributes");
+  if (!dbfname(name, sizeof name, filename)) die(FAILHARD, "filename too long");
+  if ((dbfcount = dbfopen(name)) < 0) {
+  	if (errno) die(FAILHARD, name);
+  	die(FAILHARD, "invalid dBase file");
+  }
+  for (p = strtok(list, ","); p; p = strtok(0, ",")) {
+  	if (nattrs == 256) usage("too many columns");
+  	if (dbfselect(p) < 0) {
+  		sprintf(msg, "no such column: %.40s", p);
+  		usage(msg);
+  	}
+  	nattrs++;
+  }
+}
+
+/* Dump the records selected with -r, in the order given,
+ * seeking to each through the offsets in the index file.
+ * The global checks of -x make no sense for a selection.
+ */
+void dumpranges(Dump *d, long count, int type)
+{
+  long n;
+  unsigned long offset;
+  size_t i;
+
+  for (i = 0; i < nranges; i++) {
+  	for (n = ranges[i].first; (n <= ranges[i].last) && (n <= count); n++) {
+  		(void) idxrecord(n, &offset, 0);
+  		if (shprseek(d->in, offset) < 0) {
+  			if (errno) die(FAILSOFT, "cannot seek in input");
+  			die(FAILHARD, "invalid offset in index file");
+  		}
+  		d->recno = n;
+  		dumpnext(d, type);
+  	}
+  	if ((n <= ranges[i].last) && (ranges[i].last < LONG_MAX)) {
+  		char msg[64];
+  		sprintf(msg, "no such record: %ld", n);
+  		warn(d, msg);
+  	}
+  }
 
-  xmin = getdouble();
-  ymin = getdouble();
-  xmax = getdouble();
-  ymax = getdouble();
+  idxclose();
+}
+
+/* The spatial index (-s) holds the extent of each shape as
+ * shprbbox() sees it, and is stamped with the size and mtime of
+ * the .shp and .shx. If it's up to date, -b takes the shapes it
+ * finds as if they were selected with -r; they still go through
+ * outside(), so the output is the same as without it. For this
+ * to hold, the .shx must list exactly the records in the .shp,
+ * in order, which we check when building.
+ */
 
-  nparts = getint();
-  npoints = getint();
+static int getstamps(const char *filename, RtStamp *stamps)
+{
+  char name[256];
+
+  if (rtstamp(&stamps[0], filename) < 0) return -1;
+  if (!idxname(name, sizeof name, filename)) return -1;
+  return rtstamp(&stamps[1], name);
+}
 
-  parts = (Integer *) calloc(nparts, sizeof(Integer));
-  if (parts == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < nparts; i++) parts[i] = getint();
+void buildtree(Dump *d, const char *filename)
+{
+  char name[256];
+  RtStamp stamps[2];
+  RtEntry *entries, *e;
+  ShpHeader h;
+  ShpRecord rec;
+  unsigned long offset, next, end;
+  long count = openindex(filename), n = 0, r;
+
+  if (shprheader(d->in, &h) < 0) badread(d);
+  end = h.length * 2UL;
+  next = 100;
+  entries = (RtEntry *) malloc((count+1) * sizeof(RtEntry));
+  if (entries == NULL) die(FAILSOFT, "out of memory");
+  for (r = 1; r <= count; r++) {
+  	(void) idxrecord(r, &offset, 0);
+  	if (offset != next) break;
+  	if (shprseek(d->in, offset) < 0) {
+  		if (errno) die(FAILSOFT, "cannot seek in input");
+  		die(FAILHARD, "invalid offset in index file");
+  	}
+  	if ((shprhead(d->in, &rec) < 0) || (shprbbox(d->in, &rec) < 0))
+  		badread(d);
+  	next = offset + 8 + rec.length * 2UL;
+  	e = &entries[n];
+  	e->bbox = rec.bbox;
+  	switch (rec.where) {
+  		case -1: continue;  /* nowhere */
+  		case 0: e->bbox.xmin = e->bbox.ymin = -HUGE_VAL;  /* everywhere */
+  		        e->bbox.xmax = e->bbox.ymax = HUGE_VAL;
+  	}
+  	e->recno = r;
+  	n++;
+  }
+  idxclose();
+  if ((r <= count) || (next != end)) {
+  	errno = 0;
+  	die(FAILHARD, "index file does not match shapefile");
+  }
 
-  points = (Point *) calloc(npoints, sizeof(Point));
-  if (points == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < npoints; i++) points[i] = getpoint();
+  if (getstamps(filename, stamps) < 0) die(FAILSOFT, filename);
+  if (!sidename(name, sizeof name, filename, RTREE_SUFFIX))
+  	die(FAILHARD, "filename too long");
+  if (rtbuild(name, entries, n, stamps, 2) < 0) die(FAILSOFT, name);
+  free(entries);
+}
 
+/* Write the index file (.shx) anew, going by the records of the
+ * shapefile alone (their heads; bboxes too for -ii), in one pass,
+ * up to the last complete one. With -ii, its header and that of
+ * the shapefile get the actual length and bbox; else the index
+ * has the header of the shapefile as it is, but for its length.
+ */
+int buildindex(Dump *d, const char *filename)
+{
+  char name[256], msg[NOTELEN];
+  ShpHeader h;
+  ShpRecord rec;
+  MainHeader mh;
+  BoundingBox bbox;
+  unsigned long next = 100;
+  const char *why = 0;
+  size_t len;
+  int more = 0;
+
+  if (!filename) usage("no shapefile with -i");
+  len = strlen(filename);
+  if ((iflag > 1) && (len > 3) && !strcmp(filename + len - 3, ".gz"))
+  	usage("cannot fix the header of a compressed shapefile");
+  if (!idxname(name, sizeof name, filename)) die(FAILHARD, "filename too long");
+  if (shprheader(d->in, &h) < 0) badread(d);
+  if (xflag && (h.magic != SHP_MAGIC)) warn(d, "invalid file code");
+  if (idxcreate(name) < 0) die(FAILSOFT, name);
   bboxinit(&bbox);
-  if (gflag) printf(FINT"\n", id);
-  else printf("line "FINT" parts "FINT" points "FINT"\n", id, nparts, npoints);
+  d->recno = 1;
+  while ((more = shprmore(d->in)) > 0) {
+  	errno = 0;
+  	why = "incomplete record";
+  	if ((shprhead(d->in, &rec) < 0) ||
+  	    ((rec.length < 2) && (why = "invalid record length")) ||
+  	    ((iflag > 1) && (shprbbox(d->in, &rec) < 0)) ||
+  	    (shprskip(d->in, &rec) < 0))
+  		break;
+  	if (idxput(rec.offset, rec.length*2UL) < 0) {
+  		(void) idxfinish(0);
+  		if (!errno) die(FAILHARD, "shapefile too large for an index");
+  		die(FAILSOFT, name);
+  	}
+  	if (xflag && (rec.id != d->recno)) warn(d, "unexpected record number");
+  	if (rec.where > 0) {
+  		bboxadd(&bbox, rec.bbox.xmin, rec.bbox.ymin);
+  		bboxadd(&bbox, rec.bbox.xmax, rec.bbox.ymax);
+  	}
+  	next = shprtell(d->in);
+  	d->recno++;
+  	d->records++;
+  }
+  if (more && errno) {
+  	(void) idxfinish(0);
+  	badread(d);
+  }
+  if (more) {
+  	sprintf(msg, "index ends at record %ld, offset %lu: %s", d->recno - 1,
+  	        next, why);
+  	warn(d, msg);
+  }
+  if (bbox.xmin > bbox.xmax) bbox.xmin = bbox.ymin = bbox.xmax = bbox.ymax = 0;
+
+  mh.fileCode = SHP_MAGIC;
+  mh.fileLength = (Integer) (next/2);
+  mh.version = 1000;
+  mh.shapeType = h.type;
+  mh.bbox = (iflag > 1) ? bbox : h.bbox;
+  mh.zmin = h.zmin; mh.zmax = h.zmax;
+  mh.mmin = h.mmin; mh.mmax = h.mmax;
+  if (idxfinish(&mh) < 0) {
+  	if (!errno) die(FAILHARD, "shapefile too large for an index");
+  	die(FAILSOFT, name);
+  }
+  if ((iflag > 1) && (idxheader(filename, &mh) < 0)) die(FAILSOFT, filename);
+  putflush(d);
+  return (xflag && d->warnings > 0) ? 1 : 0;
+}
 
-  for (i = 0, j = 1; i < npoints; i++) {
-  	if ((j < nparts) && (i == parts[j])) { ++j;
-  		printf("part\n");
+int usetree(const char *filename)
+{
+  char name[256];
+  RtStamp stamps[2];
+  long *found, n, i;
+
+  if (getstamps(filename, stamps) < 0) return 0;
+  if (!sidename(name, sizeof name, filename, RTREE_SUFFIX)) return 0;
+  if (rtopen(name, stamps, 2) < 0) return 0;
+  n = rtsearch(&window, &found);
+  rtclose();
+  if (n < 0) die(FAILSOFT, "out of memory");
+  for (i = 0; i < n; i++) {
+  	if ((nranges > 0) && (ranges[nranges-1].last + 1 == found[i]))
+  		ranges[nranges-1].last++;
+  	else addrange(found[i], found[i]);
+  }
+  if (n > 0) free(found);
+  return 1;
+}
+
+/* Parallel dump (-j): the index tells where records start, so
+ * the input is cut into chunks of about CHUNKSIZE bytes at record
+ * boundaries. Worker threads dump chunks into memory, each with
+ * its own Dump and its own cursor into the mapped input, and the
+ * main thread writes them out in order, warnings included.
+ *
+ * A chunk is dumped exactly like the sequential loop would do it.
+ * If a chunk does not end where the next one starts (index and
+ * records disagree), the chunks after it are dropped and the dump
+ * goes on sequentially from there: the output is always the same
+ * as without -j.
+ *
+ * Without an index or a mapping (a pipe, stdin, gzip input), the
+ * main thread cuts the input as it comes into blocks of whole
+ * records, by their lengths, and the workers dump them from there;
+ * see dumpstream(). Input is read ahead by the Input block reads
+ * (and the inflater thread), records are decoded and formatted
+ * by the workers, and output is written by the main thread.
+ */
+
+#ifndef CHUNKSIZE
+#define CHUNKSIZE (4*1024*1024)  /* bytes of input per chunk */
+#endif
+#define MAXJOBS 256
+
+typedef struct {           /* a record in a tile, for -z */
+  long x, y;                 /* the tile's column and row */
+  unsigned long offset;      /* of the record */
+  long recno;
+  int first;                 /* the record's first tile, with its warnings */
+  size_t end;                /* of the tile's output, if it's the last */
+} Tiled;
+
+typedef struct {
+  unsigned long start, end;  /* in 16-bit words, like tally */
+  unsigned long pos;         /* byte offset where the dump ended */
+  unsigned char *block;      /* the records, if cut from a stream */
+  size_t blocksize, blocklen;
+  Tiled *tile;               /* or those of some tiles, for -z */
+  size_t ntile;
+  Dump dump;
+  int done, failed;
+} Chunk;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t done;       /* signalled when a chunk is done */
+  pthread_cond_t room;       /* signalled when a chunk is written or cut */
+  Chunk *chunks;             /* chunk k in chunks[k % size] */
+  size_t size, nchunks, next, written, window;
+  int more;                  /* more chunks to come (from a stream) */
+  int stop, type;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+           PTHREAD_COND_INITIALIZER, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+static void *worker(void *arg);
+static void dumpchunk(Chunk *c);
+static void dumptile(Chunk *c);
+static void putchunk(Dump *d, Chunk *c);
+static int cutchunk(Dump *d, Chunk *c, long *recno, int *err);
+static void stoppool(pthread_t *threads, int nthreads);
+
+/* Return -1 if we cannot go parallel; then nothing has been
+ * consumed yet. Otherwise return 0 when d->tally has reached the
+ * end or the dump must continue sequentially at d->in.
+ */
+int dumpparallel(Dump *d, long count, int type)
+{
+  pthread_t threads[MAXJOBS];
+  unsigned long offset, prev = 0, pos = 0;
+  size_t k, n = 0, size = 0;
+  int nthreads;
+  long r;
+  Chunk *c;
+
+  if (shprtell(d->in) != d->tally*2) return -1;
+  for (r = 1; r <= count; r++) {
+  	if (idxrecord(r, &offset, 0) < 0) break;
+  	if ((r == 1) ? (offset != d->tally*2) : (offset <= prev)) break;
+  	if ((offset/2 >= length) || (offset > shprmapped(d->in))) break;
+  	if ((n == 0) || (offset - pool.chunks[n-1].start*2 >= CHUNKSIZE)) {
+  		if (n == size) {
+  			size = size ? size*2 : 64;
+  			c = (Chunk *) realloc(pool.chunks, size * sizeof(Chunk));
+  			if (c == NULL) die(FAILSOFT, "out of memory");
+  			pool.chunks = c;
+  		}
+  		c = &pool.chunks[n++];
+  		memset(c, 0, sizeof *c);
+  		c->start = offset/2;
+  		c->dump.recno = r;
   	}
-  	putpoint(points[i].x, points[i].y, gflag);
-  	bboxadd(&bbox, points[i].x, points[i].y);
+  	prev = offset;
+  }
+  if (n == 0) return -1;  /* no index worth using */
+  for (k = 0; k+1 < n; k++) pool.chunks[k].end = pool.chunks[k+1].start;
+  pool.chunks[n-1].end = length;
+  pool.size = pool.nchunks = n;
+  pool.window = 2*jobs;
+  pool.type = type;
+
+  for (nthreads = 0; (nthreads < jobs) && (nthreads < MAXJOBS); nthreads++)
+  	if (pthread_create(&threads[nthreads], 0, worker, 0) != 0) break;
+  if (nthreads == 0) {
+  	free(pool.chunks);
+  	pool.chunks = 0;
+  	return -1;
   }
 
-  free(points);
-  free(parts);
+  putflush(d);
+  for (k = 0; k < n; k++) {
+  	c = &pool.chunks[k];
+  	pthread_mutex_lock(&pool.lock);
+  	while (!c->done) pthread_cond_wait(&pool.done, &pool.lock);
+  	pthread_mutex_unlock(&pool.lock);
+
+  	putchunk(d, c);
+  	if (statsflag) statsmerge(&d->stats, &c->dump.stats);
+  	if (c->failed) {
+  		stoppool(threads, nthreads);
+  		errno = c->dump.err;
+  		die(c->dump.code, c->dump.info);
+  	}
+  	d->tally = c->dump.tally;
+  	d->records += c->dump.records;
+  	d->recno = c->dump.recno;
+  	if (statsflag) progress(d);
+  	pos = c->pos;
+  	free(c->dump.buf);
+  	free(c->dump.notes);
+  	if ((k+1 < n) && ((c->dump.tally != c->end) || (c->pos != c->end*2)))
+  		break;  /* continue sequentially */
+
+  	pthread_mutex_lock(&pool.lock);
+  	pool.written++;
+  	pthread_cond_broadcast(&pool.room);
+  	pthread_mutex_unlock(&pool.lock);
+  }
 
-  if (gflag) printf("END\n");
-  else if (vflag) putbbox(xmin, ymin, xmax, ymax);
+  stoppool(threads, nthreads);
+  (void) shprseek(d->in, pos);  /* where the last chunk written ended */
+  if (statsflag) d->stats.last = now();  /* the wait is no phase */
+  for (k++; k < n; k++) {  /* dropped, if any */
+  	free(pool.chunks[k].dump.buf);
+  	free(pool.chunks[k].dump.notes);
+  }
+  free(pool.chunks);
+  pool.chunks = 0;
+  return 0;
+}
 
-  if (xflag && !bboxok(&bbox, xmin, ymin, xmax, ymax))
-  	warn("invalid bbox");
-  bboxadd(&actualbbox, bbox.xmin, bbox.ymin);
-  bboxadd(&actualbbox, bbox.xmax, bbox.ymax);
+static void *worker(void *arg)
+{
+  size_t k;
+
+  (void) arg;
+  for (;;) {
+  	pthread_mutex_lock(&pool.lock);
+  	while (!pool.stop && ((pool.next < pool.nchunks) ?
+  	       (pool.next >= pool.written + pool.window) : pool.more))
+  		pthread_cond_wait(&pool.room, &pool.lock);
+  	if (pool.stop || (pool.next >= pool.nchunks)) {
+  		pthread_mutex_unlock(&pool.lock);
+  		return 0;
+  	}
+  	k = pool.next++ % pool.size;
+  	pthread_mutex_unlock(&pool.lock);
+
+  	dumpchunk(&pool.chunks[k]);
+
+  	pthread_mutex_lock(&pool.lock);
+  	pool.chunks[k].done = 1;
+  	pthread_cond_broadcast(&pool.done);
+  	pthread_mutex_unlock(&pool.lock);
+  }
 }
 
-void dumplinez(Integer id)
+static void dumpchunk(Chunk *c)
 {
-  BoundingBox bbox;
-  Double xmin, xmax;
-  Double ymin, ymax;
-  Double zmin, zmax;
-  Double mmin, mmax;
-  Integer nparts, npoints;
-  Integer *parts;
-  Point *points;
-  Double *zvalues;
-  Double *mvalues;
-  Integer i, j;
+  ShpReader *in = c->block ? shprblock(c->block, c->blocklen, c->start*2)
+                           : shprclone(reader);  /* own cursor into the mapping */
+  Dump *d = &c->dump;
+  jmp_buf env;
+
+  d->in = in;
+  d->keep = 1;
+  d->quiet = top.quiet;
+  d->fail = &env;
+  d->tally = c->start;
+  if (statsflag) d->stats.last = now();
+  bboxinit(&d->bbox);
+  if (setjmp(env)) {
+  	shprclose(in);
+  	free(d->simple.mem);
+  	free(d->copy);
+  	free(d->valid.mem);
+  	clipfree(&d->clip);
+  	c->failed = 1;
+  	return;
+  }
+  if (in == NULL) fail(d, FAILSOFT, "out of memory");
+  if (c->tile) dumptile(c);
+  else {
+  	if (!c->block) (void) shprseek(in, c->start*2);
+  	while (d->tally < c->end) dumpnext(d, pool.type);
+  }
+  c->pos = shprtell(in);
+  shprclose(in);
+  free(d->simple.mem);
+  free(d->copy);
+  free(d->valid.mem);
+  clipfree(&d->clip);
+}
 
-  xmin = getdouble();
-  ymin = getdouble();
-  xmax = getdouble();
-  ymax = getdouble();
+/* write a chunk's output with its warnings at the right places */
+static void putchunk(Dump *d, Chunk *c)
+{
+  Dump *cd = &c->dump;
+  double t = statsflag ? now() : 0;
+  size_t at = 0, i;
+
+  for (i = 0; i < cd->nnotes; i++) {
+  	if (shipout(stdout, cd->buf + at, cd->notes[i].at - at) < 0)
+  		die(FAILSOFT, "cannot write output");
+  	at = cd->notes[i].at;
+  	warn(d, cd->notes[i].info);
+  }
+  if (shipout(stdout, cd->buf + at, cd->len - at) < 0)
+  	die(FAILSOFT, "cannot write output");
+  bboxmerge(&d->bbox, &cd->bbox);
+  if (statsflag) d->stats.write += now() - t;
+}
 
-  nparts = getint();
-  npoints = getint();
+/* Parallel dump (-j) of input that comes as a stream: cut it into
+ * chunks of whole records while there's room in the window, and
+ * write them as they're done. A chunk that fails or does not come
+ * out as cut (records disagree with their lengths) is dropped, and
+ * it and all cut after it are put back into the input, to go on
+ * sequentially from its start. Return like dumpparallel().
+ */
+int dumpstream(Dump *d, int type)
+{
+  pthread_t threads[MAXJOBS];
+  long recno = d->recno;  /* of the next record to cut */
+  int nthreads, n, err = 0;
+  size_t k;
+  Chunk *c;
+
+  if (shprtell(d->in) != d->tally*2) return -1;
+  pool.window = pool.size = 2*jobs;
+  if ((pool.chunks = (Chunk *) calloc(pool.size, sizeof(Chunk))) == NULL)
+  	die(FAILSOFT, "out of memory");
+  pool.nchunks = pool.next = pool.written = 0;
+  pool.more = 1;
+  pool.stop = 0;
+  pool.type = type;
+  for (nthreads = 0; (nthreads < jobs) && (nthreads < MAXJOBS); nthreads++)
+  	if (pthread_create(&threads[nthreads], 0, worker, 0) != 0) break;
+  if (nthreads == 0) {
+  	free(pool.chunks);
+  	pool.chunks = 0;
+  	return -1;
+  }
 
-  parts = (Integer *) calloc(nparts, sizeof(Integer));
-  if (parts == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < nparts; i++) parts[i] = getint();
+  putflush(d);
+  for (k = 0; ; k++) {
+  	while (pool.more && (pool.nchunks < pool.written + pool.window)) {
+  		c = &pool.chunks[pool.nchunks % pool.size];
+  		n = cutchunk(d, c, &recno, &err);  /* its slot is free */
+  		pthread_mutex_lock(&pool.lock);
+  		if (n) pool.nchunks++;
+  		if (!n || err) pool.more = 0;
+  		pthread_cond_broadcast(&pool.room);
+  		pthread_mutex_unlock(&pool.lock);
+  	}
+  	if (k == pool.nchunks) break;
+
+  	c = &pool.chunks[k % pool.size];
+  	pthread_mutex_lock(&pool.lock);
+  	while (!c->done) pthread_cond_wait(&pool.done, &pool.lock);
+  	pthread_mutex_unlock(&pool.lock);
+  	if (c->failed || (c->dump.tally != c->end) || (c->pos != c->end*2))
+  		break;  /* continue sequentially from its start */
+
+  	putchunk(d, c);
+  	if (statsflag) statsmerge(&d->stats, &c->dump.stats);
+  	d->tally = c->dump.tally;
+  	d->records += c->dump.records;
+  	d->recno = c->dump.recno;
+  	if (statsflag) progress(d);
+  	free(c->dump.buf);
+  	free(c->dump.notes);
+  	c->dump.buf = 0;
+  	c->dump.notes = 0;
+
+  	pthread_mutex_lock(&pool.lock);
+  	pool.written++;
+  	pthread_cond_broadcast(&pool.room);
+  	pthread_mutex_unlock(&pool.lock);
+  }
 
-  points = (Point *) calloc(npoints, sizeof(Point));
-  if (points == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < npoints; i++) points[i] = getpoint();
+  stoppool(threads, nthreads);
+  if (statsflag) d->stats.last = now();
+  while (pool.nchunks > k) {  /* put back what's not written, last first */
+  	c = &pool.chunks[--pool.nchunks % pool.size];
+  	if (shprunread(d->in, c->block, c->blocklen) < 0) badread(d);
+  }
+  for (k = 0; k < pool.size; k++) {
+  	free(pool.chunks[k].block);
+  	free(pool.chunks[k].dump.buf);
+  	free(pool.chunks[k].dump.notes);
+  }
+  free(pool.chunks);
+  pool.chunks = 0;
+  if (err) {
+  	errno = err;
+  	badread(d);
+  }
+  return 0;
+}
+
+/* Cut records off the input into the chunk's block, up to about
+ * CHUNKSIZE bytes; return 0 if there were none: at the end, at a
+ * record shprraw() won't take, or on a read error (then in *err) */
+static int cutchunk(Dump *d, Chunk *c, long *recno, int *err)
+{
+  const void *p;
+  long first = *recno;
+  size_t n;
+
+  c->start = shprtell(d->in)/2;
+  c->blocklen = 0;
+  while ((c->blocklen < CHUNKSIZE) && ((p = shprraw(d->in, &n)) != NULL)) {
+  	if (c->blocklen + n > c->blocksize) {
+  		size_t size = c->blocksize ? c->blocksize : CHUNKSIZE;
+  		unsigned char *block;
+  		while (size < c->blocklen + n) size *= 2;
+  		if ((block = (unsigned char *) realloc(c->block, size)) == NULL)
+  			die(FAILSOFT, "out of memory");
+  		c->block = block;
+  		c->blocksize = size;
+  	}
+  	memcpy(c->block + c->blocklen, p, n);
+  	c->blocklen += n;
+  	(*recno)++;
+  }
+  if (p == NULL) *err = errno;
+  if (c->blocklen == 0) return 0;
+  c->end = c->start + c->blocklen/2;
+  c->pos = 0;
+  c->done = c->failed = 0;
+  memset(&c->dump, 0, sizeof c->dump);
+  c->dump.recno = first;
+  return 1;
+}
+
+static void stoppool(pthread_t *threads, int nthreads)
+{
+  int i;
 
-  zmin = getdouble();
-  zmax = getdouble();
+  pthread_mutex_lock(&pool.lock);
+  pool.stop = 1;
+  pthread_cond_broadcast(&pool.room);
+  pthread_mutex_unlock(&pool.lock);
+  for (i = 0; i < nthreads; i++) pthread_join(threads[i], 0);
+}
 
-  zvalues = (Double *) calloc(npoints, sizeof(Double));
-  if (zvalues == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < npoints; i++) zvalues[i] = getdouble();
+/* Tiles (-z): a pass over the heads of the records finds the
+ * tiles each one's bbox touches, and then each tile is dumped by a
+ * worker like a shapefile of its records (in their order), each
+ * cut to the tile, see clipped(), and written as it's done, with
+ * the workers ahead by a window of chunks of TILERECS records or
+ * more, of whole tiles, as for dumpstream(). A
+ * grid of the given size goes from 0,0, numbered x to the right
+ * and y up; a zoom level z cuts the extent in the header (squared)
+ * into 2^z by 2^z tiles, numbered from the top left like web tiles,
+ * and the outer ones take all beyond. The output of a tile goes to
+ * stdout after a line "tile name bytes", or with -o to a file
+ * dir/name.txt (or .gen etc.), with name z/x/y or x/y.
+ */
 
-  /* Note: Shapes with Z always include M */
+#define MAXTILES (1L << 22)  /* per record, to keep memory in bounds */
+#define TILERECS 256  /* records per chunk, but for the last tile */
 
-  mmin = getdouble();
-  mmax = getdouble();
+static Double tileleft, tiletop, tilewidth, tileheight;  /* the grid */
+static long tilelast;  /* column and row, at a zoom level */
 
-  mvalues = (Double *) calloc(npoints, sizeof(Double));
-  if (mvalues == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < npoints; i++) mvalues[i] = getdouble();
+static long tilecol(Double x);
+static long tilerow(Double y);
+static long tileclamp(Double t);
+static void tilebox(long x, long y, BoundingBox *box);
+static void puttiles(Dump *d, Chunk *c);
+static int makedirs(char *path);
+static int bytile(const void *a, const void *b);
 
-  bboxinit(&bbox);
-  if (gflag) printf(FINT"\n", id);
-  else printf("line "FINT" parts "FINT" points "FINT"\n", id, nparts, npoints);
+int dumptiles(Dump *d, int type)
+{
+  pthread_t threads[MAXJOBS];
+  Tiled *tiles = 0, *t;
+  size_t n = 0, size = 0, next = 0, k, bufsize;
+  ShpRecord rec;
+  long x, y, x0, x1, y0, y1, recno = 0;
+  char *buf;
+  int nthreads;
+  Chunk *c;
+
+  if (!shprmapped(d->in)) {
+  	errno = 0;
+  	die(FAILHARD, "cannot make tiles from a pipe or compressed shapefile");
+  }
+  if (zoom >= 0) {
+  	Double side = headerbbox.xmax - headerbbox.xmin;
+  	if (headerbbox.ymax - headerbbox.ymin > side) side = headerbbox.ymax - headerbbox.ymin;
+  	if (!(side >= 0) || (side == HUGE_VAL)) {
+  		errno = 0;
+  		die(FAILHARD, "no extent in the header to make tiles of");
+  	}
+  	tilelast = (1L << zoom) - 1;
+  	tileleft = headerbbox.xmin;
+  	tiletop = headerbbox.ymax;
+  	tilewidth = tileheight = (side > 0) ? side / (tilelast + 1) : 1;
+  }
+  else {
+  	tilelast = -1;
+  	tileleft = tiletop = 0;
+  	tilewidth = gridw;
+  	tileheight = gridh;
+  }
 
-  for (i = 0, j = 1; i < npoints; i++) {
-  	if ((j < nparts) && (i == parts[j])) { ++j;
-  		printf("part\n");
+  while (d->tally < length) {
+  	if ((shprhead(d->in, &rec) < 0) || (shprbbox(d->in, &rec) < 0) ||
+  	    (shprskip(d->in, &rec) < 0))
+  		badread(d);
+  	d->tally += 4 + rec.length;
+  	recno++;
+  	if ((rec.where <= 0) || (bflag && outside(&rec))) continue;
+  	x0 = tilecol(rec.bbox.xmin); x1 = tilecol(rec.bbox.xmax);
+  	y0 = tilerow(rec.bbox.ymin); y1 = tilerow(rec.bbox.ymax);
+  	if (y0 > y1) { y = y0; y0 = y1; y1 = y; }  /* rows go down */
+  	if ((x1 - x0 + 1.0) * (y1 - y0 + 1.0) > MAXTILES) {
+  		char msg[NOTELEN];
+  		sprintf(msg, "record %ld is in too many tiles", recno);
+  		errno = 0;
+  		die(FAILHARD, msg);
+  	}
+  	for (x = x0; x <= x1; x++) for (y = y0; y <= y1; y++) {
+  		if (n == size) {
+  			size = size ? 2*size : 4096;
+  			if ((t = (Tiled *) realloc(tiles, size * sizeof(Tiled))) == NULL)
+  				die(FAILSOFT, "out of memory");
+  			tiles = t;
+  		}
+  		t = &tiles[n++];
+  		t->x = x;
+  		t->y = y;
+  		t->offset = rec.offset;
+  		t->recno = recno;
+  		t->first = (x == x0) && (y == y0);
   	}
-  	putpointz(points[i].x, points[i].y, zvalues[i], mvalues[i], gflag);
-  	bboxadd(&bbox, points[i].x, points[i].y);
   }
+  if (n > 0) qsort(tiles, n, sizeof(Tiled), bytile);
+
+  d->quiet = 0;
+  pool.window = pool.size = 2*jobs;
+  if ((pool.chunks = (Chunk *) calloc(pool.size, sizeof(Chunk))) == NULL)
+  	die(FAILSOFT, "out of memory");
+  pool.nchunks = pool.next = pool.written = 0;
+  pool.more = (n > 0);
+  pool.stop = 0;
+  pool.type = type;
+  for (nthreads = 0; (nthreads < jobs) && (nthreads < MAXJOBS); nthreads++)
+  	if (pthread_create(&threads[nthreads], 0, worker, 0) != 0) break;
+  if (nthreads == 0) die(FAILSOFT, "cannot start threads");
+
+  for (k = 0; ; k++) {
+  	while (pool.more && (pool.nchunks < pool.written + pool.window)) {
+  		c = &pool.chunks[pool.nchunks % pool.size];  /* its slot is free */
+  		buf = c->dump.buf;  /* but for the output buffer, kept */
+  		bufsize = c->dump.size;
+  		memset(c, 0, sizeof *c);
+  		c->dump.buf = buf;
+  		c->dump.size = bufsize;
+  		c->tile = &tiles[next];
+  		for (c->ntile = 0; (next < n) && ((c->ntile < TILERECS) ||
+  		     ((tiles[next].x == tiles[next-1].x) && (tiles[next].y == tiles[next-1].y)));
+  		     next++)
+  			c->ntile++;
+  		pthread_mutex_lock(&pool.lock);
+  		pool.nchunks++;
+  		if (next == n) pool.more = 0;
+  		pthread_cond_broadcast(&pool.room);
+  		pthread_mutex_unlock(&pool.lock);
+  	}
+  	if (k == pool.nchunks) break;
+
+  	c = &pool.chunks[k % pool.size];
+  	pthread_mutex_lock(&pool.lock);
+  	while (!c->done) pthread_cond_wait(&pool.done, &pool.lock);
+  	pthread_mutex_unlock(&pool.lock);
+  	if (c->failed) {
+  		stoppool(threads, nthreads);
+  		errno = c->dump.err;
+  		die(c->dump.code, c->dump.info);
+  	}
 
-  free(mvalues);
-  free(zvalues);
-  free(points);
-  free(parts);
+  	puttiles(d, c);
+  	if (statsflag) statsmerge(&d->stats, &c->dump.stats);
+  	d->records += c->dump.records;
+  	if (statsflag) progress(d);
+  	free(c->dump.notes);
 
-  if (gflag) printf("END\n");
-  else if (vflag) {
-  	putbbox(xmin, ymin, xmax, ymax);
-  	putrange("zrange", zmin, zmax);
-  	putrange("mrange", mmin, mmax);
+  	pthread_mutex_lock(&pool.lock);
+  	pool.written++;
+  	pthread_cond_broadcast(&pool.room);
+  	pthread_mutex_unlock(&pool.lock);
   }
-  if (xflag && !bboxok(&bbox, xmin, ymin, xmax, ymax))
-  	warn("invalid bbox");
-  bboxadd(&actualbbox, bbox.xmin, bbox.ymin);
-  bboxadd(&actualbbox, bbox.xmax, bbox.ymax);
+
+  stoppool(threads, nthreads);
+  for (k = 0; k < pool.size; k++) free(pool.chunks[k].dump.buf);
+  free(pool.chunks);
+  pool.chunks = 0;
+  free(tiles);
+  dbfclose();
+  putflush(d);
+  putstats(d);
+  return (xflag && d->warnings > 0) ? 1 : 0;
 }
 
-void dumppolygon(Integer id)
+/* Dump the records of each tile, cut to it, like a shapefile of
+ * them, and note where its output ends */
+static void dumptile(Chunk *c)
 {
-  BoundingBox bbox;
-  Double xmin, xmax;
-  Double ymin, ymax;
-  Integer nparts, npoints;
-  Integer *parts;
-  Point *points;
-  Integer i, j;
+  Dump *d = &c->dump;
+  Tiled *t = c->tile;
+  size_t i, notes;
+
+  d->tiled = 1;
+  for (i = 0; i < c->ntile; i++) {
+  	if ((i == 0) || (t[i].x != t[i-1].x) || (t[i].y != t[i-1].y)) {
+  		d->tilex = t[i].x;
+  		d->tiley = t[i].y;
+  		tilebox(d->tilex, d->tiley, &d->tile);
+  		if (!gflag && !fflag) putname(d, "type", shptype(pool.type));
+  	}
+  	if (shprseek(d->in, t[i].offset) < 0) badread(d);
+  	d->recno = t[i].recno;
+  	notes = d->nnotes;
+  	dumpnext(d, pool.type);
+  	if (!t[i].first) d->nnotes = notes;  /* said in its first tile */
+  	if ((i+1 < c->ntile) && (t[i+1].x == t[i].x) && (t[i+1].y == t[i].y)) continue;
+  	if (gflag) putf(d, "END\n");
+  	t[i].end = d->len;
+  }
+}
 
-  xmin = getdouble();
-  ymin = getdouble();
-  xmax = getdouble();
-  ymax = getdouble();
+static long tilecol(Double x)
+{
+  return tileclamp(floor((x - tileleft) / tilewidth));
+}
 
-  nparts = getint();
-  npoints = getint();
+static long tilerow(Double y)
+{
+  if (zoom >= 0) return tileclamp(floor((tiletop - y) / tileheight));
+  return tileclamp(floor((y - tiletop) / tileheight));
+}
 
-  parts = (Integer *) calloc(nparts, sizeof(Integer));
-  if (parts == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < nparts; i++) parts[i] = getint();
+/* Into the tiles of a zoom level, or far out on a grid (NaNs too) */
+static long tileclamp(Double t)
+{
+  Double far = (Double) (LONG_MAX / 4);
 
-  points = (Point *) calloc(npoints, sizeof(Point));
-  if (points == NULL) die(FAILSOFT, "out of memory");
-  for (i = 0; i < npoints; i++) points[i] = getpoint();
+  if (zoom >= 0) return (t < 0) ? 0 : (t > tilelast) ? tilelast : (long) t;
+  return !(t > -far) ? (long) -far : (t > far) ? (long) far : (long) t;
+}
 
-  bboxinit(&bbox);
-  if (gflag) printf(FINT"\n", id);
-  else printf("polygon "FINT" parts "FINT" points "FINT"\n", id, nparts, npoints);
+static void tilebox(long x, long y, BoundingBox *box)
+{
+  box->xmin = tileleft + x * tilewidth;
+  box->xmax = tileleft + (x + 1) * tilewidth;
+  if (zoom < 0) {
+  	box->ymin = tiletop + y * tileheight;
+  	box->ymax = tiletop + (y + 1) * tileheight;
+  	return;
+  }
+  box->ymax = tiletop - y * tileheight;
+  box->ymin = tiletop - (y + 1) * tileheight;
+  if (x == 0) box->xmin = -HUGE_VAL;
+  if (x == tilelast) box->xmax = HUGE_VAL;
+  if (y == 0) box->ymax = HUGE_VAL;
+  if (y == tilelast) box->ymin = -HUGE_VAL;
+}
 
-  for (i = 0, j = 1; i < npoints; i++) {
-  	if ((j < nparts) && (i == parts[j])) { ++j;
-  		printf("part\n");
+/* Write the output of the tiles of a chunk, each with its
+ * warnings at the right places, to stdout through the buffer of
+ * d or to a file of its own */
+static void puttiles(Dump *d, Chunk *c)
+{
+  char name[80], path[1024];
+  const Tiled *t;
+  Dump *cd = &c->dump;
+  size_t at = 0, i, k = 0, to;
+  FILE *fp = 0;
+
+  for (i = 0, t = c->tile; i < c->ntile; i++, t++) {
+  	if ((i+1 < c->ntile) && (t[1].x == t->x) && (t[1].y == t->y)) continue;
+  	if (zoom >= 0) sprintf(name, "%d/%ld/%ld", zoom, t->x, t->y);
+  	else sprintf(name, "%ld/%ld", t->x, t->y);
+  	if (!odir) putf(d, "tile %s %ld\n", name, (long) (t->end - at));
+  	else {
+  		if (strlen(odir) + strlen(name) + 8 > sizeof path)
+  			die(FAILHARD, "directory name too long");
+  		sprintf(path, "%s/%s%s", odir, name, suffix());
+  		if ((makedirs(path) < 0) || ((fp = fopen(path, "wb")) == NULL))
+  			die(FAILSOFT, path);
   	}
-  	putpoint(points[i].x, points[i].y, gflag);
-  	bboxadd(&bbox, points[i].x, points[i].y);
+  	for (;;) {
+  		to = ((k < cd->nnotes) && (cd->notes[k].at <= t->end)) ? cd->notes[k].at : t->end;
+  		if (!fp) putbuf(d, cd->buf + at, to - at);
+  		else if (shipout(fp, cd->buf + at, to - at) < 0) die(FAILSOFT, path);
+  		at = to;
+  		if ((k == cd->nnotes) || (cd->notes[k].at > t->end)) break;
+  		warn(d, cd->notes[k++].info);
+  	}
+  	if (fp && (fclose(fp) != 0)) die(FAILSOFT, path);
+  	fp = 0;
   }
+}
 
-  free(points);
-  free(parts);
+/* Make the directories of path that are not there */
+static int makedirs(char *path)
+{
+  char *p;
+  int r;
+
+  for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+  	*p = '\0';
+  	r = mkdir(path, 0777);
+  	*p = '/';
+  	if ((r < 0) && (errno != EEXIST)) return -1;
+  }
+  return 0;
+}
 
-  if (gflag) printf("END\n");
-  else if (vflag) putbbox(xmin, ymin, xmax, ymax);
+static int bytile(const void *a, const void *b)
+{
+  const Tiled *s = (const Tiled *) a, *t = (const Tiled *) b;
 
-  if (xflag && !bboxok(&bbox, xmin, ymin, xmax, ymax))
-  	warn("invalid bbox");
-  bboxadd(&actualbbox, bbox.xmin, bbox.ymin);
-  bboxadd(&actualbbox, bbox.xmax, bbox.ymax);
+  if (s->x != t->x) return (s->x < t->x) ? -1 : 1;
+  if (s->y != t->y) return (s->y < t->y) ? -1 : 1;
+  return (s->recno < t->recno) ? -1 : (s->recno > t->recno);
 }
 
-void dumpmultipoint(Integer id); /* etc: TODO */
+/* For -e, a copy of the record with the points of its lines or
+ * rings simplified, in memory of the dump; the record itself, what
+ * -x and -c check, stays as decoded. Parts out of order are left
+ * as they are, and so are all other shapes.
+ */
+const ShpRecord *simplified(Dump *d, const ShpRecord *rec, ShpRecord *copy)
+{
+  Integer j, k, first, end, n = rec->npoints, nparts = rec->nparts;
+  size_t need;
+  unsigned char *keep;
+  Integer *parts;
+  Double *z, *m;
+  Point *pt;
+  long kept = 0;
+  int ring;
+
+  switch (rec->type) {
+  	case SHP_TYPE_POLYLINE: case SHP_TYPE_POLYLINEZ: case SHP_TYPE_POLYLINEM:
+  		ring = 0; break;
+  	case SHP_TYPE_POLYGON: case SHP_TYPE_POLYGONZ: case SHP_TYPE_POLYGONM:
+  		ring = 1; break;
+  	default:
+  		return rec;
+  }
+  if ((nparts < 1) || (rec->parts[0] != 0)) return rec;
+  for (j = 1; j < nparts; j++)
+  	if ((rec->parts[j] <= rec->parts[j-1]) || (rec->parts[j] >= n)) return rec;
+
+  need = n * (sizeof(Point) + (rec->hasz + rec->hasm) * sizeof(Double) + 1) +
+         nparts * sizeof(Integer);
+  if (need > d->copysize) {
+  	free(d->copy);
+  	d->copysize = 0;
+  	if ((d->copy = malloc(need)) == NULL) fail(d, FAILSOFT, "out of memory");
+  	d->copysize = need;
+  }
+  pt = (Point *) d->copy;
+  z = (Double *) (pt + n);
+  m = z + (rec->hasz ? n : 0);
+  parts = (Integer *) (m + (rec->hasm ? n : 0));
+  keep = (unsigned char *) (parts + nparts);
+
+  for (j = 0; j < nparts; j++) {
+  	first = rec->parts[j];
+  	end = (j+1 < nparts) ? rec->parts[j+1] : n;
+  	if (simplify(&d->simple, rec->points + first, end - first,
+  	             tolerance*tolerance/2, ring ? 4 : 2, keep + first) < 0)
+  		fail(d, FAILSOFT, "out of memory");
+  	parts[j] = kept;
+  	for (k = first; k < end; k++) {
+  		if (!keep[k]) continue;
+  		pt[kept] = rec->points[k];
+  		if (rec->hasz) z[kept] = rec->z[k];
+  		if (rec->hasm) m[kept] = rec->m[k];
+  		kept++;
+  	}
+  }
+  *copy = *rec;
+  copy->npoints = kept;
+  copy->parts = parts;
+  copy->points = pt;
+  if (rec->hasz) copy->z = z;
+  if (rec->hasm) copy->m = m;
+  return copy;
+}
+
+/* For -z, a copy of the record cut to the tile at hand, in memory
+ * of the dump, or NULL if nothing of it is there: lines and rings
+ * clipped to its box (see clip.h), of a multipoint the points that
+ * fall in it. Points and multipatches are there by their bbox, and
+ * stay as they are. The bbox and ranges are those of what's left.
+ * Rings don't come apart, so the reader's owner[] has room.
+ */
+const ShpRecord *clipped(Dump *d, const ShpRecord *rec, ShpRecord *copy)
+{
+  const BoundingBox *b = &d->tile, *e = &rec->extent;
+  Integer i, n = rec->npoints, kept = 0;
+  Double *z, *m;
+  Point *pt;
+  size_t need;
+  int ring;
+
+  switch (rec->type) {
+  	case SHP_TYPE_POLYLINE: case SHP_TYPE_POLYLINEZ: case SHP_TYPE_POLYLINEM:
+  		ring = 0; break;
+  	case SHP_TYPE_POLYGON: case SHP_TYPE_POLYGONZ: case SHP_TYPE_POLYGONM:
+  		ring = 1; break;
+  	case SHP_TYPE_MULTIPOINT: case SHP_TYPE_MULTIPOINTZ: case SHP_TYPE_MULTIPOINTM:
+  		ring = -1; break;
+  	default:
+  		return rec;
+  }
+  *copy = *rec;
+  if (ring >= 0) {
+  	if ((e->xmin >= b->xmin) && (e->xmax <= b->xmax) &&
+  	    (e->ymin >= b->ymin) && (e->ymax <= b->ymax))
+  		return rec;  /* all in it */
+  	if (clip(&d->clip, b, rec->points, rec->hasz ? rec->z : 0,
+  	         rec->hasm ? rec->m : 0, n, rec->parts, rec->nparts, ring) < 0)
+  		fail(d, FAILSOFT, "out of memory");
+  	if (d->clip.nparts == 0) return 0;
+  	copy->nparts = d->clip.nparts;
+  	copy->parts = d->clip.parts;
+  	copy->npoints = kept = d->clip.npoints;
+  	copy->points = pt = d->clip.points;
+  	copy->z = z = d->clip.z;
+  	copy->m = m = d->clip.m;
+  }
+  else {
+  	need = n * (sizeof(Point) + 2*sizeof(Double));
+  	if (need > d->copysize) {
+  		free(d->copy);
+  		d->copysize = 0;
+  		if ((d->copy = malloc(need)) == NULL) fail(d, FAILSOFT, "out of memory");
+  		d->copysize = need;
+  	}
+  	pt = (Point *) d->copy;
+  	z = (Double *) (pt + n);
+  	m = z + n;
+  	for (i = 0; i < n; i++) {
+  		if ((tilecol(rec->points[i].x) != d->tilex) ||
+  		    (tilerow(rec->points[i].y) != d->tiley))
+  			continue;
+  		pt[kept] = rec->points[i];
+  		if (rec->hasz) z[kept] = rec->z[i];
+  		if (rec->hasm) m[kept] = rec->m[i];
+  		kept++;
+  	}
+  	if (kept == 0) return 0;
+  	copy->npoints = kept;
+  	copy->points = pt;
+  	if (rec->hasz) copy->z = z;
+  	if (rec->hasm) copy->m = m;
+  }
+
+  bboxinit(&copy->bbox);
+  copy->zmin = copy->mmin = DBL_MAX;
+  copy->zmax = copy->mmax = -DBL_MAX;
+  for (i = 0; i < kept; i++) {
+  	bboxadd(&copy->bbox, pt[i].x, pt[i].y);
+  	if (rec->hasz && (z[i] < copy->zmin)) copy->zmin = z[i];
+  	if (rec->hasz && (z[i] > copy->zmax)) copy->zmax = z[i];
+  	if (rec->hasm && (m[i] > -1e38) && (m[i] < copy->mmin)) copy->mmin = m[i];
+  	if (rec->hasm && (m[i] > -1e38) && (m[i] > copy->mmax)) copy->mmax = m[i];
+  }
+  if (copy->mmin > copy->mmax) copy->mmin = rec->mmin, copy->mmax = rec->mmax;
+  copy->extent = copy->bbox;
+  return copy;
+}
+
+/* A decoded record as text, or for -f as what wkb.h makes of it.
+ * The loop over the points is picked per record, by whether there
+ * are Z and M values, so the points go straight to the buffer.
+ */
+
+#define VERTICES(put) \
+  for (i = 0, j = first; i < n; i++) { \
+  	if ((j < rec->nparts) && (i == rec->parts[j])) { \
+  		if (rec->types) putf(d, "part %s\n", parttype(rec->types[j])); \
+  		else putf(d, "part\n"); \
+  		j++; \
+  	} \
+  	if (lead) putf(d, FINT",", rec->id); \
+  	put; \
+  }
+
+void putrecord(Dump *d, const ShpRecord *rec)
+{
+  const Point *pt = rec->points;
+  const Double *z = rec->z, *m = rec->m;
+  Integer i, j, n = rec->npoints;
+  int first = rec->types ? 0 : 1;  /* multipatch parts have a line each */
+  int lead = 0;  /* GENERATE has multipoints as points */
+  const char *label;
+  WkbShape s;
+
+  memset(&s, 0, sizeof s);
+  switch (rec->type) {
+  	case SHP_TYPE_NULL:
+  		if (!fflag) { putf(d, "null "FINT"\n", rec->id); return; }
+  		s.type = WKB_GEOMETRYCOLLECTION;
+  		putshape(d, rec->id, &s, 0);
+  		return;
+  	case SHP_TYPE_POINT: case SHP_TYPE_POINTZ: case SHP_TYPE_POINTM:
+  		s.type = WKB_POINT; label = "point"; break;
+  	case SHP_TYPE_POLYLINE: case SHP_TYPE_POLYLINEZ: case SHP_TYPE_POLYLINEM:
+  		s.type = WKB_MULTILINESTRING; label = "line"; break;
+  	case SHP_TYPE_POLYGON: case SHP_TYPE_POLYGONZ: case SHP_TYPE_POLYGONM:
+  		s.type = WKB_MULTIPOLYGON; label = "polygon"; break;
+  	case SHP_TYPE_MULTIPOINT: case SHP_TYPE_MULTIPOINTZ: case SHP_TYPE_MULTIPOINTM:
+  		s.type = WKB_MULTIPOINT; label = "multipoint"; lead = gflag; break;
+  	case SHP_TYPE_MULTIPATCH:
+  		s.type = WKB_POLYHEDRALSURFACE; label = "patch"; break;
+  	default:
+  		return;  /* unknown, just scanned */
+  }
+
+  if (fflag) {  /* straight from the arrays */
+  	s.hasz = rec->hasz; s.hasm = rec->hasm;
+  	s.nparts = rec->nparts; s.npoints = n;
+  	s.parts = rec->parts; s.types = rec->types;
+  	s.points = pt;
+  	s.z = z; s.m = m;
+  	putshape(d, rec->id, &s, rec->owner);
+  	return;
+  }
+  if (d->quiet) return;
+
+  if (s.type == WKB_POINT) {
+  	if (gflag) putf(d, FINT",", rec->id);
+  	else putf(d, "point "FINT, rec->id);
+  	if (rec->hasz && rec->hasm) putpointzm(d, pt->x, pt->y, *z, *m, gflag);
+  	else if (rec->hasz) putpointz(d, pt->x, pt->y, *z, gflag);
+  	else if (rec->hasm) putpointm(d, pt->x, pt->y, *m, gflag);
+  	else putpoint(d, pt->x, pt->y, gflag);
+  	return;
+  }
+
+  if (!rec->parts) {
+  	if (!gflag) putf(d, "%s "FINT" points "FINT"\n", label, rec->id, n);
+  }
+  else if (gflag) putf(d, FINT"\n", rec->id);
+  else putf(d, "%s "FINT" parts "FINT" points "FINT"\n",
+  	label, rec->id, rec->nparts, n);
+
+  if (rec->hasz && rec->hasm)
+  	VERTICES(putpointzm(d, pt[i].x, pt[i].y, z[i], m[i], gflag))
+  else if (rec->hasz) VERTICES(putpointz(d, pt[i].x, pt[i].y, z[i], gflag))
+  else if (rec->hasm) VERTICES(putpointm(d, pt[i].x, pt[i].y, m[i], gflag))
+  else VERTICES(putpoint(d, pt[i].x, pt[i].y, gflag))
+
+  if (gflag) { if (rec->parts) putf(d, "END\n"); }
+  else if (vflag) {
+  	putbbox(d, rec->bbox.xmin, rec->bbox.ymin, rec->bbox.xmax, rec->bbox.ymax);
+  	if (rec->hasz) putrange(d, "zrange", rec->zmin, rec->zmax);
+  	if (rec->hasm) putrange(d, "mrange", rec->mmin, rec->mmax);
+  }
+}
+
+#undef VERTICES
 
 /* die: complain to stderr, then exit code */
 void die(int code, const char *info)
 {
-  fflush(stdout);
+  int err = errno;
+
+  putflush(&top);
+  errno = err;
   logstr("shpdump: ");
   logstr(info ? (char *) info : "error");
   if (errno) {
@@ -458,14 +1847,134 @@ void die(int code, const char *info)
   exit(code);
 }
 
-/* warn: write "! info" to stderr, inc counter */
-void warn(const char *info)
+/* fail: die, or in a worker, note why and abort its dump */
+void fail(Dump *d, int code, const char *info)
+{
+  if (!d->fail) die(code, info);
+  d->code = code;
+  d->err = errno;
+  strncpy(d->info, info, NOTELEN-1);
+  d->info[NOTELEN-1] = '\0';
+  longjmp(*d->fail, 1);
+}
+
+/* warn: write "! info" to stderr, inc counter;
+ * a worker keeps it until its output is written */
+void warn(Dump *d, const char *info)
 {
   assert(info);
-  fflush(stdout);
+  d->warnings++;
+  if (d->keep) {
+  	Note *n = (Note *) realloc(d->notes, (d->nnotes+1) * sizeof(Note));
+  	if (n == NULL) fail(d, FAILSOFT, "out of memory");
+  	d->notes = n;
+  	n += d->nnotes++;
+  	n->at = d->len;
+  	strncpy(n->info, info, NOTELEN-1);
+  	n->info[NOTELEN-1] = '\0';
+  	return;
+  }
+  putflush(d);
   logstr("! ");
   logline((char *) info);
-  warnings++;
+}
+
+int addranges(const char *s)
+{
+  while (*s) {
+  	long first, last;
+  	char *end;
+
+  	if ((*s == ',') || isspace((unsigned char) *s)) { s++; continue; }
+  	first = last = strtol(s, &end, 10);
+  	if ((end == s) || (first < 1)) return -1;
+  	s = end;
+  	if (*s == '-') {  /* range, open if no upper bound */
+  		last = strtol(++s, &end, 10);
+  		if (end == s) last = LONG_MAX;
+  		s = end;
+  	}
+  	if (last < first) return -1;
+  	if (*s && (*s != ',') && !isspace((unsigned char) *s)) return -1;
+  	addrange(first, last);
+  }
+  return 0;
+}
+
+void addrange(long first, long last)
+{
+  Range *r = (Range *) realloc(ranges, (nranges+1) * sizeof(Range));
+
+  if (r == NULL) die(FAILSOFT, "out of memory");
+  ranges = r;
+  ranges[nranges].first = first;
+  ranges[nranges].last = last;
+  nranges++;
+}
+
+int getbox(BoundingBox *box, const char *s)
+{
+  Double v[4];
+  char *end;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+  	if ((i > 0) && (*s++ != ',')) return -1;
+  	v[i] = strtod(s, &end);
+  	if (end == s) return -1;
+  	s = end;
+  }
+  if (*s || !(v[0] <= v[2]) || !(v[1] <= v[3])) return -1;
+  box->xmin = v[0]; box->ymin = v[1];
+  box->xmax = v[2]; box->ymax = v[3];
+  return 0;
+}
+
+/* -z 6 for a zoom level, -z 1000,500 for tiles of that size */
+int gettiles(const char *s)
+{
+  char *end;
+  long z;
+
+  zoom = -1;
+  gridw = gridh = 0;
+  if (!strchr(s, ',')) {
+  	z = strtol(s, &end, 10);
+  	if ((end == s) || *end || (z < 0) || (z > 30)) return -1;
+  	zoom = (int) z;
+  	return 0;
+  }
+  gridw = strtod(s, &end);
+  if ((end == s) || (*end++ != ',')) return -1;
+  gridh = strtod(s = end, &end);
+  if ((end == s) || *end || !(gridw > 0) || !(gridh > 0) ||
+      (gridw == HUGE_VAL) || (gridh == HUGE_VAL)) {
+  	gridw = gridh = 0;
+  	return -1;
+  }
+  return 0;
+}
+
+char *slurp(const char *filename)
+{
+  FILE *fp = fopen(filename, "r");
+  size_t len = 0, size = 4096;
+  char *s = (char *) malloc(size);
+
+  if (fp == NULL) die(FAILHARD, filename);
+  if (s == NULL) die(FAILSOFT, "out of memory");
+  for (;;) {
+  	len += fread(s + len, 1, size - len - 1, fp);
+  	if (ferror(fp)) die(FAILSOFT, filename);
+  	if (feof(fp)) break;
+  	if (size - len < 2) {
+  		if ((s = (char *) realloc(s, size *= 2)) == NULL)
+  			die(FAILSOFT, "out of memory");
+  	}
+  }
+  fclose(fp);
+  s[len] = '\0';
+  return s;
 }
 
 void bboxinit(BoundingBox *bbox)
@@ -473,7 +1982,7 @@ void bboxinit(BoundingBox *bbox)
   assert(bbox);
 
   bbox->xmin = bbox->ymin = DBL_MAX;  /* XXX +1.0/0.0 */
-  bbox->xmax = bbox->ymax = DBL_MIN;  /* XXX -1.0/0.0 */
+  bbox->xmax = bbox->ymax = -DBL_MAX;  /* not DBL_MIN, which is > 0 */
 }
 
 void bboxadd(BoundingBox *bbox, Double xcoord, Double ycoord)
@@ -487,77 +1996,192 @@ void bboxadd(BoundingBox *bbox, Double xcoord, Double ycoord)
   if (ycoord > bbox->ymax) bbox->ymax = ycoord;
 }
 
-/* The only two data types in Shapefiles are Integer and Double.
- * Double is always stored in little endian byte order, Integer
- * occurs in both big and little endian order.
- */
+void bboxmerge(BoundingBox *bbox, const BoundingBox *other)
+{
+  assert(bbox && other);
+
+  if (other->xmin < bbox->xmin) bbox->xmin = other->xmin;
+  if (other->xmax > bbox->xmax) bbox->xmax = other->xmax;
 
-Integer getint(void)
+  if (other->ymin < bbox->ymin) bbox->ymin = other->ymin;
+  if (other->ymax > bbox->ymax) bbox->ymax = other->ymax;
+}
+
+/* Checks for -c (beyond those of -x) */
+
+/* Records are numbered from 1, and where there's an index file,
+ * it must give their offsets and lengths (in words) */
+void checkrecord(Dump *d, unsigned long at, Integer recnum, Integer reclen)
 {
-  unsigned long value;
-  unsigned char bytes[4];
-  int byte, i;
+  unsigned long offset, len;
 
-  for (i = 0; i < 4; i++) {
-  	if ((byte = getbyte()) < 0) { errno = 0;
-  		die(FAILHARD, "unexpected end of file");
+  if (recnum != d->recno) warn(d, "unexpected record number");
+  if ((d->recno <= idxcount) && (idxrecord(d->recno, &offset, &len) == 0) &&
+      ((offset != at) || (len != (unsigned long) reclen * 2)))
+  	warn(d, "index file does not match record");
+}
+
+/* Parts start at the first point and then at increasing points */
+void checkparts(Dump *d, const Integer *parts, Integer nparts, Integer npoints)
+{
+  Integer i;
+
+  if ((nparts < 1) && (npoints > 0)) warn(d, "points but no parts");
+  if ((nparts > 0) && (parts[0] != 0)) warn(d, "first part not at first point");
+  for (i = 1; i < nparts; i++)
+  	if ((parts[i] <= parts[i-1]) || (parts[i] >= npoints)) {
+  		warn(d, "invalid part index");
+  		break;
   	}
-  	else bytes[i] = byte;
+}
+
+/* Lines must not cross or touch themselves; polygon rings must be
+ * closed, not cross each other, and go clockwise, or if holes (in
+ * an odd number of other rings) counter-clockwise */
+void checkshape(Dump *d, const ShpRecord *rec)
+{
+  int rings;
+
+  switch (rec->type) {
+  	case SHP_TYPE_POLYLINE: case SHP_TYPE_POLYLINEZ: case SHP_TYPE_POLYLINEM:
+  		rings = 0; break;
+  	case SHP_TYPE_POLYGON: case SHP_TYPE_POLYGONZ: case SHP_TYPE_POLYGONM:
+  		rings = 1; break;
+  	default:
+  		return;
   }
-  /* little endian */
-  value  = bytes[3]; value <<= 8;
-  value += bytes[2]; value <<= 8;
-  value += bytes[1]; value <<= 8;
-  value += bytes[0];
+  if (validate(&d->valid, rec->points, rec->npoints, rec->parts, rec->nparts,
+               rings, badshape, d) < 0)
+  	fail(d, FAILSOFT, "out of memory");
+}
 
-  return value;
+static void badshape(void *arg, int problem, Integer part, Integer other)
+{
+  Dump *d = (Dump *) arg;
+  char msg[NOTELEN];
+
+  if (problem == VALID_CROSS)
+  	sprintf(msg, "record %ld parts %ld and %ld cross", d->recno, (long) part,
+  	        (long) other);
+  else sprintf(msg, "record %ld part %ld: %s", d->recno, (long) part,
+               validwhat(problem));
+  warn(d, msg);
 }
 
-Integer getintbig(void)
+/* Write the result of -c as lines like the header's */
+void putsummary(Dump *d)
 {
-  unsigned long value;
-  unsigned char bytes[4];
-  int byte, i;
+  d->quiet = 0;
+  putf(d, "records %ld\n", (long) d->records);
+  putf(d, "warnings %ld\n", (long) d->warnings);
+  putname(d, "result", d->warnings ? "invalid" : "valid");
+}
 
-  for (i = 0; i < 4; i++) {
-  	if ((byte = getbyte()) < 0) { errno = 0;
-  		die(FAILHARD, "unexpected end of file");
-  	}
-  	else bytes[i] = byte;
+/* Write the -t statistics to stderr, as lines like the header's
+ * behind "stats": totals, rates, the time per phase (summed over
+ * the threads with -j), then records per shape type and per number
+ * of parts and points (in powers of two), all nonzero counts */
+void putstats(Dump *d)
+{
+  Stats *st = &d->stats;
+  double seconds;
+  char line[128];
+  int i;
+
+  if (!statsflag) return;
+  seconds = now() - started;
+  sprintf(line, "stats records %lu", d->records);
+  logline(line);
+  sprintf(line, "stats bytes %.0f", d->tally * 2.0);
+  logline(line);
+  sprintf(line, "stats seconds %.3f", seconds);
+  logline(line);
+  if (seconds <= 0) seconds = 1e-9;
+  sprintf(line, "stats records/s %.0f", d->records / seconds);
+  logline(line);
+  sprintf(line, "stats bytes/s %.0f", d->tally * 2.0 / seconds);
+  logline(line);
+  sprintf(line, "stats time read %.3f", st->read); logline(line);
+  sprintf(line, "stats time decode %.3f", st->decode); logline(line);
+  sprintf(line, "stats time bbox %.3f", st->bbox); logline(line);
+  sprintf(line, "stats time format %.3f", st->format); logline(line);
+  sprintf(line, "stats time write %.3f", st->write); logline(line);
+  sprintf(line, "stats time other %.3f", st->other); logline(line);
+  for (i = 0; i <= NTYPES; i++) if (st->types[i]) {
+  	if (i < NTYPES) sprintf(line, "stats type %d %s %lu", i, shptype(i), st->types[i]);
+  	else sprintf(line, "stats type other %lu", st->types[i]);
+  	logline(line);
+  }
+  for (i = 0; i < NBUCKETS; i++) if (st->parts[i]) {
+  	sprintf(line, "stats parts %s %lu", bucketname(i), st->parts[i]);
+  	logline(line);
+  }
+  for (i = 0; i < NBUCKETS; i++) if (st->points[i]) {
+  	sprintf(line, "stats points %s %lu", bucketname(i), st->points[i]);
+  	logline(line);
   }
-  /* big endian */
-  value  = bytes[0]; value <<= 8;
-  value += bytes[1]; value <<= 8;
-  value += bytes[2]; value <<= 8;
-  value += bytes[3];
-
-  return value;
 }
 
-Double getdouble(void)
+/* Every STATSEVERY seconds, a line on how far the dump has come */
+void progress(Dump *d)
 {
-  unsigned char bytes[8];
-  int byte, i;
+  double t = now();
+  char line[128];
+
+  if (t - reported < STATSEVERY) return;
+  reported = t;
+  sprintf(line, "stats progress records %lu bytes %.0f seconds %.0f",
+          d->records, d->tally * 2.0, t - started);
+  logline(line);
+}
 
-  for (i = 0; i < 8; i++) {
-  	if ((byte = getbyte()) < 0) { errno = 0;
-  		die(FAILHARD, "unexpected end of file");
-  	}
-  	else switch (endian) {
-  		case ENDIAN_BIG: bytes[7-i] = byte; break;
-  		case ENDIAN_LITTLE: bytes[i] = byte; break;
-  		default: abort();
-  	}
+void statsmerge(Stats *stats, const Stats *other)
+{
+  int i;
+
+  stats->read += other->read;
+  stats->decode += other->decode;
+  stats->bbox += other->bbox;
+  stats->format += other->format;
+  stats->write += other->write;
+  stats->other += other->other;
+  for (i = 0; i <= NTYPES; i++) stats->types[i] += other->types[i];
+  for (i = 0; i < NBUCKETS; i++) {
+  	stats->parts[i] += other->parts[i];
+  	stats->points[i] += other->points[i];
   }
-  return *(double *) bytes;
 }
 
-Point getpoint(void)
+/* Histogram bucket of a count: 0, 1, 2-3, 4-7, etc. */
+static int bucket(Integer n)
 {
-  Point point;
-  point.x = getdouble();
-  point.y = getdouble();
-  return point;
+  int k = 0;
+
+  while ((n > 0) && (k < NBUCKETS-1)) { n >>= 1; k++; }
+  return k;
+}
+
+static const char *bucketname(int k)
+{
+  static char name[32];
+
+  if (k < 2) sprintf(name, "%d", k);
+  else sprintf(name, "%lu-%lu", 1UL << (k-1), (1UL << (k-1)) * 2 - 1);
+  return name;
+}
+
+double now(void)
+{
+  struct timespec ts;
+
+  (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The reader sets errno for system errors, 0 for bad input */
+void badread(Dump *d)
+{
+  fail(d, errno ? FAILSOFT : FAILHARD, shprerror(d->in));
 }
 
 /* Translate numeric shape types to descriptive strings.
@@ -585,40 +2209,335 @@ char *shptype(int type)
   }
 }
 
-void putint(const char *label, Integer value)
+int shpvalidtype(int type)
+{
+  switch (type) {
+    case SHP_TYPE_NULL:
+    case SHP_TYPE_POINT: case SHP_TYPE_POLYLINE:
+    case SHP_TYPE_POLYGON: case SHP_TYPE_MULTIPOINT:
+    case SHP_TYPE_POINTZ: case SHP_TYPE_POLYLINEZ:
+    case SHP_TYPE_POLYGONZ: case SHP_TYPE_MULTIPOINTZ:
+    case SHP_TYPE_POINTM: case SHP_TYPE_POLYLINEM:
+    case SHP_TYPE_POLYGONM: case SHP_TYPE_MULTIPOINTM:
+    case SHP_TYPE_MULTIPATCH:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+char *parttype(int type)
+{
+  switch (type) {
+    case 0:  return "TriangleStrip";
+    case 1:  return "TriangleFan";
+    case 2:  return "OuterRing";
+    case 3:  return "InnerRing";
+    case 4:  return "FirstRing";
+    case 5:  return "Ring";
+    default: return "Unknown";
+  }
+}
+
+void putint(Dump *d, const char *label, Integer value)
 {
   assert(label);
-  printf("%s "FINT"\n", label, value);
+  putf(d, "%s "FINT"\n", label, value);
 }
 
-void putname(const char *label, const char *name)
+void putname(Dump *d, const char *label, const char *name)
 {
   assert(label);
-  printf("%s %s\n", label, name ? name : "(null)");
+  putf(d, "%s %s\n", label, name ? name : "(null)");
 }
 
-void putrange(const char *label, Double min, Double max)
+void putrange(Dump *d, const char *label, Double min, Double max)
 {
   assert(label);
-  printf("%s %.*f %.*f\n", label, prec, min, prec, max);
+  putf(d, "%s %.*f %.*f\n", label, prec, min, prec, max);
 }
 
-void putbbox(Double xmin, Double ymin, Double xmax, Double ymax)
+void putbbox(Dump *d, Double xmin, Double ymin, Double xmax, Double ymax)
 {
-  printf("bbox %.*f %.*f %.*f %.*f\n",
+  putf(d, "bbox %.*f %.*f %.*f %.*f\n",
   	prec, xmin, prec, ymin, prec, xmax, prec, ymax);
 }
 
-void putpoint(Double xcoord, Double ycoord, int gflag)
+/* Points are by far the most frequent output, so format them
+ * straight into the output buffer, bypassing putf().
+ */
+
+void putpoint(Dump *d, Double xcoord, Double ycoord, int gflag)
+{
+  char *p = putroom(d, 2*FMTFIXLEN(prec) + 3);
+  char *q = p;
+
+  if (!gflag) *q++ = ' ';
+  q += fmtfix(q, xcoord, prec);
+  *q++ = gflag ? ',' : ' ';
+  q += fmtfix(q, ycoord, prec);
+  *q++ = '\n';
+  putbuf(d, 0, q - p);
+}
+
+/* Append " z value" (label " z "), or ",value" for GENERATE */
+static char *putcoord(char *q, const char *label, Double value, int gflag)
+{
+  if (gflag) *q++ = ',';
+  else { memcpy(q, label, 3); q += 3; }
+  return q + fmtfix(q, value, prec);
+}
+
+static char *putxy(char *q, Double x, Double y, int gflag)
+{
+  if (!gflag) *q++ = ' ';
+  q += fmtfix(q, x, prec);
+  *q++ = gflag ? ',' : ' ';
+  return q + fmtfix(q, y, prec);
+}
+
+void putpointz(Dump *d, Double x, Double y, Double z, int gflag)
 {
-  if (gflag) printf("%.*f,%.*f\n", prec, xcoord, prec, ycoord);
-  else printf(" %.*f %.*f\n", prec, xcoord, prec, ycoord);
+  char *p = putroom(d, 3*FMTFIXLEN(prec) + 6);
+  char *q = putxy(p, x, y, gflag);
+
+  q = putcoord(q, " z ", z, gflag);
+  *q++ = '\n';
+  putbuf(d, 0, q - p);
 }
 
-void putpointz(Double x, Double y, Double z, Double m, int gflag)
+void putpointm(Dump *d, Double x, Double y, Double m, int gflag)
 {
-  if (gflag) printf("%.*f,%.*f,%.*f,%.*f\n", prec,x, prec,y, prec,z, prec,m);
-  else printf(" %.*f %.*f z %.*f m %.*f\n", prec,x, prec,y, prec,z, prec,m);
+  char *p = putroom(d, 3*FMTFIXLEN(prec) + 6);
+  char *q = putxy(p, x, y, gflag);
+
+  q = putcoord(q, " m ", m, gflag);
+  *q++ = '\n';
+  putbuf(d, 0, q - p);
+}
+
+void putpointzm(Dump *d, Double x, Double y, Double z, Double m, int gflag)
+{
+  char *p = putroom(d, 4*FMTFIXLEN(prec) + 9);
+  char *q = putxy(p, x, y, gflag);
+
+  q = putcoord(q, " z ", z, gflag);
+  q = putcoord(q, " m ", m, gflag);
+  *q++ = '\n';
+  putbuf(d, 0, q - p);
+}
+
+/* For -f: a decoded record in the output format */
+void putshape(Dump *d, Integer id, const WkbShape *s, Integer *owner)
+{
+  size_t len;
+  int k;
+
+  if (d->quiet) return;
+  if (fflag != FORMAT_ARROW) { putwkb(d, id, s, owner); return; }
+  for (k = 0; k < nattrs; k++) {
+  	const char *v = dbfvalue(d->recno, k, &len);
+  	if (v) arrowattr(k, v, len);
+  }
+  switch (arrowadd(id, s, owner)) {
+  	case 0: break;
+  	case 1: warn(d, "shape type differs from header, written as null"); break;
+  	default: fail(d, FAILSOFT, "out of memory");
+  }
+}
+
+/* The Arrow writer's output: the main thread's buffer */
+void putarrow(const void *buf, size_t len)
+{
+  putbuf(&top, (const char *) buf, len);
+}
+
+void endarrow(Dump *d)
+{
+  if ((fflag == FORMAT_ARROW) && !cflag && (arrowclose() < 0))
+  	fail(d, FAILSOFT, "out of memory");
+}
+
+/* A record as WKB, after its number and the length of
+ * the WKB as little endian 32-bit integers, or as a line with
+ * the number and the WKB in hex. The -a columns follow, each
+ * with its length (-1 if the .dbf has no row), or after tabs.
+ */
+static unsigned char *putle(unsigned char *p, unsigned long v)
+{
+  int i;
+
+  for (i = 0; i < 4; i++) p[i] = (unsigned char) ((v >> 8*i) & 255);
+  return p + 4;
+}
+
+/* Copy a value into a line: control characters become blanks */
+static char *putvalue(char *q, const char *v, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++) q[i] = ((unsigned char) v[i] < ' ') ? ' ' : v[i];
+  return q + len;
+}
+
+void putwkb(Dump *d, Integer id, const WkbShape *s, Integer *owner)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  size_t size, more = 0, len, i, k;
+  unsigned char *p, *q;
+  const char *v;
+  int a;
+
+  size = wkbsize(s, owner);
+  for (a = 0; a < nattrs; a++)
+  	if (dbfvalue(d->recno, a, &len)) more += len;
+  if (fflag == FORMAT_WKB) {
+  	p = (unsigned char *) putroom(d, 8 + size + 4*nattrs + more);
+  	q = putle(putle(p, (unsigned long) id), size);
+  	wkbwrite(q, s, owner);
+  	q += size;
+  	for (a = 0; a < nattrs; a++) {
+  		if ((v = dbfvalue(d->recno, a, &len)) == NULL) {
+  			q = putle(q, 0xFFFFFFFFUL);
+  			continue;
+  		}
+  		q = putle(q, len);
+  		memcpy(q, v, len);
+  		q += len;
+  	}
+  	putbuf(d, 0, q - p);
+  	return;
+  }
+  p = (unsigned char *) putroom(d, 12 + 2*size + nattrs + more + 1);
+  k = sprintf((char *) p, FINT" ", id);
+  wkbwrite(p + k + size, s, owner);  /* then spread it out in place */
+  for (i = 0; i < size; i++) {
+  	unsigned char c = p[k + size + i];
+  	p[k + 2*i] = hex[c >> 4];
+  	p[k + 2*i + 1] = hex[c & 15];
+  }
+  q = p + k + 2*size;
+  for (a = 0; a < nattrs; a++) {
+  	*q++ = '\t';
+  	if ((v = dbfvalue(d->recno, a, &len)))
+  		q = (unsigned char *) putvalue((char *) q, v, len);
+  }
+  *q++ = '\n';
+  putbuf(d, 0, q - p);
+}
+
+/* For -a: a line "field name value" per column, if there's a row */
+void putattrs(Dump *d)
+{
+  const char *v, *name;
+  size_t len, n;
+  char *p, *q;
+  int a;
+
+  for (a = 0; a < nattrs; a++) {
+  	if ((v = dbfvalue(d->recno, a, &len)) == NULL) continue;
+  	name = dbfcolumn(a);
+  	n = strlen(name);
+  	p = putroom(d, 8 + n + len);
+  	memcpy(p, "field ", 6);
+  	memcpy(p + 6, name, n);
+  	q = p + 6 + n;
+  	*q++ = ' ';
+  	q = putvalue(q, v, len);
+  	*q++ = '\n';
+  	putbuf(d, 0, q - p);
+  }
+}
+
+/* Output (buffered to stdout, or kept by workers) */
+
+/* putf: printf subset: %s %c %d %ld %.*f %% */
+static void putf(Dump *d, const char *fmt, ...)
+{
+  va_list ap;
+  const char *p;
+
+  va_start(ap, fmt);
+  while (*fmt) {
+    for (p = fmt; *p && (*p != '%'); p++);
+    if (p > fmt) putbuf(d, fmt, p - fmt);
+    if (!*p) break;
+    switch (*++p) {
+      case 's': putstr(d, va_arg(ap, const char *)); break;
+      case 'c': *putroom(d, 1) = (char) va_arg(ap, int); putbuf(d, 0, 1); break;
+      case 'd': putlong(d, va_arg(ap, int)); break;
+      case 'l': assert(p[1] == 'd'); p++; putlong(d, va_arg(ap, long)); break;
+      case '.': assert(p[1] == '*' && p[2] == 'f'); p += 2;
+                { int pr = va_arg(ap, int); Double v = va_arg(ap, Double);
+                  putbuf(d, 0, fmtfix(putroom(d, FMTFIXLEN(pr)), v, pr)); }
+                break;
+      case '%': putbuf(d, "%", 1); break;
+      default: abort();
+    }
+    fmt = p + 1;
+  }
+  va_end(ap);
+}
+
+static void putstr(Dump *d, const char *s)
+{
+  putbuf(d, s, strlen(s));
+}
+
+static void putlong(Dump *d, long value)
+{
+  char buf[3*sizeof(long)+2];
+  char *p = buf + sizeof buf;
+  unsigned long u = (value < 0) ? -(unsigned long) value : (unsigned long) value;
+
+  do *--p = '0' + (char) (u % 10); while ((u /= 10) > 0);
+  if (value < 0) *--p = '-';
+  putbuf(d, p, buf + sizeof buf - p);
+}
+
+/* append len bytes from s, or commit len bytes that were
+ * written in place at putroom() if s is null */
+static void putbuf(Dump *d, const char *s, size_t len)
+{
+  if (d->quiet) return;
+  if (s) memcpy(putroom(d, len), s, len);
+  d->len += len;
+}
+
+/* return pointer to at least len free bytes in the buffer,
+ * which is flushed when full, unless we keep it: then it grows */
+static char *putroom(Dump *d, size_t len)
+{
+  if (d->size - d->len < len) {
+    if (!d->keep) putflush(d);
+    if (d->size - d->len < len) {
+      size_t size = d->size ? d->size : OUTBUFSIZE;
+      char *buf;
+      while (size - d->len < len) size *= 2;
+      if ((buf = (char *) realloc(d->buf, size)) == NULL)
+        fail(d, FAILSOFT, "out of memory");
+      d->buf = buf;
+      d->size = size;
+    }
+  }
+  return d->buf + d->len;
+}
+
+static void putflush(Dump *d)
+{
+  size_t len = d->len;
+  double t, w;
+
+  d->len = 0;  /* don't retry if die() flushes */
+  if (len == 0) return;
+  t = statsflag ? now() : 0;
+  if (shipout(stdout, d->buf, len) < 0)
+    die(FAILSOFT, "cannot write output");
+  if (statsflag) {  /* not part of the phase that filled the buffer */
+    w = now() - t;
+    d->stats.write += w;
+    d->stats.last += w;
+  }
 }
 
 /* Logging (unbuffered to stderr) */
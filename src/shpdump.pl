@@ -5,6 +5,9 @@
 #
 # ujr/2006-04-11 started
 # ujr/2007-07-20 added field for precision parameter
+#
+# Set $SHPDUMPSOCK to the socket of a shpdump started with -l
+# to send it the requests, instead of running shpdump for each.
 
 use strict;
 use CGI;
@@ -15,6 +18,7 @@ my $VERSION = '2006-04-11';
 my $CONTACT = 'uruetsch@geo.unizh.ch';
 my $SHPDUMPURL = 'http://www.geo.unizh.ch/~uruetsch/software/shpdump.html';
 my $SHPDUMPBIN = './shpdump';
+my $SHPDUMPSOCK = '';  # like '/var/run/shpdump.sock' for shpdump -l
 
 my $cgi = new CGI;
 my $script = $cgi->script_name();
@@ -36,8 +40,28 @@ if ($shapefile) {
   $options .= " -h" if ($cgi->param('h'));
   $options .= " -v" if ($cgi->param('v'));
   $options .= " -x" if ($cgi->param('x'));
-  if ($cgi->param('prec')) {
-    $options .= " -p " . $cgi->param('prec');
+  my $prec = $cgi->param('prec');
+  if (defined $prec && $prec =~ /^\d{1,3}\z/) {  # into a command line
+    $options .= " -p $prec";
+  }
+
+  if ($SHPDUMPSOCK) {
+  	require IO::Socket::UNIX;
+  	my $sock = IO::Socket::UNIX->new(Peer => $SHPDUMPSOCK);
+  	if ($sock) {
+  		my $chunk; # request line, then the upload
+  		print $sock "$options\n";
+  		while (read $shapefile, $chunk, 65536) {
+  			print $sock $chunk;
+  		}
+  		$sock->shutdown(1);
+  		while (read $sock, $chunk, 65536) {
+  			print $chunk;
+  		}
+  		close $sock;
+  		print "end\n" unless ($cgi->param('g'));
+  		exit 0;
+  	}
   }
 
   my $outname = "|$SHPDUMPBIN$options 2>&1";
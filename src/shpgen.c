@@ -0,0 +1,367 @@
+/* shpgen - generate a synthetic shapefile for benchmarks | GPL
+ *
+ * Usage: shpgen [-t type] [-n recs] [-p parts] [-P points] [-s seed] name
+ *
+ * Write name.shp and name.shx with recs records of the given type
+ * (a number or a name like polygon or polylinez; default polygon),
+ * each with the given number of parts (default 1) and points per
+ * part (default 10; all points for multipoints). The shapes are
+ * scattered over the world and valid: polygon rings are closed,
+ * outer rings clockwise, holes counter-clockwise inside them. The
+ * same seed gives the same file. All records have the same size,
+ * so the size of the file is known in advance: 52 + 4*parts +
+ * 16*points bytes per polyline or polygon record, plus 16 +
+ * 8*points each for Z and M values, after a 100-byte header.
+ *
+ * Exit codes: 0 ok, 111 troubles writing, 127 invalid arguments.
+ */
+
+#include "shapefile.h"
+#include "endian.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FAILSOFT 111
+#define FAILHARD 127
+
+static const char usage[] =
+  "Usage: shpgen [-t type] [-n recs] [-p parts] [-P points] [-s seed] name\n";
+
+static const struct { const char *name; int type; } types[] = {
+  { "point", SHP_TYPE_POINT }, { "polyline", SHP_TYPE_POLYLINE },
+  { "polygon", SHP_TYPE_POLYGON }, { "multipoint", SHP_TYPE_MULTIPOINT },
+  { "pointz", SHP_TYPE_POINTZ }, { "polylinez", SHP_TYPE_POLYLINEZ },
+  { "polygonz", SHP_TYPE_POLYGONZ }, { "multipointz", SHP_TYPE_MULTIPOINTZ },
+  { "pointm", SHP_TYPE_POINTM }, { "polylinem", SHP_TYPE_POLYLINEM },
+  { "polygonm", SHP_TYPE_POLYGONM }, { "multipointm", SHP_TYPE_MULTIPOINTM },
+  { "multipatch", SHP_TYPE_MULTIPATCH }
+};
+
+static int big;  /* host is big endian */
+static unsigned long seed = 1;
+static int type = SHP_TYPE_POLYGON;
+static int family;  /* type without Z or M */
+static long nparts = 1, npoints = 10;  /* per record: npoints * nparts */
+static int hasz, hasm;
+static Point *points;
+static Double *zs, *ms;
+static BoundingBox extent;  /* of all shapes, for the header */
+static Double zmin, zmax, mmin, mmax;
+
+static void die(int code, const char *info);
+static int gettype(const char *s);
+static void shape(void);
+static void bounds(const Point *v, long n, BoundingBox *box);
+static void range(const Double *v, long n, Double *min, Double *max);
+static Double random01(void);
+static unsigned char *putint(unsigned char *p, long v);
+static unsigned char *putbig(unsigned char *p, long v);
+static unsigned char *putdouble(unsigned char *p, Double v);
+static unsigned char *putvalues(unsigned char *p, const Double *v, long n,
+                                Double min, Double max);
+static void putheader(FILE *fp, unsigned long words);
+static void write1(FILE *fp, const unsigned char *p, size_t n);
+
+int main(int argc, char *argv[])
+{
+  extern int optind;
+  extern char *optarg;
+  char shpname[256], shxname[256];
+  unsigned char head[8], *buf, *p;
+  long recs = 1000, total, i, j, length;
+  BoundingBox box;
+  Double zlo, zhi, mlo, mhi;
+  double words;
+  FILE *shp, *shx;
+  int c;
+
+  big = (getendian() == ENDIAN_BIG);
+  while ((c = getopt(argc, argv, "t:n:p:P:s:")) != -1) switch (c) {
+    case 't': if ((type = gettype(optarg)) < 0) { errno = 0; die(FAILHARD, "invalid type"); } break;
+    case 'n': recs = atol(optarg); break;
+    case 'p': nparts = atol(optarg); break;
+    case 'P': npoints = atol(optarg); break;
+    case 's': seed = strtoul(optarg, 0, 10); break;
+    default: fputs(usage, stderr); exit(FAILHARD);
+  }
+  if (optind != argc - 1) { fputs(usage, stderr); exit(FAILHARD); }
+  errno = 0;
+  if ((recs < 0) || (nparts < 1) || (npoints < 1)) die(FAILHARD, "invalid count");
+
+  family = (type == SHP_TYPE_MULTIPATCH) ? type : type % 10;
+  hasz = (type / 10 == 1) || (type == SHP_TYPE_MULTIPATCH);
+  hasm = hasz || (type / 10 == 2);
+  if (family == SHP_TYPE_POINT) nparts = npoints = 1;
+  if (family == SHP_TYPE_MULTIPOINT) nparts = 1;
+  if (((family == SHP_TYPE_POLYGON) || (type == SHP_TYPE_MULTIPATCH)) && (npoints < 4))
+    die(FAILHARD, "need 4 points per ring");
+  total = nparts * npoints;
+  if (total / nparts != npoints) die(FAILHARD, "too many points");
+
+  /* content length of each record, in bytes */
+  switch (family) {
+    case SHP_TYPE_POINT:      length = 20 + 8*hasz + 8*hasm; break;
+    case SHP_TYPE_MULTIPOINT: length = 40 + 16*total; break;
+    default:                  length = 44 + 4*nparts + 16*total;
+  }
+  if (type == SHP_TYPE_MULTIPATCH) length += 4*nparts;
+  if (family != SHP_TYPE_POINT) length += (16 + 8*total) * (hasz + hasm);
+  words = 50 + (double) recs * (4 + length/2);
+  if ((length > 0x7FFFFFFFL) || (words > 0x7FFFFFFFL)) die(FAILHARD, "too large for a shapefile");
+
+  if ((strlen(argv[optind]) + 5 > sizeof shpname)) die(FAILHARD, "name too long");
+  sprintf(shpname, "%s%s", argv[optind], SHAPE_SUFFIX);
+  sprintf(shxname, "%s%s", argv[optind], INDEX_SUFFIX);
+  buf = malloc((size_t) length);
+  points = malloc((size_t) total * sizeof(Point));
+  zs = malloc((size_t) total * sizeof(Double));
+  ms = malloc((size_t) total * sizeof(Double));
+  if (!buf || !points || !zs || !ms) die(FAILSOFT, "out of memory");
+  if ((shp = fopen(shpname, "wb")) == NULL) die(FAILSOFT, shpname);
+  if ((shx = fopen(shxname, "wb")) == NULL) die(FAILSOFT, shxname);
+  putheader(shp, 0);  /* extent still unknown */
+  putheader(shx, 0);
+
+  for (i = 1; i <= recs; i++) {
+    shape();
+    bounds(points, total, &box);
+    range(zs, total, &zlo, &zhi);
+    range(ms, total, &mlo, &mhi);
+    p = putint(buf, type);
+    if (family == SHP_TYPE_POINT) {
+      p = putdouble(p, points[0].x);
+      p = putdouble(p, points[0].y);
+      if (hasz) p = putdouble(p, zs[0]);
+      if (hasm) p = putdouble(p, ms[0]);
+    }
+    else {
+      p = putdouble(p, box.xmin); p = putdouble(p, box.ymin);
+      p = putdouble(p, box.xmax); p = putdouble(p, box.ymax);
+      if (family != SHP_TYPE_MULTIPOINT) p = putint(p, nparts);
+      p = putint(p, total);
+      if (family != SHP_TYPE_MULTIPOINT)
+        for (j = 0; j < nparts; j++) p = putint(p, j * npoints);
+      if (type == SHP_TYPE_MULTIPATCH)
+        for (j = 0; j < nparts; j++)
+          p = putint(p, j ? SHP_PART_INNERRING : SHP_PART_OUTERRING);
+      for (j = 0; j < total; j++) {
+        p = putdouble(p, points[j].x);
+        p = putdouble(p, points[j].y);
+      }
+      if (hasz) p = putvalues(p, zs, total, zlo, zhi);
+      if (hasm) p = putvalues(p, ms, total, mlo, mhi);
+    }
+    if (i == 1) {
+      extent = box;
+      zmin = zlo; zmax = zhi;
+      mmin = mlo; mmax = mhi;
+    }
+    else {
+      if (box.xmin < extent.xmin) extent.xmin = box.xmin;
+      if (box.ymin < extent.ymin) extent.ymin = box.ymin;
+      if (box.xmax > extent.xmax) extent.xmax = box.xmax;
+      if (box.ymax > extent.ymax) extent.ymax = box.ymax;
+      if (zlo < zmin) zmin = zlo;
+      if (zhi > zmax) zmax = zhi;
+      if (mlo < mmin) mmin = mlo;
+      if (mhi > mmax) mmax = mhi;
+    }
+    if (p - buf != length) die(FAILHARD, "internal error");
+
+    putbig(head, i);
+    putbig(head + 4, length / 2);
+    write1(shp, head, 8);
+    write1(shp, buf, (size_t) length);
+    putbig(head, (long) (50 + (i - 1) * (4 + length/2)));  /* offset */
+    write1(shx, head, 8);
+  }
+  if (!hasz) zmin = zmax = 0;
+  if (!hasm) mmin = mmax = 0;
+
+  rewind(shp);
+  putheader(shp, (unsigned long) words);
+  rewind(shx);
+  putheader(shx, (unsigned long) (50 + 4*recs));
+  if ((fclose(shp) != 0) || (fclose(shx) != 0)) die(FAILSOFT, "cannot write");
+  return 0;
+}
+
+static void die(int code, const char *info)
+{
+  fprintf(stderr, "shpgen: %s", info);
+  if (errno) fprintf(stderr, ": %s", strerror(errno));
+  fputc('\n', stderr);
+  exit(code);
+}
+
+static int gettype(const char *s)
+{
+  size_t i;
+  char *end;
+  long n = strtol(s, &end, 10);
+
+  if ((end > s) && !*end) {
+    for (i = 0; i < sizeof types / sizeof types[0]; i++)
+      if (types[i].type == n) return (int) n;
+    return -1;
+  }
+  for (i = 0; i < sizeof types / sizeof types[0]; i++)
+    if (!strcmp(types[i].name, s)) return types[i].type;
+  return -1;
+}
+
+/* The points (and Z and M values) of the next record: rings around
+ * a random center for polygons, random walks for polylines, a
+ * cloud for multipoints; Z random, M the distance along the part */
+static void shape(void)
+{
+  const Double pi = 3.14159265358979323846;
+  Double cx = random01() * 340 - 170, cy = random01() * 160 - 80;
+  Double r = 0.01 + random01(), k, d, a, x, y;
+  long i, j, n = npoints, h = nparts - 1;
+  Point *v;
+
+  for (j = 0; j < nparts; j++) {
+    v = points + j * n;
+    switch (family) {
+      case SHP_TYPE_POLYGON:
+      case SHP_TYPE_MULTIPATCH:
+        /* outer ring clockwise, holes counter-clockwise and small
+         * enough to stay inside even a triangle */
+        k = 0.9 * cos(pi / (n - 1));
+        if (j == 0) { x = cx; y = cy; d = r; }
+        else {
+          a = 2 * pi * (j - 1) / h;
+          x = cx + ((h > 1) ? k * r / 2 : 0) * cos(a);
+          y = cy + ((h > 1) ? k * r / 2 : 0) * sin(a);
+          d = k * r * 0.4 / h;
+        }
+        for (i = 0; i < n - 1; i++) {
+          a = 2 * pi * i / (n - 1) * (j ? 1 : -1);
+          v[i].x = x + d * cos(a);
+          v[i].y = y + d * sin(a);
+        }
+        v[n-1] = v[0];
+        break;
+      case SHP_TYPE_MULTIPOINT:
+        for (i = 0; i < n; i++) {
+          v[i].x = cx + r * (2 * random01() - 1);
+          v[i].y = cy + r * (2 * random01() - 1);
+        }
+        break;
+      case SHP_TYPE_POLYLINE:
+        v[0].x = cx + r * (2 * random01() - 1);
+        v[0].y = cy + r * (2 * random01() - 1);
+        for (i = 1; i < n; i++) {
+          v[i].x = v[i-1].x + r / n * (2 * random01() - 1);
+          v[i].y = v[i-1].y + r / n * (2 * random01() - 1);
+        }
+        break;
+      default:
+        v[0].x = cx;
+        v[0].y = cy;
+    }
+    for (i = 0; i < n; i++) {
+      zs[j*n + i] = 1000 * random01();
+      ms[j*n + i] = i ? ms[j*n + i-1] + sqrt((v[i].x - v[i-1].x) * (v[i].x - v[i-1].x) +
+                                             (v[i].y - v[i-1].y) * (v[i].y - v[i-1].y)) : 0;
+    }
+  }
+}
+
+/* A 32-bit linear congruential generator: the same numbers everywhere */
+static Double random01(void)
+{
+  seed = (seed * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+  return (Double) (seed >> 8) / 16777216.0;
+}
+
+static unsigned char *putint(unsigned char *p, long v)
+{
+  unsigned long u = (unsigned long) v;
+
+  p[0] = u & 0xFF; p[1] = (u >> 8) & 0xFF;
+  p[2] = (u >> 16) & 0xFF; p[3] = (u >> 24) & 0xFF;
+  return p + 4;
+}
+
+static unsigned char *putbig(unsigned char *p, long v)
+{
+  unsigned long u = (unsigned long) v;
+
+  p[3] = u & 0xFF; p[2] = (u >> 8) & 0xFF;
+  p[1] = (u >> 16) & 0xFF; p[0] = (u >> 24) & 0xFF;
+  return p + 4;
+}
+
+static unsigned char *putdouble(unsigned char *p, Double v)
+{
+  unsigned char *q = (unsigned char *) &v;
+  int i;
+
+  for (i = 0; i < 8; i++) p[i] = q[big ? 7 - i : i];
+  return p + 8;
+}
+
+static void bounds(const Point *v, long n, BoundingBox *box)
+{
+  long i;
+
+  box->xmin = box->xmax = v[0].x;
+  box->ymin = box->ymax = v[0].y;
+  for (i = 1; i < n; i++) {
+    if (v[i].x < box->xmin) box->xmin = v[i].x;
+    if (v[i].x > box->xmax) box->xmax = v[i].x;
+    if (v[i].y < box->ymin) box->ymin = v[i].y;
+    if (v[i].y > box->ymax) box->ymax = v[i].y;
+  }
+}
+
+static void range(const Double *v, long n, Double *min, Double *max)
+{
+  long i;
+
+  *min = *max = v[0];
+  for (i = 1; i < n; i++) {
+    if (v[i] < *min) *min = v[i];
+    if (v[i] > *max) *max = v[i];
+  }
+}
+
+/* The range of n values, then the values */
+static unsigned char *putvalues(unsigned char *p, const Double *v, long n,
+                                Double min, Double max)
+{
+  long i;
+
+  p = putdouble(p, min);
+  p = putdouble(p, max);
+  for (i = 0; i < n; i++) p = putdouble(p, v[i]);
+  return p;
+}
+
+static void putheader(FILE *fp, unsigned long words)
+{
+  unsigned char head[100], *p = head;
+
+  memset(head, 0, sizeof head);
+  putbig(p, SHP_MAGIC);
+  putbig(p + 24, (long) words);
+  p = putint(p + 28, 1000);
+  p = putint(p, type);
+  p = putdouble(p, extent.xmin); p = putdouble(p, extent.ymin);
+  p = putdouble(p, extent.xmax); p = putdouble(p, extent.ymax);
+  p = putdouble(p, zmin); p = putdouble(p, zmax);
+  p = putdouble(p, mmin); p = putdouble(p, mmax);
+  write1(fp, head, sizeof head);
+}
+
+static void write1(FILE *fp, const unsigned char *p, size_t n)
+{
+  if (fwrite(p, 1, n, fp) != n) die(FAILSOFT, "cannot write");
+}
@@ -0,0 +1,634 @@
+/* shpload - write a shapefile from what shpdump wrote | GPL
+ *
+ * Usage: shpload [-t type] name [dump]
+ *
+ * Read the text or GENERATE (-g) output of shpdump from the file
+ * dump (which may be gzip compressed) or stdin, and write name.shp
+ * and name.shx with its shapes, numbered from 1, and the bboxes
+ * and ranges of Z and M values of each shape and of all of them.
+ * The text gives the shape type ("type PolygonZ"), else the first
+ * shape does, but GENERATE has it only for plain points; -t gives
+ * it (a name like polygon or polylinez, as for shpgen), or tells
+ * that 3 values are x, y and m. Header lines, -v bboxes and -a
+ * fields are skipped. The shapefile has the precision of the dump:
+ * dump with -p 22 to get the very same shapes back, unless they're
+ * tiny.
+ *
+ * The input is read in large blocks (or mapped), each shape is
+ * kept in memory until it is written, and the output goes out in
+ * large blocks: memory stays the size of the largest shape, and a
+ * dump of any size is read once, start to end.
+ *
+ * Exit codes: 0 ok, 1 shapes that don't match their headers (as
+ * written), 111 troubles reading or writing, 127 invalid arguments
+ * or input.
+ */
+
+#include "shapefile.h"
+#include "endian.h"
+#include "fmt.h"
+#include "index.h"
+#include "input.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define FAILSOFT 111
+#define FAILHARD 127
+#define MAXLINE 4096
+#define OUTBUFSIZE (1024*1024)
+
+static const char usage[] = "Usage: shpload [-t type] name [dump]\n";
+
+static const struct { const char *name; int type; } types[] = {
+  { "null", SHP_TYPE_NULL },
+  { "point", SHP_TYPE_POINT }, { "polyline", SHP_TYPE_POLYLINE },
+  { "polygon", SHP_TYPE_POLYGON }, { "multipoint", SHP_TYPE_MULTIPOINT },
+  { "pointz", SHP_TYPE_POINTZ }, { "polylinez", SHP_TYPE_POLYLINEZ },
+  { "polygonz", SHP_TYPE_POLYGONZ }, { "multipointz", SHP_TYPE_MULTIPOINTZ },
+  { "pointm", SHP_TYPE_POINTM }, { "polylinem", SHP_TYPE_POLYLINEM },
+  { "polygonm", SHP_TYPE_POLYGONM }, { "multipointm", SHP_TYPE_MULTIPOINTM },
+  { "multipatch", SHP_TYPE_MULTIPATCH }
+};
+
+static const char *parttypes[] = {  /* as shpdump names them */
+  "TriangleStrip", "TriangleFan", "OuterRing", "InnerRing", "FirstRing", "Ring"
+};
+
+typedef struct {           /* the shape being read */
+  int open;                /* 1 while its points come */
+  int family;              /* SHP_TYPE_POINT, ..._POLYLINE etc. */
+  long id;                 /* as in the dump */
+  long wantparts, wantpoints;  /* as its header says, or -1 */
+  int hasz, hasm;          /* some of its points have them */
+  Integer nparts, npoints;
+  Integer *parts, *types;
+  Point *points;
+  Double *z, *m;
+  size_t room, partroom;   /* for points, parts */
+} Shape;
+
+static int big;            /* host is big endian */
+static int type = -1;      /* of the shapefile, once known */
+static int typegiven = 0;  /* by -t */
+static int generate = 0;   /* the input is GENERATE */
+static Input in;
+static char line[MAXLINE];
+static unsigned long lineno = 0;
+static Shape shape;
+static FILE *shp;
+static char shpfile[256], shxfile[256];
+static unsigned long offset = 100;  /* in .shp, bytes */
+static long recno = 0;     /* of the last shape written */
+static unsigned long warnings = 0;
+static unsigned char *buf = 0;  /* a record */
+static size_t bufsize = 0;
+static BoundingBox extent; /* of all shapes, for the header */
+static Double zmin = DBL_MAX, zmax = -DBL_MAX, mmin = DBL_MAX, mmax = -DBL_MAX;
+
+static void die(int code, const char *info);
+static void warn(const char *info);
+static int gettype(const char *s);
+static int family(int t);
+static char *nextline(void);
+static void text(char *s);
+static void gen(char *s);
+static void begin(int fam, long id);
+static void addpart(int ptype);
+static void addpoint(const Double *v, int hasz, int hasm);
+static int numbers(char *s, Double *v, int max);
+static void settype(int fam, int hasz, int hasm);
+static void flush(void);
+static void putrecord(const unsigned char *p, size_t n);
+static unsigned char *room(size_t n);
+static unsigned char *putint(unsigned char *p, long v);
+static unsigned char *putbig(unsigned char *p, long v);
+static unsigned char *putdouble(unsigned char *p, Double v);
+static void putheader(unsigned long words);
+
+int main(int argc, char *argv[])
+{
+  extern int optind;
+  extern char *optarg;
+  static char obuf[OUTBUFSIZE];
+  MainHeader h;
+  char *s;
+  int c, fd = 0;
+
+  big = (getendian() == ENDIAN_BIG);
+  while ((c = getopt(argc, argv, "t:")) != -1) switch (c) {
+    case 't': if ((type = gettype(optarg)) < 0) { errno = 0; die(FAILHARD, "invalid type"); }
+              typegiven = 1; break;
+    default: fputs(usage, stderr); exit(FAILHARD);
+  }
+  if ((optind != argc - 1) && (optind != argc - 2)) { fputs(usage, stderr); exit(FAILHARD); }
+  errno = 0;
+  if (strlen(argv[optind]) + 5 > sizeof shpfile) die(FAILHARD, "name too long");
+  sprintf(shpfile, "%s%s", argv[optind], SHAPE_SUFFIX);
+  sprintf(shxfile, "%s%s", argv[optind], INDEX_SUFFIX);
+  if ((optind == argc - 2) && ((fd = open(argv[optind+1], O_RDONLY)) < 0))
+    die(FAILHARD, argv[optind+1]);
+  if (inopen(&in, fd) < 0) die(FAILSOFT, "cannot read input");
+
+  if ((shp = fopen(shpfile, "wb")) == NULL) die(FAILSOFT, shpfile);
+  (void) setvbuf(shp, obuf, _IOFBF, sizeof obuf);
+  if (idxcreate(shxfile) < 0) die(FAILSOFT, shxfile);
+  extent.xmin = extent.ymin = DBL_MAX;
+  extent.xmax = extent.ymax = -DBL_MAX;
+  putheader(0);  /* extent still unknown */
+
+  while ((s = nextline()) != NULL) {
+    lineno++;
+    if (lineno == 1) generate = isdigit((unsigned char) *s) || (*s == '-');
+    if (generate) gen(s);
+    else text(s);
+  }
+  flush();
+  inclose(&in);
+
+  errno = 0;
+  if (type < 0) type = SHP_TYPE_NULL;  /* no shapes */
+  if (extent.xmin > extent.xmax) extent.xmin = extent.ymin = extent.xmax = extent.ymax = 0;
+  if (zmin > zmax) zmin = zmax = 0;
+  if (mmin > mmax) mmin = mmax = 0;
+  if (fseek(shp, 0, SEEK_SET) < 0) die(FAILSOFT, shpfile);
+  putheader(offset / 2);
+  if (fclose(shp) != 0) { shp = 0; die(FAILSOFT, shpfile); }
+  shp = 0;
+  h.fileCode = SHP_MAGIC;
+  h.fileLength = 0;  /* idxfinish() knows */
+  h.version = 1000;
+  h.shapeType = type;
+  h.bbox = extent;
+  h.zmin = zmin; h.zmax = zmax;
+  h.mmin = mmin; h.mmax = mmax;
+  if (idxfinish(&h) < 0) die(FAILSOFT, shxfile);
+  return warnings ? 1 : 0;
+}
+
+/* Remove what's written, complain, and exit */
+static void die(int code, const char *info)
+{
+  int err = errno;
+
+  if (shp) {
+    fclose(shp);
+    (void) remove(shpfile);
+    (void) idxfinish(0);
+  }
+  fprintf(stderr, "shpload: ");
+  if (lineno) fprintf(stderr, "line %lu: ", lineno);
+  fprintf(stderr, "%s", info);
+  if (err) fprintf(stderr, ": %s", strerror(err));
+  fputc('\n', stderr);
+  exit(code);
+}
+
+static void warn(const char *info)
+{
+  warnings++;
+  fprintf(stderr, "! line %lu: %s\n", lineno, info);
+}
+
+/* A type by number or name (any case, shpdump's names too) */
+static int gettype(const char *s)
+{
+  size_t i;
+  char *end, name[16];
+  long n = strtol(s, &end, 10);
+
+  if ((end > s) && !*end) {
+    for (i = 0; i < sizeof types / sizeof types[0]; i++)
+      if (types[i].type == n) return (int) n;
+    return -1;
+  }
+  for (i = 0; s[i] && (i < sizeof name - 1); i++) name[i] = tolower((unsigned char) s[i]);
+  name[i] = '\0';
+  for (i = 0; i < sizeof types / sizeof types[0]; i++)
+    if (!strcmp(types[i].name, name)) return types[i].type;
+  return -1;
+}
+
+/* The type without Z or M */
+static int family(int t)
+{
+  return (t == SHP_TYPE_MULTIPATCH) ? t : t % 10;
+}
+
+/* The next line, without its newline, or NULL at the end */
+static char *nextline(void)
+{
+  const unsigned char *nl;
+  size_t n;
+
+  for (;;) {
+    n = in.end - in.ptr;
+    if ((nl = (const unsigned char *) memchr(in.ptr, '\n', n)) != NULL) {
+      n = nl - in.ptr;
+      break;
+    }
+    if (n >= MAXLINE) break;
+    if (in.mapped || (inpeek(&in, n + 1) == NULL)) {
+      if (!in.mapped && errno) die(FAILSOFT, "cannot read input");
+      if (n == 0) return NULL;
+      break;
+    }
+  }
+  if (n >= MAXLINE) { errno = 0; die(FAILHARD, "line too long"); }
+  memcpy(line, in.ptr, n);
+  in.ptr += nl ? n + 1 : n;
+  if ((n > 0) && (line[n-1] == '\r')) n--;
+  line[n] = '\0';
+  return line;
+}
+
+/* A line of text output: a shape's header, a point, a part or
+ * something to skip */
+static void text(char *s)
+{
+  Double v[4];
+  char *end, word[16];
+  long id = 0, a = -1, b = -1;
+  int k, hasz = 0, hasm = 0, fam;
+
+  if (*s == ' ') {  /* " x y [z Z] [m M]" */
+    if (!shape.open) { errno = 0; die(FAILHARD, "point outside of a shape"); }
+    v[0] = fmtscan(s + 1, &end);
+    if ((end == s + 1) || (*end != ' ')) { errno = 0; die(FAILHARD, "invalid point"); }
+    s = end + 1;
+    v[1] = fmtscan(s, &end);
+    if (end == s) { errno = 0; die(FAILHARD, "invalid point"); }
+    for (s = end; *s == ' '; s = end) {
+      if ((s[1] == 'z') && (s[2] == ' ')) { v[2] = fmtscan(s + 3, &end); hasz = 1; }
+      else if ((s[1] == 'm') && (s[2] == ' ')) { v[3] = fmtscan(s + 3, &end); hasm = 1; }
+      else break;
+      if (end == s + 3) break;
+    }
+    if (*s) { errno = 0; die(FAILHARD, "invalid point"); }
+    addpoint(v, hasz, hasm);
+    return;
+  }
+
+  for (k = 0; *s && (*s != ' ') && (k < (int) sizeof word - 1); k++) word[k] = *s++;
+  word[k] = '\0';
+  if (!strcmp(word, "part")) {
+    if (!shape.open) { errno = 0; die(FAILHARD, "part outside of a shape"); }
+    if (*s++ != ' ') addpart(-1);
+    else {
+      for (k = 0; k < (int) (sizeof parttypes / sizeof parttypes[0]); k++)
+        if (!strcmp(s, parttypes[k])) break;
+      if (k == (int) (sizeof parttypes / sizeof parttypes[0])) {
+        errno = 0;
+        die(FAILHARD, "invalid part type");
+      }
+      addpart(k);
+    }
+    return;
+  }
+  if (!strcmp(word, "type")) {
+    if (!*s || ((k = gettype(s + 1)) < 0)) { errno = 0; die(FAILHARD, "invalid type"); }
+    if (!typegiven && (recno == 0) && !shape.open) type = k;
+    return;
+  }
+  if (!strcmp(word, "null")) fam = SHP_TYPE_NULL;
+  else if (!strcmp(word, "point")) fam = SHP_TYPE_POINT;
+  else if (!strcmp(word, "multipoint")) fam = SHP_TYPE_MULTIPOINT;
+  else if (!strcmp(word, "line")) fam = SHP_TYPE_POLYLINE;
+  else if (!strcmp(word, "polygon")) fam = SHP_TYPE_POLYGON;
+  else if (!strcmp(word, "patch")) fam = SHP_TYPE_MULTIPATCH;
+  else if (!strcmp(word, "shape")) {  /* of an unknown type */
+    flush();
+    warn("shape of unknown type skipped");
+    return;
+  }
+  else return;  /* header, bbox, zrange, field... */
+
+  flush();
+  id = strtol(s, &end, 10);
+  if (end == s) { errno = 0; die(FAILHARD, "invalid shape header"); }
+  s = end;
+  if (fam == SHP_TYPE_POINT) {  /* "point N x y [z Z] [m M]" */
+    begin(fam, id);
+    text(s);
+    flush();
+    return;
+  }
+  if (fam == SHP_TYPE_MULTIPOINT) {
+    if (sscanf(s, " points %ld", &b) != 1) { errno = 0; die(FAILHARD, "invalid shape header"); }
+  }
+  else if ((fam != SHP_TYPE_NULL) && (sscanf(s, " parts %ld points %ld", &a, &b) != 2)) {
+    errno = 0;
+    die(FAILHARD, "invalid shape header");
+  }
+  begin(fam, id);
+  shape.wantparts = a;
+  shape.wantpoints = b;
+  if (fam == SHP_TYPE_NULL) flush();
+}
+
+/* A line of GENERATE: "id" to start a line or polygon, "x,y..."
+ * for its points, "part" and "END"; "id,x,y..." for a point, or
+ * one of a multipoint's */
+static void gen(char *s)
+{
+  Double v[5];
+  int n, fam = (type < 0) ? -1 : family(type), hasz = 0, hasm = 0;
+
+  if (!strcmp(s, "END")) { flush(); return; }
+  if (!strncmp(s, "part", 4)) { text(s); return; }
+  if ((n = numbers(s, v, 5)) < 1) { errno = 0; die(FAILHARD, "invalid line"); }
+  if (shape.open && (shape.family != SHP_TYPE_POINT) &&
+      (shape.family != SHP_TYPE_MULTIPOINT)) {  /* x,y[,z][,m] */
+    if (n < 2) { errno = 0; die(FAILHARD, "invalid point"); }
+    hasz = (n > 2) && (type / 10 == 1 || type == SHP_TYPE_MULTIPATCH);
+    hasm = (n > 2 + hasz);
+    if (hasm && !hasz) v[3] = v[2];
+    addpoint(v, hasz, hasm);
+    return;
+  }
+  if (n == 1) {  /* a line, polygon or patch starts */
+    if ((fam < 0) || (fam == SHP_TYPE_POINT) || (fam == SHP_TYPE_MULTIPOINT)) {
+      errno = 0;
+      die(FAILHARD, "give the type of lines or polygons with -t");
+    }
+    flush();
+    begin(fam, (long) v[0]);
+    return;
+  }
+  if (n < 3) { errno = 0; die(FAILHARD, "invalid point"); }
+  if ((fam < 0) && (n > 3)) {
+    errno = 0;
+    die(FAILHARD, "give the type of points with Z or M with -t");
+  }
+  if (fam < 0) fam = SHP_TYPE_POINT;
+  if ((fam != SHP_TYPE_POINT) && (fam != SHP_TYPE_MULTIPOINT)) {
+    errno = 0;
+    die(FAILHARD, "point outside of a shape");
+  }
+  if (!shape.open || (fam == SHP_TYPE_POINT) || (shape.id != (long) v[0])) {
+    flush();
+    begin(fam, (long) v[0]);
+  }
+  hasz = (n > 3) && (type / 10 == 1);
+  hasm = (n > 3 + hasz);
+  if (hasm && !hasz) v[4] = v[3];
+  {
+    Double w[4];
+    w[0] = v[1]; w[1] = v[2]; w[2] = v[3]; w[3] = v[4];
+    addpoint(w, hasz, hasm);
+  }
+  if (fam == SHP_TYPE_POINT) flush();
+}
+
+/* Comma separated numbers, up to max of them; their number, or
+ * -1 if there's anything else */
+static int numbers(char *s, Double *v, int max)
+{
+  char *end;
+  int n = 0;
+
+  for (;;) {
+    if (n == max) return -1;
+    v[n++] = fmtscan(s, &end);
+    if (end == s) return -1;
+    if (*end == '\0') return n;
+    if (*end != ',') return -1;
+    s = end + 1;
+  }
+}
+
+static void begin(int fam, long id)
+{
+  shape.open = 1;
+  shape.family = fam;
+  shape.id = id;
+  shape.wantparts = shape.wantpoints = -1;
+  shape.hasz = shape.hasm = 0;
+  shape.nparts = shape.npoints = 0;
+}
+
+/* A part starts at the next point; ptype -1 if not given */
+static void addpart(int ptype)
+{
+  if ((size_t) shape.nparts == shape.partroom) {
+    size_t n = shape.partroom ? 2*shape.partroom : 64;
+    Integer *p = (Integer *) realloc(shape.parts, n * sizeof(Integer));
+    Integer *t = p ? (Integer *) realloc(shape.types, n * sizeof(Integer)) : 0;
+    if (p) shape.parts = p;
+    if (t) shape.types = t;
+    if (!p || !t) die(FAILSOFT, "out of memory");
+    shape.partroom = n;
+  }
+  if (ptype < 0) ptype = shape.nparts ? SHP_PART_RING : SHP_PART_OUTERRING;
+  shape.parts[shape.nparts] = shape.npoints;
+  shape.types[shape.nparts++] = ptype;
+}
+
+/* x, y, z, m in v; z and m only if hasz, hasm */
+static void addpoint(const Double *v, int hasz, int hasm)
+{
+  Integer i = shape.npoints;
+
+  if ((shape.nparts == 0) && (shape.family != SHP_TYPE_POINT) &&
+      (shape.family != SHP_TYPE_MULTIPOINT))
+    addpart(-1);
+  if ((size_t) i == shape.room) {
+    size_t n = shape.room ? 2*shape.room : 1024;
+    Point *p = (Point *) realloc(shape.points, n * sizeof(Point));
+    Double *z = p ? (Double *) realloc(shape.z, n * sizeof(Double)) : 0;
+    Double *m = z ? (Double *) realloc(shape.m, n * sizeof(Double)) : 0;
+    if (p) shape.points = p;
+    if (z) shape.z = z;
+    if (m) shape.m = m;
+    if (!p || !z || !m) die(FAILSOFT, "out of memory");
+    shape.room = n;
+  }
+  if (i == 0x7FFFFFFFL / 16) { errno = 0; die(FAILHARD, "too many points for a shape"); }
+  shape.points[i].x = v[0];
+  shape.points[i].y = v[1];
+  shape.z[i] = hasz ? v[2] : 0;
+  shape.m[i] = hasm ? v[3] : 0;
+  if (hasz) shape.hasz = 1;
+  if (hasm) shape.hasm = 1;
+  shape.npoints++;
+}
+
+/* The type of the shapefile is that of the first shape, unless given */
+static void settype(int fam, int hasz, int hasm)
+{
+  if (type >= 0) return;
+  type = fam;
+  if ((fam == SHP_TYPE_NULL) || (fam == SHP_TYPE_MULTIPATCH)) return;
+  if (hasz) type += 10;
+  else if (hasm) type += 20;
+}
+
+/* Write the shape read, if any */
+static void flush(void)
+{
+  Shape *s = &shape;
+  Integer i, n = s->npoints;
+  BoundingBox box;
+  Double zlo = DBL_MAX, zhi = -DBL_MAX, mlo = DBL_MAX, mhi = -DBL_MAX;
+  int hasz, hasm, t;
+  unsigned char *p, *q;
+  size_t len;
+
+  if (!s->open) return;
+  s->open = 0;
+  if (s->family != SHP_TYPE_NULL) settype(s->family, s->hasz, s->hasm);
+  if ((s->family != SHP_TYPE_NULL) && (s->family != family(type))) {
+    errno = 0;
+    die(FAILHARD, "shape not of the type of the shapefile");
+  }
+  if (((s->wantparts >= 0) && (s->wantparts != s->nparts)) ||
+      ((s->wantpoints >= 0) && (s->wantpoints != n)))
+    warn("parts or points not as the shape's header says");
+  if ((s->family == SHP_TYPE_POINT) && (n != 1)) {
+    errno = 0;
+    die(FAILHARD, "point without coordinates");
+  }
+
+  t = (s->family == SHP_TYPE_NULL) ? SHP_TYPE_NULL : type;
+  hasz = (t / 10 == 1) || (t == SHP_TYPE_MULTIPATCH);
+  hasm = ((t / 10 == 1) || (t / 10 == 2) || (t == SHP_TYPE_MULTIPATCH)) && s->hasm;
+
+  box.xmin = box.ymin = DBL_MAX;
+  box.xmax = box.ymax = -DBL_MAX;
+  for (i = 0; i < n; i++) {
+    const Point *pt = &s->points[i];
+    if (pt->x < box.xmin) box.xmin = pt->x;
+    if (pt->x > box.xmax) box.xmax = pt->x;
+    if (pt->y < box.ymin) box.ymin = pt->y;
+    if (pt->y > box.ymax) box.ymax = pt->y;
+    if (s->z[i] < zlo) zlo = s->z[i];
+    if (s->z[i] > zhi) zhi = s->z[i];
+    if ((s->m[i] > -1e38) && (s->m[i] < mlo)) mlo = s->m[i];  /* no data below */
+    if ((s->m[i] > -1e38) && (s->m[i] > mhi)) mhi = s->m[i];
+  }
+  if (box.xmin > box.xmax) box.xmin = box.ymin = box.xmax = box.ymax = 0;
+  if (n > 0) {
+    if (box.xmin < extent.xmin) extent.xmin = box.xmin;
+    if (box.ymin < extent.ymin) extent.ymin = box.ymin;
+    if (box.xmax > extent.xmax) extent.xmax = box.xmax;
+    if (box.ymax > extent.ymax) extent.ymax = box.ymax;
+    if (hasz && (zlo < zmin)) zmin = zlo;
+    if (hasz && (zhi > zmax)) zmax = zhi;
+    if (hasm && (mlo < mmin)) mmin = mlo;
+    if (hasm && (mhi > mmax)) mmax = mhi;
+  }
+  if (zlo > zhi) zlo = zhi = 0;
+  if (mlo > mhi) mlo = mhi = 0;
+
+  /* record header, then contents */
+  len = 8 + 4 + 40 + 8*s->nparts + 16*(size_t) n + (16 + 8*(size_t) n)*(hasz + hasm);
+  p = q = room(len);
+  p += 8;
+  p = putint(p, t);
+  switch (family(t)) {
+    case SHP_TYPE_NULL:
+      break;
+    case SHP_TYPE_POINT:
+      p = putdouble(p, s->points[0].x);
+      p = putdouble(p, s->points[0].y);
+      if (hasz) p = putdouble(p, s->z[0]);
+      if (hasm) p = putdouble(p, s->m[0]);
+      break;
+    default:
+      p = putdouble(p, box.xmin); p = putdouble(p, box.ymin);
+      p = putdouble(p, box.xmax); p = putdouble(p, box.ymax);
+      if (family(t) != SHP_TYPE_MULTIPOINT) p = putint(p, s->nparts);
+      p = putint(p, n);
+      if (family(t) != SHP_TYPE_MULTIPOINT)
+        for (i = 0; i < s->nparts; i++) p = putint(p, s->parts[i]);
+      if (t == SHP_TYPE_MULTIPATCH)
+        for (i = 0; i < s->nparts; i++) p = putint(p, s->types[i]);
+      for (i = 0; i < n; i++) {
+        p = putdouble(p, s->points[i].x);
+        p = putdouble(p, s->points[i].y);
+      }
+      if (hasz) {
+        p = putdouble(p, zlo); p = putdouble(p, zhi);
+        for (i = 0; i < n; i++) p = putdouble(p, s->z[i]);
+      }
+      if (hasm) {
+        p = putdouble(p, mlo); p = putdouble(p, mhi);
+        for (i = 0; i < n; i++) p = putdouble(p, s->m[i]);
+      }
+  }
+  putrecord(q, p - q);
+}
+
+/* Write a record, its header filled in here, and index it */
+static void putrecord(const unsigned char *p, size_t n)
+{
+  unsigned long len = n - 8;
+
+  errno = 0;
+  if ((offset + n)/2 > 0xFFFFFFFFUL) die(FAILHARD, "too large for a shapefile");
+  putbig((unsigned char *) p, ++recno);
+  putbig((unsigned char *) p + 4, (long) (len / 2));
+  if (fwrite(p, 1, n, shp) != n) die(FAILSOFT, shpfile);
+  if (idxput(offset, len) < 0) die(FAILSOFT, shxfile);
+  offset += n;
+}
+
+static unsigned char *room(size_t n)
+{
+  if (n > bufsize) {
+    free(buf);
+    bufsize = 0;
+    if ((buf = (unsigned char *) malloc(n)) == NULL) die(FAILSOFT, "out of memory");
+    bufsize = n;
+  }
+  return buf;
+}
+
+static unsigned char *putint(unsigned char *p, long v)
+{
+  unsigned long u = (unsigned long) v;
+
+  p[0] = u & 0xFF; p[1] = (u >> 8) & 0xFF;
+  p[2] = (u >> 16) & 0xFF; p[3] = (u >> 24) & 0xFF;
+  return p + 4;
+}
+
+static unsigned char *putbig(unsigned char *p, long v)
+{
+  unsigned long u = (unsigned long) v;
+
+  p[3] = u & 0xFF; p[2] = (u >> 8) & 0xFF;
+  p[1] = (u >> 16) & 0xFF; p[0] = (u >> 24) & 0xFF;
+  return p + 4;
+}
+
+static unsigned char *putdouble(unsigned char *p, Double v)
+{
+  unsigned char *q = (unsigned char *) &v;
+  int i;
+
+  for (i = 0; i < 8; i++) p[i] = q[big ? 7 - i : i];
+  return p + 8;
+}
+
+static void putheader(unsigned long words)
+{
+  unsigned char head[100], *p = head;
+
+  memset(head, 0, sizeof head);
+  putbig(p, SHP_MAGIC);
+  putbig(p + 24, (long) words);
+  p = putint(p + 28, 1000);
+  p = putint(p, (type < 0) ? SHP_TYPE_NULL : type);
+  p = putdouble(p, extent.xmin); p = putdouble(p, extent.ymin);
+  p = putdouble(p, extent.xmax); p = putdouble(p, extent.ymax);
+  p = putdouble(p, zmin); p = putdouble(p, zmax);
+  p = putdouble(p, mmin); p = putdouble(p, mmax);
+  if (fwrite(head, 1, sizeof head, shp) != sizeof head) die(FAILSOFT, shpfile);
+}
@@ -0,0 +1,740 @@
+/* shpread.c - read shapefiles record by record | GPL */
+
+/* A reader holds its input (mapped or read in blocks, see input.h),
+ * its position, and scratch memory for the arrays of the record at
+ * hand, which only grows, to the largest needed. Records are decoded
+ * by one function per family of shapes, made from decoder.h.
+ *
+ * The only two data types in Shapefiles are Integer and Double.
+ * Double is always stored in little endian byte order, Integer
+ * occurs in both big and little endian order. Input comes in
+ * chunks from need(), which checks once per chunk that enough
+ * bytes are left; the get... routines below then decode from
+ * memory without any further checks.
+ */
+
+#include "shpread.h"
+#include "endian.h"
+#include "input.h"
+#include "vec.h"
+
+#include <errno.h>
+#include <float.h>   /* DBL_MAX */
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ShpReader {
+  Input in;
+  int clone;               /* input not ours: another reader's, or memory */
+  unsigned long pos;       /* byte offset */
+  unsigned long end;       /* as the header says, or 0 */
+  void *scratch;           /* for decoding records, reused */
+  size_t scratchsize;
+  const char *error;
+};
+
+/* Set once for all readers, by the first shpropen() */
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static int endian;
+
+static void init(void)
+{
+  endian = getendian();
+  (void) vecinit(endian);
+}
+
+static int fail(ShpReader *r, int err, const char *what)
+{
+  r->error = what;
+  errno = err;
+  return -1;
+}
+
+static int badinput(ShpReader *r)
+{
+  return fail(r, errno, errno ? "read error" : "unexpected end of file");
+}
+
+static const unsigned char *need(ShpReader *r, size_t n)
+{
+  const unsigned char *p = inneed(&r->in, n);
+
+  if (p == NULL) {
+    (void) badinput(r);
+    return NULL;
+  }
+  r->pos += n;
+  return p;
+}
+
+static const unsigned char *peek(ShpReader *r, size_t n)
+{
+  const unsigned char *p = inpeek(&r->in, n);
+
+  if (p == NULL) (void) badinput(r);
+  return p;
+}
+
+#define NEED(p, n) do { if (((p) = need(r, (n))) == NULL) return -1; } while (0)
+
+static void *scratch(ShpReader *r, size_t size)
+{
+  if ((size > r->scratchsize) || !r->scratch) {
+    size_t newsize = r->scratchsize ? 2*r->scratchsize : 64*1024;
+    while (newsize < size) newsize *= 2;
+    free(r->scratch);
+    r->scratchsize = 0;
+    if ((r->scratch = malloc(newsize)) == NULL) {
+      (void) fail(r, ENOMEM, "out of memory");
+      return NULL;
+    }
+    r->scratchsize = newsize;
+  }
+  return r->scratch;
+}
+
+static Integer getint(const unsigned char *p)
+{
+  unsigned long value;
+
+  /* little endian */
+  value  = p[3]; value <<= 8;
+  value += p[2]; value <<= 8;
+  value += p[1]; value <<= 8;
+  value += p[0];
+
+  return value;
+}
+
+static Integer getintbig(const unsigned char *p)
+{
+  unsigned long value;
+
+  /* big endian */
+  value  = p[0]; value <<= 8;
+  value += p[1]; value <<= 8;
+  value += p[2]; value <<= 8;
+  value += p[3];
+
+  return value;
+}
+
+static Double getdouble(const unsigned char *p)
+{
+  Double value;
+  unsigned char *bytes = (unsigned char *) &value;
+
+  if (endian == ENDIAN_LITTLE) memcpy(bytes, p, 8);
+  else {
+    bytes[0] = p[7]; bytes[1] = p[6]; bytes[2] = p[5]; bytes[3] = p[4];
+    bytes[4] = p[3]; bytes[5] = p[2]; bytes[6] = p[1]; bytes[7] = p[0];
+  }
+  return value;
+}
+
+static void getints(Integer *v, const unsigned char *p, Integer n)
+{
+  Integer i;
+
+  if (endian == ENDIAN_LITTLE) memcpy(v, p, n*sizeof(Integer));
+  else for (i = 0; i < n; i++, p += 4) v[i] = getint(p);
+}
+
+static void getdoubles(Double *v, const unsigned char *p, Integer n)
+{
+  Integer i;
+
+  if (endian == ENDIAN_LITTLE) memcpy(v, p, n*sizeof(Double));
+  else for (i = 0; i < n; i++, p += 8) v[i] = getdouble(p);
+}
+
+/* The numbers of parts and points come from the file: before
+ * they size anything, check that the arrays fit into the room
+ * the record has for them (bytes after type, bbox, counts, and
+ * ranges), which caps them. Parts take partsize bytes (with
+ * their types), points pointsize (with their Z, not the M).
+ */
+static int badcounts(Integer nparts, Integer npoints, Integer room,
+                     int partsize, int pointsize)
+{
+  return (room < 0) || (nparts < 0) || (npoints < 0) ||
+         (partsize && (nparts > room / partsize)) ||
+         (npoints > (room - partsize*nparts) / pointsize);
+}
+
+/* Readers */
+
+ShpReader *shpropen(int fd)
+{
+  ShpReader *r;
+
+  (void) pthread_once(&once, init);
+  if ((r = (ShpReader *) calloc(1, sizeof *r)) == NULL) return NULL;
+  if (inopen(&r->in, fd) < 0) {
+    free(r);
+    return NULL;
+  }
+  return r;
+}
+
+/* Memory the caller keeps, like a mapping of its own, is read
+ * like a mapped file, and not unmapped when done */
+ShpReader *shprmem(const void *base, size_t size)
+{
+  ShpReader *r;
+
+  (void) pthread_once(&once, init);
+  if ((r = (ShpReader *) calloc(1, sizeof *r)) == NULL) return NULL;
+  if ((inmem(&r->in, base, size) < 0) || (ininflate(&r->in) < 0)) {
+    free(r);
+    return NULL;
+  }
+  return r;
+}
+
+/* A block of records taken from offset, as it is, is read like
+ * the file from there, up to the end of the block */
+ShpReader *shprblock(const void *base, size_t size, unsigned long offset)
+{
+  ShpReader *r;
+
+  (void) pthread_once(&once, init);
+  if ((r = (ShpReader *) calloc(1, sizeof *r)) == NULL) return NULL;
+  (void) inmem(&r->in, base, size);
+  r->pos = offset;
+  return r;
+}
+
+ShpReader *shprclone(const ShpReader *r)
+{
+  ShpReader *c;
+
+  if (!r->in.mapped) { errno = 0; return NULL; }
+  if ((c = (ShpReader *) malloc(sizeof *c)) == NULL) return NULL;
+  *c = *r;  /* a copy of a mapped Input is a cursor of its own */
+  c->clone = 1;
+  c->scratch = 0;
+  c->scratchsize = 0;
+  return c;
+}
+
+void shprclose(ShpReader *r)
+{
+  if (!r) return;
+  if (!r->clone) inclose(&r->in);
+  free(r->scratch);
+  free(r);
+}
+
+unsigned long shprmapped(const ShpReader *r)
+{
+  return r->in.mapped ? (unsigned long) r->in.size : 0;
+}
+
+unsigned long shprtell(const ShpReader *r)
+{
+  return r->pos;
+}
+
+int shprseek(ShpReader *r, unsigned long offset)
+{
+  if (inseek(&r->in, offset) < 0)
+    return fail(r, errno, errno ? "cannot seek in input" : "invalid offset");
+  r->pos = offset;
+  return 0;
+}
+
+const char *shprerror(const ShpReader *r)
+{
+  return r->error ? r->error : "no error";
+}
+
+int shprheader(ShpReader *r, ShpHeader *h)
+{
+  const unsigned char *p;
+
+  NEED(p, 100);
+  h->magic = getintbig(p);
+  /* five unused integers at p+4..p+23 */
+  h->length = (unsigned long) getintbig(p+24);
+  h->version = getint(p+28);
+  h->type = getint(p+32);
+  h->bbox.xmin = getdouble(p+36);
+  h->bbox.ymin = getdouble(p+44);
+  h->bbox.xmax = getdouble(p+52);
+  h->bbox.ymax = getdouble(p+60);
+  h->zmin = getdouble(p+68);
+  h->zmax = getdouble(p+76);
+  h->mmin = getdouble(p+84);
+  h->mmax = getdouble(p+92);
+  r->end = 2*h->length;
+  return 0;
+}
+
+/* Records */
+
+int shprhead(ShpReader *r, ShpRecord *rec)
+{
+  const unsigned char *p;
+
+  rec->offset = r->pos;
+  NEED(p, 12);
+  rec->id = getintbig(p);
+  rec->length = getintbig(p+4);
+  rec->type = getint(p+8);
+  rec->where = 0;
+  rec->used = 0;
+  return 0;
+}
+
+/* Points are taken directly, all other shapes by their bbox,
+ * which comes first in the record, so we can tell where they
+ * are without decoding the rest. Null shapes are nowhere; for
+ * unknown types and shapes too short to tell, we don't know.
+ */
+int shprbbox(ShpReader *r, ShpRecord *rec)
+{
+  const unsigned char *p;
+  Integer reclen = rec->length*2 - sizeof(Integer);  /* after the type */
+
+  rec->where = 0;
+  switch (rec->type) {
+    case SHP_TYPE_NULL:
+      rec->where = -1;
+      break;
+    case SHP_TYPE_POINT: case SHP_TYPE_POINTZ: case SHP_TYPE_POINTM:
+      if (reclen < 16) break;
+      if ((p = peek(r, 16)) == NULL) return -1;
+      rec->bbox.xmin = rec->bbox.xmax = getdouble(p);
+      rec->bbox.ymin = rec->bbox.ymax = getdouble(p+8);
+      rec->where = 1;
+      break;
+    case SHP_TYPE_POLYLINE: case SHP_TYPE_POLYLINEZ: case SHP_TYPE_POLYLINEM:
+    case SHP_TYPE_POLYGON: case SHP_TYPE_POLYGONZ: case SHP_TYPE_POLYGONM:
+    case SHP_TYPE_MULTIPOINT: case SHP_TYPE_MULTIPOINTZ:
+    case SHP_TYPE_MULTIPOINTM: case SHP_TYPE_MULTIPATCH:
+      if (reclen < 32) break;
+      if ((p = peek(r, 32)) == NULL) return -1;
+      rec->bbox.xmin = getdouble(p);
+      rec->bbox.ymin = getdouble(p+8);
+      rec->bbox.xmax = getdouble(p+16);
+      rec->bbox.ymax = getdouble(p+24);
+      rec->where = 1;
+      break;
+  }
+  return 0;
+}
+
+int shprskip(ShpReader *r, ShpRecord *rec)
+{
+  Integer reclen = rec->length*2 - sizeof(Integer);
+
+  if (reclen <= 0) return 0;
+  if (inskip(&r->in, reclen) < 0) return badinput(r);
+  r->pos += reclen;
+  rec->used = reclen;
+  return 0;
+}
+
+/* Points, with Z and M if hasz and hasm */
+static int decodepoint(ShpReader *r, ShpRecord *rec, int hasz, int hasm)
+{
+  const unsigned char *p;
+  Point *pt;
+  Double *zm;
+
+  NEED(p, 16 + 8*hasz + 8*hasm);
+  if ((pt = (Point *) scratch(r, sizeof(Point) + 2*sizeof(Double))) == NULL)
+    return -1;
+  zm = (Double *) (pt + 1);
+  pt->x = getdouble(p);
+  pt->y = getdouble(p+8);
+  zm[0] = hasz ? getdouble(p+16) : 0;
+  zm[1] = hasm ? getdouble(p+16+8*hasz) : 0;
+  rec->npoints = 1;
+  rec->points = pt;
+  rec->hasz = hasz; rec->z = zm;
+  rec->hasm = hasm; rec->m = zm + 1;
+  rec->bbox.xmin = rec->bbox.xmax = pt->x;
+  rec->bbox.ymin = rec->bbox.ymax = pt->y;
+  if ((pt->x == pt->x) && (pt->y == pt->y)) rec->extent = rec->bbox;
+  else {  /* empty, as for shapes with only NaNs */
+    rec->extent.xmin = rec->extent.ymin = DBL_MAX;
+    rec->extent.xmax = rec->extent.ymax = -DBL_MAX;
+  }
+  return 0;
+}
+
+/* All other shapes: one decoder per type from a template */
+
+#define DECODER decodeline
+#define HASPARTS 1
+#define HASTYPES 0
+#define HASZ 0
+#define HASM 0
+#include "decoder.h"
+
+#define DECODER decodelinez
+#define HASPARTS 1
+#define HASTYPES 0
+#define HASZ 1
+#define HASM 1
+#include "decoder.h"
+
+#define DECODER decodelinem
+#define HASPARTS 1
+#define HASTYPES 0
+#define HASZ 0
+#define HASM 1
+#include "decoder.h"
+
+#define DECODER decodemultipoint
+#define HASPARTS 0
+#define HASTYPES 0
+#define HASZ 0
+#define HASM 0
+#include "decoder.h"
+
+#define DECODER decodemultipointz
+#define HASPARTS 0
+#define HASTYPES 0
+#define HASZ 1
+#define HASM 1
+#include "decoder.h"
+
+#define DECODER decodemultipointm
+#define HASPARTS 0
+#define HASTYPES 0
+#define HASZ 0
+#define HASM 1
+#include "decoder.h"
+
+#define DECODER decodemultipatch
+#define HASPARTS 1
+#define HASTYPES 1
+#define HASZ 1
+#define HASM 1
+#include "decoder.h"
+
+int shprdecode(ShpReader *r, ShpRecord *rec)
+{
+  Integer reclen = rec->length*2 - sizeof(Integer);
+  unsigned long at = r->pos;
+  int ok;
+
+  rec->extent.xmin = rec->extent.ymin = DBL_MAX;
+  rec->extent.xmax = rec->extent.ymax = -DBL_MAX;
+  rec->nparts = rec->npoints = 0;
+  rec->parts = rec->types = rec->owner = 0;
+  rec->points = 0;
+  rec->hasz = rec->hasm = 0;
+  rec->z = rec->m = 0;
+  rec->zmin = rec->zmax = rec->mmin = rec->mmax = 0;
+
+  switch (rec->type) {  /* polygons are lines, as far as decoding goes */
+    case SHP_TYPE_NULL: ok = 0; break;
+    case SHP_TYPE_POINT: ok = decodepoint(r, rec, 0, 0); break;
+    case SHP_TYPE_POINTZ: ok = decodepoint(r, rec, 1, reclen >= 32); break;
+    case SHP_TYPE_POINTM: ok = decodepoint(r, rec, 0, reclen >= 24); break;
+    case SHP_TYPE_POLYLINE: case SHP_TYPE_POLYGON:
+      ok = decodeline(r, rec, reclen); break;
+    case SHP_TYPE_POLYLINEZ: case SHP_TYPE_POLYGONZ:
+      ok = decodelinez(r, rec, reclen); break;
+    case SHP_TYPE_POLYLINEM: case SHP_TYPE_POLYGONM:
+      ok = decodelinem(r, rec, reclen); break;
+    case SHP_TYPE_MULTIPOINT: ok = decodemultipoint(r, rec, reclen); break;
+    case SHP_TYPE_MULTIPOINTZ: ok = decodemultipointz(r, rec, reclen); break;
+    case SHP_TYPE_MULTIPOINTM: ok = decodemultipointm(r, rec, reclen); break;
+    case SHP_TYPE_MULTIPATCH: ok = decodemultipatch(r, rec, reclen); break;
+    default: ok = shprskip(r, rec);
+  }
+  rec->used = r->pos - at;
+  return ok;
+}
+
+/* A record as it is, by the length in its head, which must
+ * fit in what the file header says is left */
+const void *shprraw(ShpReader *r, size_t *size)
+{
+  const unsigned char *p;
+  Integer length;
+  size_t n;
+
+  errno = 0;
+  if (!r->end || (r->pos + 8 > r->end)) return NULL;
+  if ((p = peek(r, 8)) == NULL) return NULL;
+  length = getintbig(p+4);
+  if ((length < 2) || ((unsigned long) length > (r->end - r->pos - 8) / 2)) {
+    errno = 0;
+    return NULL;
+  }
+  n = 8 + 2*(size_t) length;
+  if ((p = need(r, n)) == NULL) return NULL;
+  *size = n;
+  return p;
+}
+
+int shprunread(ShpReader *r, const void *p, size_t n)
+{
+  if (inunread(&r->in, p, n) < 0)
+    return fail(r, errno, errno == ENOMEM ? "out of memory" : "cannot unread");
+  r->pos -= n;
+  return 0;
+}
+
+int shprnext(ShpReader *r, ShpRecord *rec)
+{
+  if (r->end ? (r->pos >= r->end) : (inpeek(&r->in, 1) == NULL)) {
+    if (!r->end && errno) return badinput(r);
+    return 0;
+  }
+  if ((shprhead(r, rec) < 0) || (shprdecode(r, rec) < 0)) return -1;
+  return 1;
+}
+
+int shprmore(ShpReader *r)
+{
+  if (inpeek(&r->in, 1)) return 1;
+  return errno ? badinput(r) : 0;
+}
+
+#ifdef TEST
+/* Write a small shapefile, read it back through a mapped file,
+ * through a pipe (block reads) and from memory, plain and gzip
+ * compressed, and check what the records decode to; cut it into
+ * records as they are; then break it in a few ways. Exit 1 on any
+ * mismatch.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#ifndef NOZLIB
+#include <zlib.h>
+#endif
+
+static unsigned char file[1024];
+static size_t flen;
+
+static void putbig(Integer v)
+{
+  int i;
+  for (i = 0; i < 4; i++) file[flen++] = (unsigned char) ((unsigned long) v >> (24 - 8*i));
+}
+
+static void putlittle(Integer v)
+{
+  int i;
+  for (i = 0; i < 4; i++) file[flen++] = (unsigned char) ((unsigned long) v >> 8*i);
+}
+
+static void putdouble(Double v)
+{
+  unsigned char *p = (unsigned char *) &v;
+  int i;
+  for (i = 0; i < 8; i++) file[flen++] = (endian == ENDIAN_LITTLE) ? p[i] : p[7-i];
+}
+
+static size_t makefile(void)
+{
+  static const Double xy[] = { 0,0, 1,0, 1,1, 5,5, 6,6 };
+  Double inf = 1e308 * 10;
+  size_t at;
+  int i;
+
+  init();
+  flen = 0;
+  putbig(SHP_MAGIC);
+  for (i = 0; i < 5; i++) putbig(0);
+  putbig(0);  /* length, below */
+  putlittle(1000);
+  putlittle(SHP_TYPE_POLYLINE);
+  for (i = 0; i < 8; i++) putdouble(i < 2 ? 0 : 6);
+
+  putbig(1); putbig((4 + 40 + 8 + 80)/2); putlittle(SHP_TYPE_POLYLINE);
+  putdouble(0); putdouble(0); putdouble(6); putdouble(6);
+  putlittle(2); putlittle(5); putlittle(0); putlittle(3);
+  for (i = 0; i < 10; i++) putdouble(xy[i]);
+
+  putbig(2); putbig(2); putlittle(SHP_TYPE_NULL);
+
+  putbig(3); putbig((4 + 16)/2); putlittle(SHP_TYPE_POINTM);
+  putdouble(inf - inf); putdouble(8);  /* NaN x, no M */
+
+  at = flen;
+  putbig(4); putbig((4 + 40 + 4)/2); putlittle(SHP_TYPE_POLYLINE);
+  putdouble(0); putdouble(0); putdouble(0); putdouble(0);
+  putlittle(1); putlittle(1000); putlittle(0);
+
+  file[24] = (unsigned char) (flen/2 >> 24); file[25] = (unsigned char) (flen/2 >> 16);
+  file[26] = (unsigned char) (flen/2 >> 8); file[27] = (unsigned char) (flen/2);
+  return at;
+}
+
+static unsigned long tests = 0, fails = 0;
+
+static void expect(int ok, const char *how, const char *what)
+{
+  tests++;
+  if (!ok) { fails++; printf("%s: %s\n", how, what); }
+}
+
+/* As a mapped file (1), through a pipe (0) or from memory (2),
+ * the first len bytes of the file or of what's in buf */
+static ShpReader *openbuf(const unsigned char *buf, size_t len, int mapped)
+{
+  int fd[2];
+  FILE *fp;
+
+  if (mapped == 2) return shprmem(buf, len);
+  if (mapped) {
+    if ((fp = tmpfile()) == NULL) return NULL;
+    (void) fwrite(buf, 1, len, fp);
+    (void) fflush(fp);
+    (void) lseek(fileno(fp), 0, SEEK_SET);
+    return shpropen(fileno(fp));  /* fp stays open till exit */
+  }
+  if (pipe(fd) < 0) return NULL;
+  (void) write(fd[1], buf, len);
+  close(fd[1]);
+  return shpropen(fd[0]);
+}
+
+static unsigned char gz[2048];  /* the file, compressed */
+static size_t gzlen;
+
+#ifndef NOZLIB
+/* Compress the file into gz, in gzip format, as two members */
+static void makegz(size_t len)
+{
+  z_stream zs;
+  size_t half = len/2, i;
+
+  gzlen = 0;
+  for (i = 0; i < 2; i++) {
+    memset(&zs, 0, sizeof zs);
+    if (deflateInit2(&zs, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+    zs.next_in = file + (i ? half : 0);
+    zs.avail_in = (uInt) (i ? len - half : half);
+    zs.next_out = gz + gzlen;
+    zs.avail_out = (uInt) (sizeof gz - gzlen);
+    (void) deflate(&zs, Z_FINISH);
+    gzlen = sizeof gz - zs.avail_out;
+    (void) deflateEnd(&zs);
+  }
+}
+#endif
+
+static void run(size_t len, int mapped, int compressed, const char *how)
+{
+  ShpReader *r = compressed ? openbuf(gz, gzlen, mapped) : openbuf(file, len, mapped);
+  ShpReader *c;
+  ShpHeader h;
+  ShpRecord rec;
+
+  expect(r != NULL, how, "open");
+  if (!r) return;
+  expect((shprmapped(r) != 0) == (mapped && !compressed), how, "mapped");
+  expect(shprheader(r, &h) == 0, how, "header");
+  expect((h.magic == SHP_MAGIC) && (h.type == SHP_TYPE_POLYLINE) &&
+         (h.length == flen/2) && (h.bbox.xmax == 6), how, "header fields");
+
+  expect(shprhead(r, &rec) == 0, how, "head 1");
+  expect((rec.id == 1) && (rec.offset == 100) && (rec.where == 0), how, "head 1 fields");
+  expect((shprbbox(r, &rec) == 0) && (rec.where == 1) && (rec.bbox.xmax == 6),
+         how, "bbox 1");
+  expect(shprdecode(r, &rec) == 0, how, "decode 1");
+  expect((rec.nparts == 2) && (rec.npoints == 5) && (rec.parts[1] == 3) &&
+         !rec.types && !rec.hasz && !rec.hasm, how, "line counts");
+  expect((rec.points[2].x == 1) && (rec.points[4].y == 6) &&
+         (rec.extent.xmin == 0) && (rec.extent.ymax == 6), how, "line points");
+  expect(rec.used == (unsigned long) rec.length*2 - 4, how, "line used");
+
+  if (mapped && !compressed) {  /* a clone reads on from here, on its own */
+    c = shprclone(r);
+    expect((c != NULL) && (shprnext(c, &rec) == 1) && (rec.id == 2), how, "clone");
+    shprclose(c);
+  }
+  else expect(shprclone(r) == NULL, how, "no clone unmapped");
+
+  expect((shprnext(r, &rec) == 1) && (rec.id == 2) &&
+         (rec.type == SHP_TYPE_NULL) && (rec.npoints == 0), how, "null");
+  expect((shprnext(r, &rec) == 1) && (rec.id == 3) && (rec.npoints == 1) &&
+         !rec.hasm && (rec.points->y == 8), how, "point without M");
+  expect(rec.extent.xmin > rec.extent.xmax, how, "NaN point extent");
+  expect((shprnext(r, &rec) < 0) && (errno == 0) &&
+         !strcmp(shprerror(r), "invalid number of parts or points"), how, "bad counts");
+  shprclose(r);
+}
+
+int main(void)
+{
+  size_t bad = makefile();
+  ShpReader *r, *c;
+  ShpHeader h;
+  ShpRecord rec;
+  const void *raw;
+  size_t size;
+  int n = 0;
+
+  run(flen, 1, 0, "mapped");
+  run(flen, 0, 0, "piped");
+  run(flen, 2, 0, "memory");
+#ifndef NOZLIB
+  makegz(flen);
+  run(flen, 1, 1, "gzip mapped");
+  run(flen, 0, 1, "gzip piped");
+  run(flen, 2, 1, "gzip memory");
+
+  /* cut short, and with the deflate data broken */
+  r = openbuf(gz, gzlen - 30, 0);
+  n = r && (shprheader(r, &h) == 0) ? shprnext(r, &rec) : 1;
+  while (n > 0) n = shprnext(r, &rec);
+  expect((n < 0) && (errno == 0) && !strcmp(shprerror(r), "unexpected end of file"),
+         "gzip truncated", "end of file");
+  shprclose(r);
+  gz[20] ^= 0xff; gz[21] ^= 0xff; gz[22] ^= 0xff;
+  r = openbuf(gz, gzlen, 1);
+  n = r && (shprheader(r, &h) == 0) ? shprnext(r, &rec) : -1;
+  while (n > 0) n = shprnext(r, &rec);
+  expect((n < 0) && (errno == EIO), "gzip corrupt", "read error");
+  shprclose(r);
+  n = 0;
+#endif
+
+  /* without the bad record, to the end the header gives */
+  flen = bad;
+  file[26] = (unsigned char) (flen/2 >> 8); file[27] = (unsigned char) (flen/2);
+  r = openbuf(file, flen, 1);
+  if (r && (shprheader(r, &h) == 0)) while (shprnext(r, &rec) > 0) n++;
+  expect(n == 3, "iterate", "3 records");
+  expect(shprmore(r) == 0, "iterate", "no more");
+  shprclose(r);
+
+  /* cut off the first record as it is, read it on its own, put it back */
+  r = openbuf(file, flen, 0);
+  if (r && (shprheader(r, &h) == 0) && ((raw = shprraw(r, &size)) != NULL)) {
+    memcpy(gz, raw, size);
+    expect((size == 8 + 132) && (shprtell(r) == 100 + size), "raw", "record 1");
+    c = shprblock(gz, size, 100);
+    expect(c && (shprnext(c, &rec) == 1) && (rec.id == 1) && (rec.offset == 100) &&
+           (rec.npoints == 5) && (shprnext(c, &rec) == 0), "block", "record 1");
+    shprclose(c);
+    expect((shprunread(r, gz, size) == 0) && (shprtell(r) == 100), "unread", "record 1");
+    for (n = 0; shprnext(r, &rec) > 0; n++) ;
+    expect((n == 3) && (shprraw(r, &size) == NULL) && (errno == 0) &&
+           (shprmore(r) == 0), "unread", "3 records");
+  }
+  else expect(0, "raw", "record 1");
+  shprclose(r);
+
+  /* truncated in the middle of the first record */
+  r = openbuf(file, 150, 0);
+  n = r && (shprheader(r, &h) == 0) ? shprnext(r, &rec) : 1;
+  expect((n < 0) && (errno == 0) && !strcmp(shprerror(r), "unexpected end of file"),
+         "truncated", "end of file");
+  shprclose(r);
+
+  printf("%lu tests, %lu failed\n", tests, fails);
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,108 @@
+/* shpread.h - read shapefiles record by record | GPL */
+
+/* The reading half of shpdump as a library (libshpread): open a
+ * .shp, read its header, then iterate over its records, which are
+ * decoded into memory of the reader and handed out in place. There
+ * is no global state: readers are independent, and a reader of a
+ * mapped file can be cloned to read it with several threads.
+ *
+ *   ShpReader *r = shpropen(fd);
+ *   ShpHeader h;
+ *   ShpRecord rec;
+ *
+ *   if (r && (shprheader(r, &h) == 0))
+ *     while (shprnext(r, &rec) > 0) use(&rec);
+ *   shprclose(r);
+ *
+ * On errors, functions return -1 (or NULL), with errno set for
+ * system errors and 0 for invalid or truncated files, and
+ * shprerror() tells what happened.
+ */
+
+#ifndef _SHPREAD_H_
+#define _SHPREAD_H_
+
+#include <stddef.h>
+
+#include "shapefile.h"
+
+typedef struct ShpReader ShpReader;
+
+typedef struct {           /* the file header */
+  Integer magic, version;
+  unsigned long length;    /* of the file, in 16-bit words */
+  Integer type;            /* of the shapes, SHP_TYPE_... */
+  BoundingBox bbox;
+  Double zmin, zmax, mmin, mmax;
+} ShpHeader;
+
+typedef struct {           /* a record */
+  unsigned long offset;    /* in the file */
+  Integer id;              /* record number, from its header */
+  Integer length;          /* of its contents in 16-bit words, ditto */
+  Integer type;            /* of the shape */
+  int where;               /* set by shprbbox(): 1 if bbox is known,
+                              -1 if the shape is nowhere (null), else 0 */
+  BoundingBox bbox;        /* as in the record; for points, the point */
+
+  /* Set by shprdecode(), in memory of the reader, valid until it
+   * decodes the next record: */
+  BoundingBox extent;      /* of the points, NaNs ignored */
+  Integer nparts, npoints;
+  const Integer *parts;    /* first point of each part, or NULL if
+                              the type has none (multipoints) */
+  const Integer *types;    /* of the parts, for multipatches */
+  const Point *points;
+  int hasz, hasm;          /* Z and M values there? */
+  const Double *z, *m;
+  Double zmin, zmax;       /* ranges as in the record */
+  Double mmin, mmax;
+  Integer *owner;          /* room for nparts integers, for wkbgroup() */
+  unsigned long used;      /* bytes of the contents decoded */
+} ShpRecord;
+
+extern ShpReader *shpropen(int fd);  /* map fd, or read it in blocks */
+extern ShpReader *shprmem(const void *base, size_t size);  /* read memory */
+extern ShpReader *shprclone(const ShpReader *r);  /* own cursor, mapped only */
+extern void shprclose(ShpReader *r);
+
+extern unsigned long shprmapped(const ShpReader *r);  /* bytes mapped, or 0 */
+extern unsigned long shprtell(const ShpReader *r);  /* byte offset */
+extern int shprseek(ShpReader *r, unsigned long offset);
+extern const char *shprerror(const ShpReader *r);
+
+extern int shprheader(ShpReader *r, ShpHeader *h);  /* read the header */
+
+/* Read the head of the next record (number, length, type) into
+ * rec; then either shprdecode() or shprskip() its contents. The
+ * contents decoded are what their counts say, not what the length
+ * says, as the length may be wrong: compare rec->used to check.
+ * In between, shprbbox() tells where the shape is, from the bbox
+ * that starts the contents (or the point), without decoding them.
+ */
+extern int shprhead(ShpReader *r, ShpRecord *rec);
+extern int shprbbox(ShpReader *r, ShpRecord *rec);
+extern int shprdecode(ShpReader *r, ShpRecord *rec);
+extern int shprskip(ShpReader *r, ShpRecord *rec);
+
+/* Both in one: return 1 for a record, 0 at the end (as the file
+ * header says, if it was read), or -1 */
+extern int shprnext(ShpReader *r, ShpRecord *rec);
+
+/* Is there input left, whatever the file header says? 1 or 0, or
+ * -1 on read errors; for going by the records alone */
+extern int shprmore(ShpReader *r);
+
+/* For cutting a stream into blocks of records to decode elsewhere:
+ * shprraw() returns the next record as it is, head and contents
+ * by its length, and sets *size (valid until the next call), or
+ * NULL (errno 0 at the end or if the length is not plausible,
+ * then nothing is consumed). shprblock() reads such a block,
+ * taken from the given offset, like the file from there, and
+ * shprunread() puts bytes back to be read again, unmapped only.
+ */
+extern const void *shprraw(ShpReader *r, size_t *size);
+extern ShpReader *shprblock(const void *base, size_t size, unsigned long offset);
+extern int shprunread(ShpReader *r, const void *p, size_t n);
+
+#endif /* _SHPREAD_H_ */
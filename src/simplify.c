@@ -0,0 +1,225 @@
+/* simplify.c - drop vertices of lines and rings for output | GPL */
+
+/* The inner vertices are linked to their neighbours by prev and
+ * next, and kept in a min-heap by the area of their triangles, with
+ * at[] telling where each is in the heap. When the smallest goes,
+ * its neighbours get the areas of their new triangles, but no less
+ * than the one that went (its "effective area"), and move up or
+ * down the heap. Ties go by position, so the result is the same
+ * whatever the heap looks like.
+ */
+
+#include "simplify.h"
+
+#include <float.h>   /* DBL_MAX */
+#include <stdlib.h>
+
+#define BEFORE(a, i, j) (((a)[i] < (a)[j]) || (((a)[i] == (a)[j]) && ((i) < (j))))
+
+static Double triangle(const Point *a, const Point *b, const Point *c);
+static void up(const Double *area, long *heap, long *at, long k);
+static void down(const Double *area, long *heap, long *at, long m, long k);
+
+long simplify(Simplifier *s, const Point *p, long n, Double area,
+              long min, unsigned char *keep)
+{
+  size_t need = (size_t) n * (sizeof(Double) + 4*sizeof(long));
+  long *prev, *next, *heap, *at;
+  long i, j, k, m = 0, left = n;
+  Double *a, gone;
+
+  for (i = 0; i < n; i++) keep[i] = 1;
+  if ((n <= 2) || (n <= min) || !(area > 0)) return n;
+  if (need > s->size) {
+    free(s->mem);
+    s->size = 0;
+    if ((s->mem = malloc(need)) == NULL) return -1;
+    s->size = need;
+  }
+  a = (Double *) s->mem;
+  prev = (long *) (a + n);
+  next = prev + n;
+  heap = next + n;
+  at = heap + n;
+
+  for (i = 0; i < n; i++) {
+    prev[i] = i - 1;
+    next[i] = i + 1;
+  }
+  for (i = 1; i < n-1; i++) {
+    a[i] = triangle(&p[i-1], &p[i], &p[i+1]);
+    heap[m] = i;
+    at[i] = m++;
+  }
+  for (k = m/2; k-- > 0; ) down(a, heap, at, m, k);
+
+  while ((m > 0) && (left > min) && (a[heap[0]] < area)) {
+    i = heap[0];
+    gone = a[i];
+    if (--m > 0) {
+      heap[0] = heap[m];
+      at[heap[0]] = 0;
+      down(a, heap, at, m, 0);
+    }
+    keep[i] = 0;
+    left--;
+    next[prev[i]] = next[i];
+    prev[next[i]] = prev[i];
+    for (k = 0; k < 2; k++) {
+      j = k ? next[i] : prev[i];
+      if ((j == 0) || (j == n-1)) continue;
+      a[j] = triangle(&p[prev[j]], &p[j], &p[next[j]]);
+      if (a[j] < gone) a[j] = gone;
+      up(a, heap, at, at[j]);
+      down(a, heap, at, m, at[j]);
+    }
+  }
+  return left;
+}
+
+/* Its area; NaNs make it too large to go */
+static Double triangle(const Point *a, const Point *b, const Point *c)
+{
+  Double t = ((b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y)) / 2;
+
+  if (t < 0) t = -t;
+  return (t == t) ? t : DBL_MAX;
+}
+
+static void up(const Double *area, long *heap, long *at, long k)
+{
+  long i = heap[k], parent;
+
+  while (k > 0) {
+    parent = (k - 1) / 2;
+    if (!BEFORE(area, i, heap[parent])) break;
+    heap[k] = heap[parent];
+    at[heap[k]] = k;
+    k = parent;
+  }
+  heap[k] = i;
+  at[i] = k;
+}
+
+static void down(const Double *area, long *heap, long *at, long m, long k)
+{
+  long i = heap[k], child;
+
+  while ((child = 2*k + 1) < m) {
+    if ((child + 1 < m) && BEFORE(area, heap[child+1], heap[child])) child++;
+    if (!BEFORE(area, heap[child], i)) break;
+    heap[k] = heap[child];
+    at[heap[k]] = k;
+    k = child;
+  }
+  heap[k] = i;
+  at[i] = k;
+}
+
+#ifdef TEST
+/* Simplify some lines and rings, and random ones of all sizes,
+ * and compare with doing it the slow way: find the smallest area
+ * again for each vertex that goes. Exit 1 on any mismatch.
+ */
+#include <stdio.h>
+#include <string.h>
+
+static unsigned long tests = 0, fails = 0;
+
+static void expect(int ok, const char *what)
+{
+  tests++;
+  if (!ok) { fails++; printf("%s\n", what); }
+}
+
+static long slow(const Point *p, long n, Double area, long min, unsigned char *keep)
+{
+  Double a[256], gone;
+  long prev[256], next[256], i, j, best, left = n;
+
+  for (i = 0; i < n; i++) { keep[i] = 1; prev[i] = i - 1; next[i] = i + 1; }
+  if ((n <= 2) || (n <= min) || !(area > 0)) return n;
+  for (i = 1; i < n-1; i++) a[i] = triangle(&p[i-1], &p[i], &p[i+1]);
+  while (left > min) {
+    for (best = -1, i = 1; i < n-1; i++)
+      if (keep[i] && ((best < 0) || BEFORE(a, i, best))) best = i;
+    if ((best < 0) || !(a[best] < area)) break;
+    gone = a[best];
+    keep[best] = 0;
+    left--;
+    next[prev[best]] = next[best];
+    prev[next[best]] = prev[best];
+    for (j = prev[best]; j != next[next[best]]; j = next[j]) {
+      if ((j == 0) || (j == n-1)) continue;
+      a[j] = triangle(&p[prev[j]], &p[j], &p[next[j]]);
+      if (a[j] < gone) a[j] = gone;
+    }
+  }
+  return left;
+}
+
+static unsigned long seed = 1;
+
+static Double random01(void)
+{
+  seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+  return seed / 2147483648.0;
+}
+
+int main(void)
+{
+  static Point p[1000000];
+  static unsigned char keep[1000000], want[256];
+  Simplifier s = { 0, 0 };
+  long n, i, k, got;
+
+  /* a straight line with small bumps, and a corner */
+  for (i = 0; i < 11; i++) { p[i].x = i; p[i].y = (i % 2) ? 0.01 : 0; }
+  p[10].y = 5;
+  got = simplify(&s, p, 11, 0.5, 2, keep);
+  expect((got == 3) && keep[0] && keep[9] && keep[10], "bumps");
+  got = simplify(&s, p, 11, 0, 2, keep);
+  expect(got == 11, "no tolerance");
+  got = simplify(&s, p, 11, 1e9, 2, keep);
+  expect((got == 2) && keep[0] && keep[10], "all but the ends");
+
+  /* a closed ring keeps its ends and at least min vertices */
+  p[0].x = 0; p[0].y = 0; p[1].x = 0; p[1].y = 1; p[2].x = 0.01; p[2].y = 1.01;
+  p[3].x = 1; p[3].y = 1; p[4].x = 1; p[4].y = 0; p[5] = p[0];
+  got = simplify(&s, p, 6, 0.1, 4, keep);
+  expect((got == 5) && (keep[1] != keep[2]) && keep[0] && keep[5], "ring");
+  got = simplify(&s, p, 6, 1e9, 4, keep);
+  expect((got == 4) && keep[0] && keep[5], "ring min");
+
+  /* NaNs stay */
+  for (i = 0; i < 5; i++) { p[i].x = i; p[i].y = 0; }
+  p[2].y = p[2].y / p[2].y;
+  p[2].x = 0.0 / p[0].x;
+  got = simplify(&s, p, 5, 1, 2, keep);
+  expect(keep[2], "NaN kept");
+
+  /* random walks against the slow way */
+  for (k = 0; k < 2000; k++) {
+    Double area = random01() * random01();
+    long min = k % 5;
+    n = 1 + (long) (random01() * 200);
+    for (i = 0; i < n; i++) {
+      p[i].x = (i ? p[i-1].x : 0) + random01() - 0.3;
+      p[i].y = (i ? p[i-1].y : 0) + random01() - 0.5;
+      if (k % 7 == 0) p[i].y = (Double) (long) (p[i].y * 4);
+    }
+    got = simplify(&s, p, n, area, min, keep);
+    expect((got == slow(p, n, area, min, want)) && !memcmp(keep, want, n), "random");
+  }
+
+  /* a million vertices, in n log n */
+  n = sizeof p / sizeof p[0];
+  for (i = 0; i < n; i++) { p[i].x = i; p[i].y = random01(); }
+  got = simplify(&s, p, n, 0.25, 2, keep);
+  expect((got > 2) && (got < n) && keep[0] && keep[n-1], "million");
+
+  free(s.mem);
+  printf("%lu tests, %lu failed\n", tests, fails);
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,25 @@
+/* simplify.h - drop vertices of lines and rings for output | GPL */
+
+#ifndef _SIMPLIFY_H_
+#define _SIMPLIFY_H_
+
+#include <stddef.h>
+
+#include "shapefile.h"
+
+typedef struct {           /* memory for simplify(), reused */
+  void *mem;               /* zero to start, free() when done */
+  size_t size;
+} Simplifier;
+
+/* Visvalingam-Whyatt: drop the vertex of p[0..n-1] that makes the
+ * smallest triangle with its neighbours, again and again, while
+ * that area is less than area and more than min vertices are left.
+ * The first and last vertex stay, so rings stay closed. Set keep[i]
+ * to 1 for the vertices kept, else 0, and return their number, or
+ * -1 if out of memory. O(n log n), with a heap.
+ */
+extern long simplify(Simplifier *s, const Point *p, long n, Double area,
+                     long min, unsigned char *keep);
+
+#endif /* _SIMPLIFY_H_ */
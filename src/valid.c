@@ -0,0 +1,535 @@
+/* valid.c - geometric validity of lines and polygon rings | GPL */
+
+/* Each part is cut into monotone chains: runs of segments that go
+ * the same way in x and in y, so the bbox of a run is that of its
+ * ends and segments in it can't meet but where they join. A sweep
+ * line goes over the chains by their xmin; chains still active (the
+ * sweep has not passed their xmax) whose y ranges overlap are halved
+ * until single segments are left, and only those are tested. The
+ * work goes with the chains that overlap, not with all pairs.
+ *
+ * Segments of one part may only meet where they join, end to end;
+ * rings may touch each other at points but not cross or overlap.
+ * Parts of a polyline may cross each other.
+ */
+
+#include "valid.h"
+
+#include <stdlib.h>
+
+typedef struct {
+  Double xmin, ymin, xmax, ymax;  /* of its ends */
+  Integer first, last;            /* its points, v[first..last] */
+  Integer part;
+} Chain;
+
+typedef struct {
+  const Point *p;
+  Integer *v;              /* points of the parts, no repeats in a row */
+  Integer *start;          /* of each part in v, and the end */
+  unsigned char *found;    /* kinds found, per part, as bits */
+  Integer *other;          /* the part it crosses, if that's said with it */
+  int rings;
+  long problems;
+} Check;
+
+#define BIT(problem) (1 << (problem))
+#define SKIP BIT(0)        /* too few points to look at */
+
+static void problem(Check *c, int what, Integer part, Integer other);
+static int same(const Point *a, const Point *b);
+static int quadrant(const Point *a, const Point *b);
+static int byxmin(const void *a, const void *b);
+static void overlaps(Check *c, const Chain *a, Integer a0, Integer a1,
+                     const Chain *b, Integer b0, Integer b1);
+static void segments(Check *c, Integer i, Integer partj, Integer j, Integer partk);
+static int meet(const Point *p, const Point *q, const Point *r, const Point *s);
+static int orient(const Point *a, const Point *b, const Point *c);
+static void orientation(Check *c, BoundingBox *box, Integer nparts);
+static int inside(const Check *c, Integer k, const Point *pt);
+
+long validate(Validator *v, const Point *points, Integer npoints,
+              const Integer *parts, Integer nparts, int rings,
+              void (*report)(void *arg, int problem, Integer part, Integer other),
+              void *arg)
+{
+  size_t need;
+  Check check, *c = &check;
+  Chain *chains;
+  BoundingBox *box;
+  Integer *active, nchains = 0, nactive, i, j, k, a, b, n;
+  char *m;
+
+  if ((npoints < 1) || (nparts < 1)) return 0;
+  need = npoints * sizeof(Chain) + nparts * sizeof(BoundingBox) +
+         (2*npoints + 2*nparts + 1) * sizeof(Integer) + nparts;
+  if (need > v->size) {
+    free(v->mem);
+    v->size = 0;
+    if ((v->mem = malloc(need)) == NULL) return -1;
+    v->size = need;
+  }
+  m = (char *) v->mem;
+  chains = (Chain *) m;                  m += npoints * sizeof(Chain);
+  box = (BoundingBox *) m;               m += nparts * sizeof(BoundingBox);
+  c->v = (Integer *) m;                  m += npoints * sizeof(Integer);
+  active = (Integer *) m;                m += npoints * sizeof(Integer);
+  c->start = (Integer *) m;              m += (nparts + 1) * sizeof(Integer);
+  c->other = (Integer *) m;              m += nparts * sizeof(Integer);
+  c->found = (unsigned char *) m;
+  c->p = points;
+  c->rings = rings;
+  c->problems = 0;
+
+  /* the points of each part, ends closed, enough of them */
+  for (j = 0, n = 0; j < nparts; j++) {
+    a = parts[j];
+    b = (j+1 < nparts) ? parts[j+1] : npoints;
+    if (a < 0) a = 0;
+    if (a > npoints) a = npoints;
+    if (b > npoints) b = npoints;
+    if (b < a) b = a;
+    c->found[j] = 0;
+    c->other[j] = -1;
+    c->start[j] = n;
+    for (i = a; i < b; i++)
+      if ((n == c->start[j]) || !same(&points[i], &points[c->v[n-1]])) c->v[n++] = i;
+    if (rings && (b > a) && !same(&points[a], &points[b-1])) problem(c, VALID_OPEN, j, -1);
+    if (n - c->start[j] < (rings ? 4 : 2)) {
+      problem(c, VALID_FEW, j, -1);
+      c->found[j] |= SKIP;
+    }
+  }
+  c->start[nparts] = n;
+
+  /* cut into chains */
+  for (j = 0; j < nparts; j++) {
+    if (c->found[j] & SKIP) continue;
+    for (i = c->start[j]; i + 1 < c->start[j+1]; i = k) {
+      int q = quadrant(&points[c->v[i]], &points[c->v[i+1]]);
+      Chain *ch = &chains[nchains++];
+      for (k = i + 1; (k + 1 < c->start[j+1]) &&
+                      (quadrant(&points[c->v[k]], &points[c->v[k+1]]) == q); k++);
+      ch->first = i;
+      ch->last = k;
+      ch->part = j;
+      a = c->v[i];
+      b = c->v[k];
+      ch->xmin = (points[a].x < points[b].x) ? points[a].x : points[b].x;
+      ch->xmax = (points[a].x < points[b].x) ? points[b].x : points[a].x;
+      ch->ymin = (points[a].y < points[b].y) ? points[a].y : points[b].y;
+      ch->ymax = (points[a].y < points[b].y) ? points[b].y : points[a].y;
+    }
+  }
+
+  /* sweep */
+  qsort(chains, nchains, sizeof(Chain), byxmin);
+  for (k = 0, nactive = 0; k < nchains; k++) {
+    const Chain *ch = &chains[k];
+    for (i = 0, n = 0; i < nactive; i++) {
+      const Chain *other = &chains[active[i]];
+      if (!(other->xmax >= ch->xmin)) continue;  /* passed */
+      active[n++] = active[i];
+      if ((other->ymax < ch->ymin) || (other->ymin > ch->ymax)) continue;
+      if (other->part == ch->part) {
+        if (c->found[ch->part] & BIT(VALID_SELF)) continue;
+      }
+      else if (!rings || ((c->found[ch->part] & BIT(VALID_CROSS)) &&
+                          (c->found[other->part] & BIT(VALID_CROSS))))
+        continue;
+      overlaps(c, other, other->first, other->last, ch, ch->first, ch->last);
+    }
+    nactive = n;
+    active[nactive++] = k;
+  }
+
+  if (rings) orientation(c, box, nparts);
+
+  /* say what was found by part, not in the order of the sweep */
+  for (j = 0; j < nparts; j++)
+    for (k = VALID_OPEN; k <= VALID_FLAT; k++) {
+      if (!(c->found[j] & BIT(k))) continue;
+      if (k != VALID_CROSS) report(arg, (int) k, j, -1);
+      else if (c->other[j] >= 0) report(arg, (int) k, j, c->other[j]);
+    }
+  return c->problems;
+}
+
+const char *validwhat(int problem)
+{
+  switch (problem) {
+    case VALID_OPEN: return "ring not closed";
+    case VALID_FEW: return "too few points";
+    case VALID_SELF: return "crosses itself";
+    case VALID_CROSS: return "rings cross";
+    case VALID_OUTER: return "outer ring not clockwise";
+    case VALID_HOLE: return "hole not counter-clockwise";
+    case VALID_FLAT: return "ring has no area";
+  }
+  return "invalid";
+}
+
+static void problem(Check *c, int what, Integer part, Integer other)
+{
+  if (c->found[part] & BIT(what)) return;
+  c->found[part] |= BIT(what);
+  if (other >= 0) {
+    c->found[other] |= BIT(what);
+    c->other[part] = other;
+  }
+  c->problems++;
+}
+
+static int same(const Point *a, const Point *b)
+{
+  return (a->x == b->x) && (a->y == b->y);
+}
+
+/* Which way a segment goes: segments in a chain go the same way */
+static int quadrant(const Point *a, const Point *b)
+{
+  if (b->x >= a->x) return (b->y >= a->y) ? 0 : 3;
+  return (b->y >= a->y) ? 1 : 2;
+}
+
+static int byxmin(const void *a, const void *b)
+{
+  const Chain *p = (const Chain *) a, *q = (const Chain *) b;
+  int np = (p->xmin != p->xmin), nq = (q->xmin != q->xmin);
+
+  if (np || nq) return nq - np;  /* NaNs first, gone at once */
+  return (p->xmin < q->xmin) ? -1 : (p->xmin > q->xmin) ? 1 : 0;
+}
+
+/* Points a0..a1 of one chain and b0..b1 of another, as far as their
+ * bboxes overlap: halve the longer until both are single segments */
+static void overlaps(Check *c, const Chain *a, Integer a0, Integer a1,
+                     const Chain *b, Integer b0, Integer b1)
+{
+  const Point *p = c->p, *pa = &p[c->v[a0]], *qa = &p[c->v[a1]];
+  const Point *pb = &p[c->v[b0]], *qb = &p[c->v[b1]];
+  Integer mid;
+
+  if ((a->part == b->part) ? (c->found[a->part] & BIT(VALID_SELF)) :
+      ((c->found[a->part] & BIT(VALID_CROSS)) && (c->found[b->part] & BIT(VALID_CROSS))))
+    return;  /* already said */
+  if ((((pa->x < qa->x) ? qa->x : pa->x) < ((pb->x < qb->x) ? pb->x : qb->x)) ||
+      (((pb->x < qb->x) ? qb->x : pb->x) < ((pa->x < qa->x) ? pa->x : qa->x)) ||
+      (((pa->y < qa->y) ? qa->y : pa->y) < ((pb->y < qb->y) ? pb->y : qb->y)) ||
+      (((pb->y < qb->y) ? qb->y : pb->y) < ((pa->y < qa->y) ? pa->y : qa->y)))
+    return;
+  if ((a1 - a0 == 1) && (b1 - b0 == 1)) {
+    segments(c, a0, a->part, b0, b->part);
+    return;
+  }
+  if (a1 - a0 >= b1 - b0) {
+    mid = (a0 + a1) / 2;
+    overlaps(c, a, a0, mid, b, b0, b1);
+    overlaps(c, a, mid, a1, b, b0, b1);
+  }
+  else {
+    mid = (b0 + b1) / 2;
+    overlaps(c, a, a0, a1, b, b0, mid);
+    overlaps(c, a, a0, a1, b, mid, b1);
+  }
+}
+
+#define NONE 0
+#define TOUCH 1            /* at a point that is the end of one of them */
+#define PROPER 2           /* in a point inside both */
+#define OVERLAP 3          /* along a stretch, collinear */
+
+/* Segment i (points v[i], v[i+1]) of part j and k of part l */
+static void segments(Check *c, Integer i, Integer j, Integer k, Integer l)
+{
+  const Point *p = c->p;
+  const Integer *v = c->v;
+  int how = meet(&p[v[i]], &p[v[i+1]], &p[v[k]], &p[v[k+1]]);
+  Integer first, last;
+
+  if (how == NONE) return;
+  if (j != l) {
+    if (how >= PROPER) problem(c, VALID_CROSS, (j < l) ? j : l, (j < l) ? l : j);
+    return;
+  }
+  first = c->start[j];
+  last = c->start[j+1] - 2;  /* its last segment */
+  if ((how == TOUCH) &&
+      ((i - k == 1) || (k - i == 1) ||
+       ((((i == first) && (k == last)) || ((k == first) && (i == last))) &&
+        same(&p[v[first]], &p[v[last+1]]))))
+    return;  /* where they join */
+  problem(c, VALID_SELF, j, -1);
+}
+
+/* How segments pq and rs meet */
+static int meet(const Point *p, const Point *q, const Point *r, const Point *s)
+{
+  int d1 = orient(r, s, p), d2 = orient(r, s, q);
+  int d3 = orient(p, q, r), d4 = orient(p, q, s);
+  Double lo, hi, a0, a1, b0, b1;
+
+  if (!d1 && !d2 && !d3 && !d4) {  /* collinear: compare along x or y */
+    int y = (p->x == q->x) && (r->x == s->x);
+    a0 = y ? p->y : p->x; a1 = y ? q->y : q->x;
+    b0 = y ? r->y : r->x; b1 = y ? s->y : s->x;
+    lo = (a0 < a1) ? a0 : a1;
+    if (((b0 < b1) ? b0 : b1) > lo) lo = (b0 < b1) ? b0 : b1;
+    hi = (a0 < a1) ? a1 : a0;
+    if (((b0 < b1) ? b1 : b0) < hi) hi = (b0 < b1) ? b1 : b0;
+    return (lo < hi) ? OVERLAP : (lo == hi) ? TOUCH : NONE;
+  }
+  if ((d1 * d2 > 0) || (d3 * d4 > 0)) return NONE;
+  if (!d1 || !d2 || !d3 || !d4) return TOUCH;
+  return PROPER;
+}
+
+/* Which side of ab is c on: 1 left, -1 right, 0 on the line */
+static int orient(const Point *a, const Point *b, const Point *c)
+{
+  Double t = (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+
+  return (t > 0) ? 1 : (t < 0) ? -1 : 0;
+}
+
+/* Rings inside an even number of others are outer rings and must
+ * be clockwise, the others holes, counter-clockwise */
+static void orientation(Check *c, BoundingBox *box, Integer nparts)
+{
+  const Point *p = c->p;
+  const Integer *v = c->v;
+  Integer i, j, k, depth;
+  Double area;
+
+  for (j = 0; j < nparts; j++) {
+    box[j].xmin = box[j].ymin = 1;
+    box[j].xmax = box[j].ymax = -1;  /* empty */
+    if (c->found[j] & SKIP) continue;
+    box[j].xmin = box[j].xmax = p[v[c->start[j]]].x;
+    box[j].ymin = box[j].ymax = p[v[c->start[j]]].y;
+    for (i = c->start[j] + 1; i < c->start[j+1]; i++) {
+      const Point *pt = &p[v[i]];
+      if (pt->x < box[j].xmin) box[j].xmin = pt->x;
+      if (pt->x > box[j].xmax) box[j].xmax = pt->x;
+      if (pt->y < box[j].ymin) box[j].ymin = pt->y;
+      if (pt->y > box[j].ymax) box[j].ymax = pt->y;
+    }
+  }
+  for (j = 0; j < nparts; j++) {
+    const Point *pt = &p[v[c->start[j]]];
+    if (c->found[j] & (SKIP | BIT(VALID_SELF))) continue;
+    for (area = 0, i = c->start[j] + 1; i + 1 < c->start[j+1]; i++)
+      area += (p[v[i]].x - pt->x) * (p[v[i+1]].y - pt->y) -
+              (p[v[i+1]].x - pt->x) * (p[v[i]].y - pt->y);
+    if (area == 0) { problem(c, VALID_FLAT, j, -1); continue; }
+    for (depth = 0, k = 0; k < nparts; k++)
+      if ((k != j) && (pt->x >= box[k].xmin) && (pt->x <= box[k].xmax) &&
+          (pt->y >= box[k].ymin) && (pt->y <= box[k].ymax) && inside(c, k, pt))
+        depth++;
+    if ((depth % 2 == 0) && (area > 0)) problem(c, VALID_OUTER, j, -1);
+    if ((depth % 2 == 1) && (area < 0)) problem(c, VALID_HOLE, j, -1);
+  }
+}
+
+/* Is pt inside ring k (even-odd rule)? */
+static int inside(const Check *c, Integer k, const Point *pt)
+{
+  const Point *p = c->p;
+  const Integer *v = c->v + c->start[k];
+  Integer n = c->start[k+1] - c->start[k], i, j;
+  int in = 0;
+
+  for (i = 0, j = n-1; i < n; j = i++) {
+    const Point *a = &p[v[i]], *b = &p[v[j]];
+    if (((a->y > pt->y) != (b->y > pt->y)) &&
+        (pt->x < (b->x - a->x) * (pt->y - a->y) / (b->y - a->y) + a->x))
+      in = !in;
+  }
+  return in;
+}
+
+#ifdef TEST
+/* Check some rings and lines with known problems, random ones on a
+ * small grid against testing all pairs of segments, and large ones.
+ * Exit 1 on any mismatch.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static unsigned long tests = 0, fails = 0;
+static int got[8];
+static Integer crossed[2];
+static Integer lastpart;  /* reported, to see they come in order */
+static int unordered;
+static Validator val = { 0, 0 };
+
+static void expect(int ok, const char *what)
+{
+  tests++;
+  if (!ok) { fails++; printf("%s\n", what); }
+}
+
+static void note(void *arg, int problem, Integer part, Integer other)
+{
+  (void) arg;
+  got[problem]++;
+  if (problem == VALID_CROSS) { crossed[0] = part; crossed[1] = other; }
+  if (part < lastpart) unordered = 1;
+  lastpart = part;
+}
+
+/* The problems found in n points given as x,y pairs, as bits */
+static int check(const Double *xy, Integer n, const Integer *parts,
+                 Integer nparts, int rings)
+{
+  static Point p[256];
+  Integer i;
+  int bits = 0;
+
+  for (i = 0; i < n; i++) { p[i].x = xy[2*i]; p[i].y = xy[2*i+1]; }
+  memset(got, 0, sizeof got);
+  lastpart = 0;
+  unordered = 0;
+  if (validate(&val, p, n, parts, nparts, rings, note, 0) < 0) return -1;
+  for (i = 1; i < 8; i++) if (got[i]) bits |= BIT(i);
+  return bits;
+}
+
+/* All pairs of segments of p[0..n-1], no repeats in a row */
+static int slowself(const Point *p, Integer n)
+{
+  Integer i, k;
+  int how;
+
+  for (i = 0; i + 1 < n; i++)
+    for (k = i + 1; k + 1 < n; k++) {
+      if ((how = meet(&p[i], &p[i+1], &p[k], &p[k+1])) == NONE) continue;
+      if ((how == TOUCH) &&
+          ((k == i + 1) || ((i == 0) && (k == n - 2) && same(&p[0], &p[n-1]))))
+        continue;
+      return 1;
+    }
+  return 0;
+}
+
+static int slowcross(const Point *p, Integer n, const Point *q, Integer m)
+{
+  Integer i, k;
+
+  for (i = 0; i + 1 < n; i++)
+    for (k = 0; k + 1 < m; k++)
+      if (meet(&p[i], &p[i+1], &q[k], &q[k+1]) >= PROPER) return 1;
+  return 0;
+}
+
+static unsigned long seed = 1;
+
+static long dice(long n)
+{
+  seed = (seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+  return (long) (seed / 2147483648.0 * n);
+}
+
+/* n points on a grid, none twice in a row, closed if ring */
+static void walk(Point *p, Integer n, int ring)
+{
+  Integer i;
+
+  for (i = 0; i < n; i++)
+    do {
+      p[i].x = dice(5);
+      p[i].y = dice(5);
+    } while ((i > 0) && (same(&p[i], &p[i-1]) ||
+                         (ring && (i == n-2) && same(&p[i], &p[0]))));
+  if (ring) p[n-1] = p[0];
+}
+
+int main(void)
+{
+  static const Double square[] = { 0,0, 0,1, 1,1, 1,0, 0,0 };
+  static const Double ccw[] = { 0,0, 1,0, 1,1, 0,1, 0,0 };
+  static const Double holed[] = { 0,0, 0,4, 4,4, 4,0, 0,0,  1,1, 2,1, 2,2, 1,2, 1,1 };
+  static const Double cwhole[] = { 0,0, 0,4, 4,4, 4,0, 0,0,  1,1, 1,2, 2,2, 2,1, 1,1 };
+  static const Double bowtie[] = { 0,0, 1,1, 1,0, 0,1, 0,0 };
+  static const Double open[] = { 0,0, 0,1, 1,1, 1,0 };
+  static const Double few[] = { 0,0, 0,1, 0,1, 0,0 };
+  static const Double crossing[] = { 0,0, 0,2, 2,2, 2,0, 0,0,  1,1, 1,3, 3,3, 3,1, 1,1 };
+  static const Double touching[] = { 0,0, 0,4, 4,4, 4,0, 0,0,  2,1, 1,2, 0,0, 2,1 };
+  static const Double spike[] = { 0,0, 0,1, 1,1, 3,1, 1,1, 1,0, 0,0 };
+  static const Double figure8[] = { 0,0, 0,1, 1,1, 1,2, 2,2, 2,1, 1,1, 1,0, 0,0 };
+  static const Double line[] = { 0,0, 2,2, 2,0, 0,2 };
+  static const Double lines[] = { 0,0, 2,2,  2,0, 0,2 };
+  static const Double twolines[] = { 10,0, 12,2, 12,0, 10,2,  0,0, 2,2, 2,0, 0,2 };
+  static const Integer one[] = { 0 }, two[] = { 0, 5 }, lines2[] = { 0, 2 };
+  static const Integer lines4[] = { 0, 4 };
+  static Point p[200000];
+  Integer parts[2], n, m, i, k;
+  int bits;
+
+  expect(check(square, 5, one, 1, 1) == 0, "square");
+  expect(check(ccw, 5, one, 1, 1) == BIT(VALID_OUTER), "counter-clockwise");
+  expect(check(holed, 10, two, 2, 1) == 0, "hole");
+  expect(check(cwhole, 10, two, 2, 1) == BIT(VALID_HOLE), "clockwise hole");
+  expect(check(bowtie, 5, one, 1, 1) == BIT(VALID_SELF), "bow-tie");
+  expect(check(open, 4, one, 1, 1) == BIT(VALID_OPEN), "open");
+  expect(check(few, 4, one, 1, 1) == BIT(VALID_FEW), "few");
+  bits = check(crossing, 10, two, 2, 1);
+  expect((bits & BIT(VALID_CROSS)) && (crossed[0] == 0) && (crossed[1] == 1), "crossing");
+  expect(check(touching, 9, two, 2, 1) == 0, "touching");
+  expect(check(spike, 7, one, 1, 1) == BIT(VALID_SELF), "spike");
+  expect(check(figure8, 9, one, 1, 1) == BIT(VALID_SELF), "figure 8");
+  expect(check(line, 4, one, 1, 0) == BIT(VALID_SELF), "line");
+  expect(check(lines, 4, lines2, 2, 0) == 0, "lines may cross");
+  expect((check(twolines, 8, lines4, 2, 0) == BIT(VALID_SELF)) && (got[VALID_SELF] == 2) &&
+         !unordered, "by part");
+  expect(check(lines, 4, lines2, 2, 1) == (BIT(VALID_OPEN) | BIT(VALID_FEW)), "not rings");
+  expect(check(square, 1, one, 1, 0) == BIT(VALID_FEW), "point");
+  expect(check(square, 0, one, 0, 1) == 0, "nothing");
+
+  /* random ones against all pairs */
+  for (k = 0; k < 20000; k++) {
+    int ring = k % 2;
+    n = 2 + ring*2 + dice(12);
+    walk(p, n, ring);
+    parts[0] = 0;
+    memset(got, 0, sizeof got);
+    if (validate(&val, p, n, parts, 1, ring, note, 0) < 0) break;
+    expect(!got[VALID_SELF] == !slowself(p, n), "random");
+  }
+  for (k = 0; k < 5000; k++) {
+    n = 4 + dice(8);
+    m = 4 + dice(8);
+    walk(p, n, 1);
+    walk(p + n, m, 1);
+    parts[0] = 0;
+    parts[1] = n;
+    memset(got, 0, sizeof got);
+    if (validate(&val, p, n + m, parts, 2, 1, note, 0) < 0) break;
+    expect(!got[VALID_CROSS] == !slowcross(p, n, p + n, m), "random rings");
+  }
+
+  /* a large circle with a hole, then with a dent through the hole */
+  n = 100000;
+  for (i = 0; i < n; i++) {
+    Double a = -2 * 3.14159265358979 * i / (n - 1);
+    p[i].x = 10 * cos(a); p[i].y = 10 * sin(a);
+    p[n+i].x = 5 * cos(-a); p[n+i].y = 5 * sin(-a);
+  }
+  p[n-1] = p[0];
+  p[2*n-1] = p[n];
+  parts[0] = 0;
+  parts[1] = n;
+  memset(got, 0, sizeof got);
+  expect(validate(&val, p, 2*n, parts, 2, 1, note, 0) == 0, "circles");
+  p[n/2].x = 0;
+  p[n/2].y = 0;
+  memset(got, 0, sizeof got);
+  expect((validate(&val, p, 2*n, parts, 2, 1, note, 0) == 1) && got[VALID_CROSS],
+         "dented circles");
+
+  free(val.mem);
+  printf("%lu tests, %lu failed\n", tests, fails);
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,40 @@
+/* valid.h - geometric validity of lines and polygon rings | GPL */
+
+#ifndef _VALID_H_
+#define _VALID_H_
+
+#include <stddef.h>
+
+#include "shapefile.h"
+
+#define VALID_OPEN      1  /* ring not closed */
+#define VALID_FEW       2  /* too few points (4 for a ring, 2 for a line) */
+#define VALID_SELF      3  /* part crosses or touches itself */
+#define VALID_CROSS     4  /* rings cross (or overlap) each other */
+#define VALID_OUTER     5  /* outer ring not clockwise */
+#define VALID_HOLE      6  /* hole not counter-clockwise */
+#define VALID_FLAT      7  /* ring without area */
+
+typedef struct {           /* memory for validate(), reused */
+  void *mem;               /* zero to start, free() when done */
+  size_t size;
+} Validator;
+
+/* Check the parts of a polyline, or the rings of a polygon if rings,
+ * and call report() for each problem found, at most once per kind
+ * and part (other is the second part for VALID_CROSS, else -1),
+ * at the end, by part and kind.
+ * Intersections are found with a sweep line over monotone chains
+ * of segments, not by testing all pairs; for rings, a hole is a
+ * ring inside an odd number of others. Return the number of
+ * problems, or -1 if out of memory.
+ */
+extern long validate(Validator *v, const Point *points, Integer npoints,
+                     const Integer *parts, Integer nparts, int rings,
+                     void (*report)(void *arg, int problem, Integer part, Integer other),
+                     void *arg);
+
+/* The problem in words, like "ring not closed" */
+extern const char *validwhat(int problem);
+
+#endif /* _VALID_H_ */
@@ -0,0 +1,273 @@
+/* vec.c - decode point arrays and their extent in one pass | GPL */
+
+/* Points in a shapefile are little endian x,y pairs of doubles,
+ * which on little endian machines is just what a Point array
+ * looks like in memory. So decoding is a copy, and we fold the
+ * min/max of the coordinates into that copy: one pass over the
+ * data instead of a memcpy() and a bboxadd() per point.
+ *
+ * On x86 there are SSE2 and AVX kernels that handle a point or
+ * two per instruction (x and y side by side in a register, so
+ * no shuffling is needed), chosen at run time; elsewhere and on
+ * big endian machines, plain C. MINPD/MAXPD return the second
+ * operand if either is a NaN, so with the accumulator there,
+ * NaNs are skipped just like the compares in bboxadd() do.
+ */
+
+#include "vec.h"
+#include "endian.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NOVEC)
+#define VECX86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+typedef void Kernel(Point *v, const unsigned char *p, long n, BoundingBox *bbox);
+
+static Kernel plain, swapped;
+#ifdef VECX86
+static Kernel sse2, avx;
+#endif
+
+static Kernel *kernel = plain;
+
+const char *vecinit(int endian)
+{
+  if (endian != ENDIAN_LITTLE) {
+    kernel = swapped;
+    return "swapped";
+  }
+#ifdef VECX86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx")) {
+    kernel = avx;
+    return "avx";
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    kernel = sse2;
+    return "sse2";
+  }
+#endif
+  kernel = plain;
+  return "plain";
+}
+
+void vecpoints(Point *v, const unsigned char *p, long n, BoundingBox *bbox)
+{
+  if (n > 0) kernel(v, p, n, bbox);
+}
+
+static void plain(Point *v, const unsigned char *p, long n, BoundingBox *bbox)
+{
+  Double xmin = bbox->xmin, ymin = bbox->ymin;
+  Double xmax = bbox->xmax, ymax = bbox->ymax;
+  long i;
+
+  memcpy(v, p, n * sizeof(Point));
+  for (i = 0; i < n; i++) {
+    if (v[i].x < xmin) xmin = v[i].x;
+    if (v[i].x > xmax) xmax = v[i].x;
+    if (v[i].y < ymin) ymin = v[i].y;
+    if (v[i].y > ymax) ymax = v[i].y;
+  }
+  bbox->xmin = xmin; bbox->ymin = ymin;
+  bbox->xmax = xmax; bbox->ymax = ymax;
+}
+
+static void swapped(Point *v, const unsigned char *p, long n, BoundingBox *bbox)
+{
+  Double *d = (Double *) v;
+  long i;
+
+  for (i = 0; i < 2*n; i++, p += 8) {
+    unsigned char *b = (unsigned char *) &d[i];
+    b[0] = p[7]; b[1] = p[6]; b[2] = p[5]; b[3] = p[4];
+    b[4] = p[3]; b[5] = p[2]; b[6] = p[1]; b[7] = p[0];
+  }
+  for (i = 0; i < n; i++) {
+    if (v[i].x < bbox->xmin) bbox->xmin = v[i].x;
+    if (v[i].x > bbox->xmax) bbox->xmax = v[i].x;
+    if (v[i].y < bbox->ymin) bbox->ymin = v[i].y;
+    if (v[i].y > bbox->ymax) bbox->ymax = v[i].y;
+  }
+}
+
+#ifdef VECX86
+
+__attribute__((target("sse2")))
+static void sse2(Point *v, const unsigned char *p, long n, BoundingBox *bbox)
+{
+  __m128d lo = _mm_set_pd(bbox->ymin, bbox->xmin);
+  __m128d hi = _mm_set_pd(bbox->ymax, bbox->xmax);
+  double *out = (double *) v;
+  long i;
+
+  for (i = 0; i < n; i++) {
+    __m128d a = _mm_loadu_pd((const double *) (p + 16*i));
+    _mm_storeu_pd(out + 2*i, a);
+    lo = _mm_min_pd(a, lo);
+    hi = _mm_max_pd(a, hi);
+  }
+  _mm_storeu_pd(&bbox->xmin, lo);  /* xmin, ymin adjacent */
+  _mm_storeu_pd(&bbox->xmax, hi);
+}
+
+__attribute__((target("avx")))
+static void avx(Point *v, const unsigned char *p, long n, BoundingBox *bbox)
+{
+  __m128d lo2 = _mm_set_pd(bbox->ymin, bbox->xmin);
+  __m128d hi2 = _mm_set_pd(bbox->ymax, bbox->xmax);
+  __m256d lo = _mm256_set_m128d(lo2, lo2), lo1 = lo;
+  __m256d hi = _mm256_set_m128d(hi2, hi2), hi1 = hi;
+  double *out = (double *) v;
+  long i;
+
+  for (i = 0; i + 4 <= n; i += 4) {  /* two points per register */
+    __m256d a = _mm256_loadu_pd((const double *) (p + 16*i));
+    __m256d b = _mm256_loadu_pd((const double *) (p + 16*i + 32));
+    _mm256_storeu_pd(out + 2*i, a);
+    _mm256_storeu_pd(out + 2*i + 4, b);
+    lo = _mm256_min_pd(a, lo);
+    hi = _mm256_max_pd(a, hi);
+    lo1 = _mm256_min_pd(b, lo1);
+    hi1 = _mm256_max_pd(b, hi1);
+  }
+  lo = _mm256_min_pd(lo1, lo);
+  hi = _mm256_max_pd(hi1, hi);
+  lo2 = _mm_min_pd(_mm256_extractf128_pd(lo, 1), _mm256_castpd256_pd128(lo));
+  hi2 = _mm_max_pd(_mm256_extractf128_pd(hi, 1), _mm256_castpd256_pd128(hi));
+  for (; i < n; i++) {
+    __m128d a = _mm_loadu_pd((const double *) (p + 16*i));
+    _mm_storeu_pd(out + 2*i, a);
+    lo2 = _mm_min_pd(a, lo2);
+    hi2 = _mm_max_pd(a, hi2);
+  }
+  _mm_storeu_pd(&bbox->xmin, lo2);
+  _mm_storeu_pd(&bbox->xmax, hi2);
+}
+
+#endif /* VECX86 */
+
+#ifdef TEST
+/* Check all kernels this machine can run against bboxadd()-like
+ * scalar code, on random arrays with NaNs, infinities and zeros
+ * of both signs, at all alignments. With -b, also time them on
+ * large arrays (a micro-benchmark). Exit 1 on any mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static struct { const char *name; Kernel *kernel; } kernels[] = {
+  { "plain", plain },
+#ifdef VECX86
+  { "sse2", sse2 },
+  { "avx", avx },
+#endif
+  { 0, 0 }
+};
+
+static int runnable(const char *name)
+{
+#ifdef VECX86
+  __builtin_cpu_init();
+  if (!strcmp(name, "sse2")) return __builtin_cpu_supports("sse2");
+  if (!strcmp(name, "avx")) return __builtin_cpu_supports("avx");
+#endif
+  return !strcmp(name, "plain");
+}
+
+static double pick(void)
+{
+  double inf = 1e308 * 10;
+
+  switch (rand() % 50) {
+    case 0: return inf - inf;
+    case 1: return inf;
+    case 2: return -inf;
+    case 3: return 0.0;
+    case 4: return -0.0;
+    default: return (rand() - RAND_MAX/2) / 1000.0;
+  }
+}
+
+static void reference(Point *v, const unsigned char *p, long n, BoundingBox *b)
+{
+  long i;
+
+  memcpy(v, p, n * sizeof(Point));
+  for (i = 0; i < n; i++) {
+    if (v[i].x < b->xmin) b->xmin = v[i].x;
+    if (v[i].x > b->xmax) b->xmax = v[i].x;
+    if (v[i].y < b->ymin) b->ymin = v[i].y;
+    if (v[i].y > b->ymax) b->ymax = v[i].y;
+  }
+}
+
+static void bench(void)
+{
+  long n = 1000000, reps = 50, i, k;
+  unsigned char *buf = (unsigned char *) malloc(n * sizeof(Point) + 8);
+  Point *v = (Point *) malloc(n * sizeof(Point));
+  BoundingBox b;
+
+  for (i = 0; i < 2*n; i++) {
+    double d = (rand() - RAND_MAX/2) / 1000.0;
+    memcpy(buf + 1 + 8*i, &d, 8);  /* misaligned, like in a file */
+  }
+  for (k = 0; kernels[k].name; k++) {
+    clock_t t;
+    double secs;
+    if (!runnable(kernels[k].name)) continue;
+    t = clock();
+    for (i = 0; i < reps; i++) {
+      b.xmin = b.ymin = 1e308; b.xmax = b.ymax = -1e308;
+      kernels[k].kernel(v, buf + 1, n, &b);
+    }
+    secs = (double) (clock() - t) / CLOCKS_PER_SEC;
+    printf("%-6s %8.1f MB/s  %6.1f Mpoints/s\n", kernels[k].name,
+           reps * n * sizeof(Point) / secs / 1e6, reps * n / secs / 1e6);
+  }
+  free(buf);
+  free(v);
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned char buf[16*64+16];
+  Point want[64], got[64];
+  unsigned long tests = 0, fails = 0;
+  int k, i, n, off, rep;
+
+  printf("vecinit: %s\n", vecinit(ENDIAN_LITTLE));
+  for (k = 0; kernels[k].name; k++) {
+    if (!runnable(kernels[k].name)) continue;
+    for (rep = 0; rep < 2000; rep++) {
+      BoundingBox b1, b2;
+      n = rep % 64;
+      off = rep % 16;
+      for (i = 0; i < 2*n; i++) {
+        double d = pick();
+        memcpy(buf + off + 8*i, &d, 8);
+      }
+      b1.xmin = b1.ymin = (rep & 1) ? 1e308 : 0.5;
+      b1.xmax = b1.ymax = (rep & 1) ? -1e308 : -0.5;
+      b2 = b1;
+      reference(want, buf + off, n, &b1);
+      kernels[k].kernel(got, buf + off, n, &b2);
+      tests++;
+      if (memcmp(want, got, n * sizeof(Point)) ||
+          (b1.xmin != b2.xmin) || (b1.ymin != b2.ymin) ||
+          (b1.xmax != b2.xmax) || (b1.ymax != b2.ymax)) {
+        if (fails++ < 20) printf("%s: mismatch for n=%d\n", kernels[k].name, n);
+      }
+    }
+  }
+  printf("%lu tests, %lu failed\n", tests, fails);
+  if ((argc > 1) && !strcmp(argv[1], "-b")) bench();
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,23 @@
+/* vec.h - decode point arrays and their extent in one pass | GPL */
+
+#ifndef _VEC_H_
+#define _VEC_H_
+
+#include "shapefile.h"
+
+#define vecinit shprvecinit  /* in the library, see input.h */
+#define vecpoints shprvecpoints
+
+/* Pick the fastest kernel this machine can run for the given
+ * byte order (ENDIAN_LITTLE or ENDIAN_BIG, see endian.h) and
+ * return its name. Call once, before any threads are started.
+ */
+extern const char *vecinit(int endian);
+
+/* Decode n points (little endian x,y pairs) from p into v and
+ * extend bbox by them, like bboxadd() for each point would: NaNs
+ * are ignored (only the sign of a zero bound may differ).
+ */
+extern void vecpoints(Point *v, const unsigned char *p, long n, BoundingBox *bbox);
+
+#endif /* _VEC_H_ */
@@ -0,0 +1,469 @@
+/* wkb.c - encode shapes as Well-Known Binary | GPL */
+
+/* Points become points, multipoints multipoints, polylines
+ * multilinestrings (one linestring per part), polygons
+ * multipolygons, multipatches polyhedral surfaces, and null
+ * shapes empty geometry collections.
+ *
+ * The parts of a polygon are rings: outer rings clockwise, holes
+ * counter-clockwise, in no particular order. A hole goes with the
+ * smallest outer ring that contains its first vertex (the inner one
+ * of an island in a lake in an island), else with the outer ring
+ * before it; a hole with neither is taken as an outer ring.
+ * In multipatches, the part types tell which rings go together,
+ * and triangle strips and fans make a polygon per triangle.
+ *
+ * The grouping is kept in owner[] (see wkbgroup() in wkb.h).
+ * Part indices from the file are clamped to the points there are.
+ */
+
+#include "wkb.h"
+
+#include <string.h>
+
+#define TRIANGLES WKB_TRIANGLES
+#define HOLE (-2)  /* while grouping */
+
+void wkbspan(const WkbShape *s, Integer j, Integer *first, Integer *end)
+{
+  Integer a = s->parts[j];
+  Integer b = (j+1 < s->nparts) ? s->parts[j+1] : s->npoints;
+
+  if (a < 0) a = 0;
+  if (a > s->npoints) a = s->npoints;
+  if (b > s->npoints) b = s->npoints;
+  if (b < a) b = a;
+  *first = a;
+  *end = b;
+}
+
+/* Twice the signed area of a ring: negative if clockwise */
+static Double area2(const Point *v, Integer n)
+{
+  Double sum = 0;
+  Integer i;
+
+  for (i = 1; i + 1 < n; i++)
+    sum += (v[i].x - v[0].x) * (v[i+1].y - v[0].y) -
+           (v[i+1].x - v[0].x) * (v[i].y - v[0].y);
+  return sum;
+}
+
+/* Is p inside the ring (even-odd rule)? */
+static int inside(const Point *v, Integer n, const Point *p)
+{
+  Integer i, j;
+  int in = 0;
+
+  for (i = 0, j = n-1; i < n; j = i++)
+    if (((v[i].y > p->y) != (v[j].y > p->y)) &&
+        (p->x < (v[j].x - v[i].x) * (p->y - v[i].y) / (v[j].y - v[i].y) + v[i].x))
+      in = !in;
+  return in;
+}
+
+static void rings(const WkbShape *s, Integer *owner)
+{
+  Integer j, k, a, b, c, e, last, outers = 0;
+  Double size, least;
+
+  for (j = 0; j < s->nparts; j++) {
+    wkbspan(s, j, &a, &b);
+    if (area2(s->points + a, b - a) <= 0) { owner[j] = j; outers++; }
+    else owner[j] = HOLE;
+  }
+  for (j = 0, last = -1; j < s->nparts; j++) {
+    if (owner[j] == j) { last = j; continue; }
+    owner[j] = last;
+    wkbspan(s, j, &a, &b);
+    if ((outers > 1) && (a < b)) for (k = 0, least = 0; k < s->nparts; k++) {
+      if ((k == j) || (owner[k] != k)) continue;
+      wkbspan(s, k, &c, &e);
+      if (!inside(s->points + c, e - c, s->points + a)) continue;
+      size = -area2(s->points + c, e - c);
+      if ((least > 0) && (size >= least)) continue;
+      owner[j] = k;
+      least = size;
+    }
+    if (owner[j] < 0) owner[j] = j;
+  }
+}
+
+static void patches(const WkbShape *s, Integer *owner)
+{
+  Integer j, last = -1;
+
+  for (j = 0; j < s->nparts; j++) switch (s->types[j]) {
+    case SHP_PART_TRIANGLESTRIP:
+    case SHP_PART_TRIANGLEFAN:
+      owner[j] = TRIANGLES;
+      last = -1;
+      break;
+    case SHP_PART_OUTERRING:
+    case SHP_PART_FIRSTRING:
+      owner[j] = last = j;
+      break;
+    case SHP_PART_INNERRING:
+      if ((last >= 0) && (s->types[last] == SHP_PART_OUTERRING)) owner[j] = last;
+      else owner[j] = j;
+      break;
+    case SHP_PART_RING:
+      if ((last >= 0) && (s->types[last] == SHP_PART_FIRSTRING)) owner[j] = last;
+      else owner[j] = j;
+      break;
+    default:
+      owner[j] = j;
+      last = -1;
+  }
+}
+
+void wkbgroup(const WkbShape *s, Integer *owner)
+{
+  if (s->types) patches(s, owner);
+  else rings(s, owner);
+}
+
+#define triangles(n) ((n) > 2 ? (n) - 2 : 0)
+
+size_t wkbsize(const WkbShape *s, Integer *owner)
+{
+  size_t coord = 8 * (2 + s->hasz + s->hasm);
+  size_t size = 9;  /* byte order, type, count */
+  Integer j, a, b;
+
+  switch (s->type) {
+    case WKB_POINT:
+      return 5 + coord;
+    case WKB_MULTIPOINT:
+      return size + s->npoints * (5 + coord);
+    case WKB_MULTILINESTRING:
+      for (j = 0; j < s->nparts; j++) {
+        wkbspan(s, j, &a, &b);
+        size += 9 + (b - a) * coord;
+      }
+      return size;
+    case WKB_MULTIPOLYGON:
+    case WKB_POLYHEDRALSURFACE:
+      wkbgroup(s, owner);
+      break;
+    default:
+      return size;
+  }
+  for (j = 0; j < s->nparts; j++) {
+    wkbspan(s, j, &a, &b);
+    if (owner[j] == TRIANGLES) size += triangles(b - a) * (9 + 4 + 4*coord);
+    else {
+      if (owner[j] == j) size += 9;
+      size += 4 + (b - a) * coord;
+    }
+  }
+  return size;
+}
+
+static unsigned char *puthead(unsigned char *p, const WkbShape *s, Integer type)
+{
+  unsigned int one = 1;
+
+  type += 1000*s->hasz + 2000*s->hasm;
+  *p++ = *(unsigned char *) &one;  /* byte order: 1 if little endian */
+  memcpy(p, &type, 4);
+  return p + 4;
+}
+
+static unsigned char *putcount(unsigned char *p, Integer n)
+{
+  memcpy(p, &n, 4);
+  return p + 4;
+}
+
+/* Coordinates of points a..b-1, straight from the arrays */
+static unsigned char *putcoords(unsigned char *p, const WkbShape *s, Integer a, Integer b)
+{
+  const Double *w = s->hasz ? s->z : s->m;
+  Integer i;
+
+  if (!s->hasz && !s->hasm) {
+    memcpy(p, s->points + a, (b - a) * sizeof(Point));
+    return p + (b - a) * sizeof(Point);
+  }
+  if (s->hasz && s->hasm) for (i = a; i < b; i++, p += 32) {
+    memcpy(p, &s->points[i], 16);
+    memcpy(p+16, &s->z[i], 8);
+    memcpy(p+24, &s->m[i], 8);
+  }
+  else for (i = a; i < b; i++, p += 24) {
+    memcpy(p, &s->points[i], 16);
+    memcpy(p+16, &w[i], 8);
+  }
+  return p;
+}
+
+static unsigned char *putring(unsigned char *p, const WkbShape *s, Integer j)
+{
+  Integer a, b;
+
+  wkbspan(s, j, &a, &b);
+  p = putcount(p, b - a);
+  return putcoords(p, s, a, b);
+}
+
+static unsigned char *putpolygon(unsigned char *p, const WkbShape *s,
+                                 const Integer *owner, Integer k)
+{
+  Integer j, n = 1;
+
+  for (j = 0; j < s->nparts; j++) if ((j != k) && (owner[j] == k)) n++;
+  p = puthead(p, s, 3);
+  p = putcount(p, n);
+  p = putring(p, s, k);
+  for (j = 0; j < s->nparts; j++)
+    if ((j != k) && (owner[j] == k)) p = putring(p, s, j);
+  return p;
+}
+
+static unsigned char *puttriangles(unsigned char *p, const WkbShape *s, Integer j)
+{
+  Integer a, b, i;
+  int fan = (s->types[j] == SHP_PART_TRIANGLEFAN);
+
+  wkbspan(s, j, &a, &b);
+  for (i = a; i + 2 < b; i++) {
+    Integer first = fan ? a : i;
+    p = puthead(p, s, 3);
+    p = putcount(p, 1);
+    p = putcount(p, 4);
+    p = putcoords(p, s, first, first+1);
+    p = putcoords(p, s, i+1, i+3);
+    p = putcoords(p, s, first, first+1);
+  }
+  return p;
+}
+
+void wkbwrite(unsigned char *p, const WkbShape *s, const Integer *owner)
+{
+  Integer i, j, a, b, n = 0;
+
+  switch (s->type) {
+    case WKB_POINT:
+      p = puthead(p, s, WKB_POINT);
+      (void) putcoords(p, s, 0, 1);
+      return;
+    case WKB_MULTIPOINT:
+      p = puthead(p, s, WKB_MULTIPOINT);
+      p = putcount(p, s->npoints);
+      for (i = 0; i < s->npoints; i++) {
+        p = puthead(p, s, WKB_POINT);
+        p = putcoords(p, s, i, i+1);
+      }
+      return;
+    case WKB_MULTILINESTRING:
+      p = puthead(p, s, WKB_MULTILINESTRING);
+      p = putcount(p, s->nparts);
+      for (j = 0; j < s->nparts; j++) {
+        p = puthead(p, s, 2);
+        p = putring(p, s, j);
+      }
+      return;
+    case WKB_MULTIPOLYGON:
+    case WKB_POLYHEDRALSURFACE:
+      break;
+    default:
+      p = puthead(p, s, s->type);
+      (void) putcount(p, 0);
+      return;
+  }
+  for (j = 0; j < s->nparts; j++) {
+    if (owner[j] == j) n++;
+    else if (owner[j] == TRIANGLES) {
+      wkbspan(s, j, &a, &b);
+      n += triangles(b - a);
+    }
+  }
+  p = puthead(p, s, s->type);
+  p = putcount(p, n);
+  for (j = 0; j < s->nparts; j++) {
+    if (owner[j] == j) p = putpolygon(p, s, owner, j);
+    else if (owner[j] == TRIANGLES) p = puttriangles(p, s, j);
+  }
+}
+
+#ifdef TEST
+/* Encode some shapes, decode the WKB back to text, and compare
+ * that with what we expect; check that sizes are exact. Exit 1
+ * on any mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+static char text[4096];
+static size_t tlen;
+
+static void emit(const char *s)
+{
+  size_t n = strlen(s);
+  if (tlen + n < sizeof text) { memcpy(text + tlen, s, n+1); tlen += n; }
+}
+
+static const unsigned char *getu32(const unsigned char *p, Integer *v)
+{
+  memcpy(v, p, 4);
+  return p + 4;
+}
+
+static const unsigned char *coords(const unsigned char *p, int dims)
+{
+  char buf[64];
+  Double v;
+  int k;
+
+  for (k = 0; k < dims; k++, p += 8) {
+    memcpy(&v, p, 8);
+    sprintf(buf, k ? " %g" : "%g", v);
+    emit(buf);
+  }
+  return p;
+}
+
+static const unsigned char *parse(const unsigned char *p)
+{
+  static const char *names[] = { "?", "POINT", "LINESTRING", "POLYGON",
+    "MULTIPOINT", "MULTILINESTRING", "MULTIPOLYGON", "GEOMETRYCOLLECTION" };
+  Integer type, n, m, i, k;
+  int dims;
+
+  p++;  /* byte order */
+  p = getu32(p, &type);
+  dims = 2 + (type/1000 == 1 || type/1000 == 3) + (type/1000 >= 2);
+  if (type/1000 == 1) emit("Z");
+  if (type/1000 == 2) emit("M");
+  if (type/1000 == 3) emit("ZM");
+  type %= 1000;
+  emit(type == 15 ? "SURFACE" : (type < 8) ? names[type] : "?");
+  emit("(");
+  switch (type) {
+    case 1: p = coords(p, dims); break;
+    case 2:
+      p = getu32(p, &n);
+      for (i = 0; i < n; i++) { if (i) emit(","); p = coords(p, dims); }
+      break;
+    case 3:
+      p = getu32(p, &n);
+      for (k = 0; k < n; k++) {
+        emit(k ? ",(" : "(");
+        p = getu32(p, &m);
+        for (i = 0; i < m; i++) { if (i) emit(","); p = coords(p, dims); }
+        emit(")");
+      }
+      break;
+    default:
+      p = getu32(p, &n);
+      for (i = 0; i < n; i++) { if (i) emit(","); p = parse(p); }
+  }
+  emit(")");
+  return p;
+}
+
+static unsigned long tests = 0, fails = 0;
+
+static void check(const char *name, const WkbShape *s, const char *want)
+{
+  unsigned char buf[4096];
+  Integer owner[64];
+  size_t size = wkbsize(s, owner);
+  const unsigned char *end;
+
+  memset(buf, 0xEE, sizeof buf);
+  wkbwrite(buf, s, owner);
+  tlen = 0;
+  text[0] = 0;
+  end = parse(buf);
+  tests++;
+  if ((end != buf + size) || (buf[size] != 0xEE) || strcmp(text, want)) {
+    fails++;
+    printf("%s: size %lu, parsed %ld\n  got  %s\n  want %s\n", name,
+           (unsigned long) size, (long) (end - buf), text, want);
+  }
+}
+
+int main(void)
+{
+  /* two squares, clockwise, holes in the second given first and last */
+  static Point sq[] = {
+    {0,0},{0,1},{1,1},{1,0},{0,0},                          /* outer A */
+    {12,2},{13,2},{13,3},{12,3},{12,2},                     /* hole in B */
+    {10,0},{10,10},{20,10},{20,0},{10,0},                   /* outer B */
+    {15,5},{16,5},{16,6},{15,6},{15,5}                      /* hole in B */
+  };
+  static Integer sqparts[] = { 0, 5, 10, 15 };
+  /* an island in a lake in an island, the inner lake given last */
+  static Point nest[] = {
+    {0,0},{0,10},{10,10},{10,0},{0,0},                      /* outer */
+    {2,2},{2,8},{8,8},{8,2},{2,2},                          /* island */
+    {1,1},{9,1},{9,9},{1,9},{1,1},                          /* lake */
+    {3,3},{7,3},{7,7},{3,7},{3,3}                           /* its lake */
+  };
+  static Point tri[] = { {0,0},{1,0},{0,1},{1,1},{2,2} };
+  static Double z[] = { 1, 2, 3, 4, 5 };
+  static Double m[] = { 9, 8, 7, 6, 5 };
+  static Integer strip[] = { 0 }, striptype[] = { SHP_PART_TRIANGLESTRIP };
+  static Integer fantype[] = { SHP_PART_TRIANGLEFAN };
+  static Integer bad[] = { 3, 1 };
+  static Point ring[] = { {0,0},{0,4},{4,4},{4,0},{0,0}, {1,1},{3,1},{3,3},{1,3},{1,1} };
+  static Integer ringparts[] = { 0, 5 };
+  static Integer ringtypes[] = { SHP_PART_FIRSTRING, SHP_PART_RING };
+  WkbShape s;
+
+  memset(&s, 0, sizeof s);
+  s.type = WKB_POINT; s.npoints = 1; s.points = tri + 4;
+  check("point", &s, "POINT(2 2)");
+  s.hasz = 1; s.z = z + 4;
+  check("pointz", &s, "ZPOINT(2 2 5)");
+  s.hasm = 1; s.m = m + 4;
+  check("pointzm", &s, "ZMPOINT(2 2 5 5)");
+  s.hasz = 0;
+  check("pointm", &s, "MPOINT(2 2 5)");
+
+  memset(&s, 0, sizeof s);
+  s.type = WKB_GEOMETRYCOLLECTION;
+  check("null", &s, "GEOMETRYCOLLECTION()");
+
+  s.type = WKB_MULTIPOINT; s.npoints = 2; s.points = tri;
+  check("multipoint", &s, "MULTIPOINT(POINT(0 0),POINT(1 0))");
+
+  s.type = WKB_MULTILINESTRING; s.nparts = 2; s.parts = bad; s.npoints = 5;
+  check("badparts", &s, "MULTILINESTRING(LINESTRING(),LINESTRING(1 0,0 1,1 1,2 2))");
+
+  memset(&s, 0, sizeof s);
+  s.type = WKB_MULTIPOLYGON; s.points = sq; s.npoints = 20;
+  s.parts = sqparts; s.nparts = 4;
+  check("multipolygon", &s, "MULTIPOLYGON("
+        "POLYGON((0 0,0 1,1 1,1 0,0 0)),"
+        "POLYGON((10 0,10 10,20 10,20 0,10 0),"
+        "(12 2,13 2,13 3,12 3,12 2),(15 5,16 5,16 6,15 6,15 5)))");
+  s.parts = sqparts + 3; s.nparts = 1; s.npoints = 20;  /* lone hole */
+  check("lonehole", &s, "MULTIPOLYGON(POLYGON((15 5,16 5,16 6,15 6,15 5)))");
+  s.points = nest; s.parts = sqparts; s.nparts = 4; s.npoints = 20;
+  check("nested", &s, "MULTIPOLYGON("
+        "POLYGON((0 0,0 10,10 10,10 0,0 0),(1 1,9 1,9 9,1 9,1 1)),"
+        "POLYGON((2 2,2 8,8 8,8 2,2 2),(3 3,7 3,7 7,3 7,3 3)))");
+
+  memset(&s, 0, sizeof s);
+  s.type = WKB_POLYHEDRALSURFACE; s.hasz = 1; s.points = tri; s.z = z;
+  s.npoints = 5; s.nparts = 1; s.parts = strip; s.types = striptype;
+  check("strip", &s, "ZSURFACE("
+        "ZPOLYGON((0 0 1,1 0 2,0 1 3,0 0 1)),"
+        "ZPOLYGON((1 0 2,0 1 3,1 1 4,1 0 2)),"
+        "ZPOLYGON((0 1 3,1 1 4,2 2 5,0 1 3)))");
+  s.npoints = 4; s.types = fantype;
+  check("fan", &s, "ZSURFACE("
+        "ZPOLYGON((0 0 1,1 0 2,0 1 3,0 0 1)),"
+        "ZPOLYGON((0 0 1,0 1 3,1 1 4,0 0 1)))");
+  s.points = ring; s.npoints = 10; s.nparts = 2; s.parts = ringparts;
+  s.types = ringtypes; s.hasz = 0;
+  check("rings", &s, "SURFACE(POLYGON((0 0,0 4,4 4,4 0,0 0),"
+        "(1 1,3 1,3 3,1 3,1 1)))");
+
+  printf("%lu tests, %lu failed\n", tests, fails);
+  return fails ? 1 : 0;
+}
+#endif
@@ -0,0 +1,50 @@
+/* wkb.h - encode shapes as Well-Known Binary | GPL */
+
+#ifndef _WKB_H_
+#define _WKB_H_
+
+#include <stddef.h>
+
+#include "shapefile.h"
+
+#define WKB_POINT               1  /* geometry types we write */
+#define WKB_MULTIPOINT          4
+#define WKB_MULTILINESTRING     5
+#define WKB_MULTIPOLYGON        6
+#define WKB_GEOMETRYCOLLECTION  7  /* empty, for null shapes */
+#define WKB_POLYHEDRALSURFACE  15  /* for multipatches */
+
+typedef struct {           /* a decoded shape, in its arrays */
+  int type;                /* WKB_... it becomes */
+  int hasz, hasm;
+  Integer nparts, npoints;
+  const Integer *parts;    /* first point of each part */
+  const Integer *types;    /* of parts, for multipatches */
+  const Point *points;
+  const Double *z, *m;     /* if hasz, hasm */
+} WkbShape;
+
+/* Find the points of part j: first to end-1 (part indices from
+ * the file clamped to the points there are) */
+extern void wkbspan(const WkbShape *s, Integer j, Integer *first, Integer *end);
+
+/* Group the parts of a multipolygon or polyhedral surface (rings,
+ * triangle strips and fans) into polygons: for each part, set
+ * owner[j] to j if it starts a polygon, to k if it's another ring
+ * of the polygon part k starts, or to WKB_TRIANGLES.
+ */
+extern void wkbgroup(const WkbShape *s, Integer *owner);
+#define WKB_TRIANGLES (-1)
+
+/* Return the size of the WKB for shape s. For multipolygons
+ * and polyhedral surfaces, this calls wkbgroup() to fill in
+ * owner[] (nparts entries) for wkbwrite().
+ */
+extern size_t wkbsize(const WkbShape *s, Integer *owner);
+
+/* Write the WKB for s, as sized by wkbsize(), in this machine's
+ * byte order (ISO type codes: +1000 for Z, +2000 M, +3000 ZM).
+ */
+extern void wkbwrite(unsigned char *buf, const WkbShape *s, const Integer *owner);
+
+#endif /* _WKB_H_ */